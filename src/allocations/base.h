@@ -1,5 +1,15 @@
 #pragma once
 
+// Destroys the allocator when it goes out of scope. Declare it before anything
+// that's allocated from it.
+struct RaiiAllocator {
+    vma::Allocator allocator;
+
+    ~RaiiAllocator() {
+        allocator.destroy();
+    }
+};
+
 struct AllocatedImage {
     vk::Image image;
     vma::Allocation allocation;
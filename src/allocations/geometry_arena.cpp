@@ -0,0 +1,96 @@
+#include "geometry_arena.h"
+
+#include "../util.h"
+
+GeometryArena::GeometryArena(
+    vma::Allocator allocator_,
+    vk::DeviceSize block_size_
+) :
+    allocator(allocator_),
+    block_size(block_size_) {}
+
+GeometryAllocation
+GeometryArena::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+    std::unique_lock lock(mutex);
+
+    auto create_info =
+        vma::VirtualAllocationCreateInfo {.size = size, .alignment = alignment};
+
+    for (uint32_t i = 0; i < blocks.size(); i++) {
+        vma::VirtualAllocation allocation;
+        vk::DeviceSize offset;
+
+        if (blocks[i].virtual_block.virtualAllocate(
+                &create_info,
+                &allocation,
+                &offset
+            )
+            == vk::Result::eSuccess) {
+            return {
+                .block_index = i,
+                .allocation = allocation,
+                .buffer = blocks[i].buffer.buffer,
+                .offset = offset,
+                .address = blocks[i].address + offset};
+        }
+    }
+
+    // Nothing had enough space, so add a new block. Anything bigger than the
+    // usual block size gets a block of its own.
+    auto new_block_size = std::max(size, block_size);
+
+    auto buffer = AllocatedBuffer(
+        vk::BufferCreateInfo {
+            .size = new_block_size,
+            .usage = vk::BufferUsageFlagBits::eTransferDst
+                | vk::BufferUsageFlagBits::eStorageBuffer
+                | vk::BufferUsageFlagBits::eShaderDeviceAddress},
+        {
+            .usage = vma::MemoryUsage::eAutoPreferDevice,
+        },
+        allocator,
+        "geometry arena block " + std::to_string(blocks.size())
+    );
+
+    auto device = allocator.getAllocatorInfo().device;
+    auto address = device.getBufferAddress({.buffer = buffer.buffer});
+
+    auto block_create_info = vma::VirtualBlockCreateInfo {.size = new_block_size};
+    vma::VirtualBlock virtual_block;
+    check_vk_result(vma::createVirtualBlock(&block_create_info, &virtual_block)
+    );
+
+    blocks.push_back(Block {
+        .buffer = std::move(buffer),
+        .address = address,
+        .virtual_block = virtual_block});
+
+    auto block_index = static_cast<uint32_t>(blocks.size() - 1);
+
+    vma::VirtualAllocation allocation;
+    vk::DeviceSize offset;
+    check_vk_result(
+        virtual_block.virtualAllocate(&create_info, &allocation, &offset)
+    );
+
+    return {
+        .block_index = block_index,
+        .allocation = allocation,
+        .buffer = blocks[block_index].buffer.buffer,
+        .offset = offset,
+        .address = address + offset};
+}
+
+void GeometryArena::free(const GeometryAllocation& allocation) {
+    std::unique_lock lock(mutex);
+
+    blocks[allocation.block_index].virtual_block.virtualFree(
+        allocation.allocation
+    );
+}
+
+GeometryArena::~GeometryArena() {
+    for (auto& block : blocks) {
+        block.virtual_block.destroy();
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "base.h"
+
+struct GeometryAllocation {
+    uint32_t block_index;
+    vma::VirtualAllocation allocation;
+    vk::Buffer buffer;
+    vk::DeviceSize offset;
+    uint64_t address;
+};
+
+// Suballocates vertex streams, indices, meshlets and mesh infos out of a few
+// large device-local buffers, instead of creating separate buffers for every
+// primitive. Shared with the meshes that are loaded into it so that they can
+// hand their ranges back when they're destroyed.
+struct GeometryArena {
+    struct Block {
+        AllocatedBuffer buffer;
+        uint64_t address;
+        vma::VirtualBlock virtual_block;
+    };
+
+    vma::Allocator allocator;
+    vk::DeviceSize block_size;
+    std::vector<Block> blocks;
+    // Allocations are made from the loading thread.
+    std::mutex mutex;
+
+    GeometryArena(vma::Allocator allocator_, vk::DeviceSize block_size_);
+
+    GeometryAllocation
+    allocate(vk::DeviceSize size, vk::DeviceSize alignment = 16);
+
+    void free(const GeometryAllocation& allocation);
+
+    ~GeometryArena();
+};
@@ -6,3 +6,11 @@ PersistentlyMappedBuffer::PersistentlyMappedBuffer(AllocatedBuffer buffer_) :
     mapped_ptr = buffer_info.pMappedData;
     assert(mapped_ptr);
 }
+
+void PersistentlyMappedBuffer::invalidate() {
+    buffer.allocator.invalidateAllocation(buffer.allocation, 0, VK_WHOLE_SIZE);
+}
+
+void PersistentlyMappedBuffer::flush() {
+    buffer.allocator.flushAllocation(buffer.allocation, 0, VK_WHOLE_SIZE);
+}
@@ -6,4 +6,12 @@ struct PersistentlyMappedBuffer {
     void* mapped_ptr;
 
     PersistentlyMappedBuffer(AllocatedBuffer buffer_);
+
+    // Make GPU writes visible to `mapped_ptr`. Needed before reading back, as
+    // the memory may be cached and not coherent. A no-op when it is coherent.
+    void invalidate();
+
+    // Make host writes through `mapped_ptr` visible to the GPU, and keep them
+    // from being thrown away by a later `invalidate`.
+    void flush();
 };
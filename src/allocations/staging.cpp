@@ -1,79 +1,277 @@
 #include "staging.h"
 
-AllocatedBuffer upload_via_staging_buffer(
-    const void* bytes,
+#include "../load_stats.h"
+#include "../util.h"
+
+PersistentlyMappedBuffer create_staging_buffer(
     size_t num_bytes,
+    vk::BufferUsageFlags extra_usage,
     vma::Allocator allocator,
-    vk::BufferUsageFlags desired_flags,
-    const std::string& name,
-    const vk::raii::CommandBuffer& command_buffer,
-    std::vector<AllocatedBuffer>& temp_buffers
+    const std::string& name
 ) {
-    auto staging_buffer_name = name + " staging buffer";
-    auto staging_buffer = PersistentlyMappedBuffer(AllocatedBuffer(
+    return PersistentlyMappedBuffer(AllocatedBuffer(
         vk::BufferCreateInfo {
             .size = num_bytes,
-            .usage = vk::BufferUsageFlagBits::eTransferSrc},
+            .usage = vk::BufferUsageFlagBits::eTransferSrc | extra_usage},
         {
             .flags = vma::AllocationCreateFlagBits::eMapped
                 | vma::AllocationCreateFlagBits::eHostAccessSequentialWrite,
             .usage = vma::MemoryUsage::eAuto,
         },
         allocator,
-        staging_buffer_name
+        name
     ));
-    std::memcpy(staging_buffer.mapped_ptr, bytes, num_bytes);
+}
 
-    auto final_buffer = AllocatedBuffer(
-        vk::BufferCreateInfo {
-            .size = num_bytes,
-            .usage = vk::BufferUsageFlagBits::eTransferDst | desired_flags},
-        {
-            .usage = vma::MemoryUsage::eAuto,
-        },
+StagingRing::StagingRing(
+    const vk::raii::Device& device_,
+    vma::Allocator allocator_,
+    const vk::raii::Queue& queue_,
+    uint32_t queue_family,
+    vk::DeviceSize budget,
+    uint32_t num_chunks,
+    std::mutex* queue_mutex_
+) :
+    device(device_),
+    queue(queue_),
+    queue_mutex(queue_mutex_),
+    allocator(allocator_),
+    buffer(create_staging_buffer(
+        budget,
+        vk::BufferUsageFlagBits::eShaderDeviceAddress,
         allocator,
-        name
+        "staging ring"
+    )),
+    buffer_address(device.getBufferAddress({.buffer = buffer.buffer.buffer})),
+    pool(device.createCommandPool({
+        .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+        .queueFamilyIndex = queue_family,
+    })),
+    // Keep chunk offsets nicely aligned.
+    chunk_size((budget / num_chunks) & ~vk::DeviceSize(255)) {
+    auto command_buffers =
+        device.allocateCommandBuffers(vk::CommandBufferAllocateInfo {
+            .commandPool = *pool,
+            .level = vk::CommandBufferLevel::ePrimary,
+            .commandBufferCount = num_chunks});
+
+    chunks.reserve(num_chunks);
+
+    for (uint32_t i = 0; i < num_chunks; i++) {
+        chunks.push_back(Chunk {
+            .command_buffer = std::move(command_buffers[i]),
+            .fence = device.createFence({}),
+            .offset = i * chunk_size});
+    }
+
+    begin_chunk(chunks[current]);
+}
+
+const vk::raii::CommandBuffer& StagingRing::command_buffer() const {
+    return chunks[current].command_buffer;
+}
+
+std::optional<StagingAllocation>
+StagingRing::try_allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+    auto& chunk = chunks[current];
+
+    auto start = ((chunk.used + alignment - 1) / alignment) * alignment;
+
+    if (start + size > chunk_size) {
+        return std::nullopt;
+    }
+
+    chunk.used = start + size;
+
+    auto offset = chunk.offset + start;
+
+    return StagingAllocation {
+        .mapped_ptr = static_cast<uint8_t*>(buffer.mapped_ptr) + offset,
+        .buffer = buffer.buffer.buffer,
+        .offset = offset,
+        .address = buffer_address + offset};
+}
+
+StagingAllocation
+StagingRing::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+    assert(size <= chunk_size);
+
+    if (auto allocation = try_allocate(size, alignment)) {
+        return allocation.value();
+    }
+
+    flush();
+
+    return try_allocate(size, alignment).value();
+}
+
+StagingAllocation StagingRing::allocate_dedicated(vk::DeviceSize size) {
+    auto dedicated = create_staging_buffer(
+        size,
+        vk::BufferUsageFlagBits::eShaderDeviceAddress,
+        allocator,
+        "oversized staging buffer"
     );
 
-    command_buffer.copyBuffer(
-        staging_buffer.buffer.buffer,
-        final_buffer.buffer,
-        {vk::BufferCopy {.srcOffset = 0, .dstOffset = 0, .size = num_bytes}}
+    auto allocation = StagingAllocation {
+        .mapped_ptr = dedicated.mapped_ptr,
+        .buffer = dedicated.buffer.buffer,
+        .offset = 0,
+        .address = device.getBufferAddress({.buffer = dedicated.buffer.buffer}
+        )};
+
+    // Freed once the chunk that uses it has finished executing.
+    chunks[current].oversized.push_back(std::move(dedicated.buffer));
+
+    return allocation;
+}
+
+void StagingRing::on_complete(std::function<void()> callback) {
+    chunks[current].on_complete.push_back(std::move(callback));
+}
+
+void StagingRing::flush() {
+    if (before_submit) {
+        before_submit();
+    }
+
+    auto& chunk = chunks[current];
+
+    chunk.command_buffer.end();
+
+    {
+        std::unique_lock<std::mutex> lock;
+        if (queue_mutex) {
+            lock = std::unique_lock(*queue_mutex);
+        }
+
+        ZoneScopedN("gpu submit");
+        auto timer = PhaseTimer(LoadStats::global().gpu_submit, chunk.used);
+
+        queue.submit(
+            vk::SubmitInfo {
+                .commandBufferCount = 1,
+                .pCommandBuffers = &*chunk.command_buffer},
+            *chunk.fence
+        );
+    }
+    chunk.in_flight = true;
+
+    current = (current + 1) % chunks.size();
+
+    begin_chunk(chunks[current]);
+}
+
+void StagingRing::poll() {
+    // Chunks are submitted in order, so go from the oldest to the newest and
+    // stop at the first one that's still executing.
+    for (size_t i = 1; i < chunks.size(); i++) {
+        auto& chunk = chunks[(current + i) % chunks.size()];
+
+        if (!chunk.in_flight) {
+            continue;
+        }
+
+        if (chunk.fence.getStatus() != vk::Result::eSuccess) {
+            break;
+        }
+
+        retire(chunk);
+    }
+}
+
+void StagingRing::finish() {
+    flush();
+
+    for (size_t i = 1; i < chunks.size(); i++) {
+        auto& chunk = chunks[(current + i) % chunks.size()];
+
+        if (chunk.in_flight) {
+            retire(chunk);
+        }
+    }
+}
+
+void StagingRing::begin_chunk(Chunk& chunk) {
+    if (chunk.in_flight) {
+        retire(chunk);
+    }
+
+    chunk.used = 0;
+    chunk.command_buffer.reset();
+    chunk.command_buffer.begin(
+        {.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit}
     );
+}
 
-    temp_buffers.push_back(std::move(staging_buffer.buffer));
+void StagingRing::retire(Chunk& chunk) {
+    {
+        ZoneScopedN("fence wait");
+        auto timer = PhaseTimer(LoadStats::global().fence_wait);
+        check_vk_result(device.waitForFences({*chunk.fence}, true, UINT64_MAX)
+        );
+    }
+    device.resetFences({*chunk.fence});
+    chunk.in_flight = false;
+    chunk.oversized.clear();
 
-    return final_buffer;
+    for (auto& callback : chunk.on_complete) {
+        callback();
+    }
+
+    chunk.on_complete.clear();
+}
+
+void copy_via_staging_buffer(
+    const void* bytes,
+    size_t num_bytes,
+    vk::Buffer dst_buffer,
+    vk::DeviceSize dst_offset,
+    StagingRing& staging
+) {
+    // Split large uploads up so that they can't exceed the staging budget.
+    size_t offset = 0;
+
+    while (offset < num_bytes) {
+        auto piece_size =
+            std::min<vk::DeviceSize>(num_bytes - offset, staging.chunk_size);
+        auto allocation = staging.allocate(piece_size);
+
+        {
+            ZoneScopedN("staging copy");
+            auto timer =
+                PhaseTimer(LoadStats::global().staging_copy, piece_size);
+            std::memcpy(
+                allocation.mapped_ptr,
+                static_cast<const uint8_t*>(bytes) + offset,
+                piece_size
+            );
+        }
+
+        staging.command_buffer().copyBuffer(
+            allocation.buffer,
+            dst_buffer,
+            {vk::BufferCopy {
+                .srcOffset = allocation.offset,
+                .dstOffset = dst_offset + offset,
+                .size = piece_size}}
+        );
+
+        offset += piece_size;
+    }
 }
 
-std::pair<AllocatedBuffer, size_t> upload_from_file_via_staging_buffer(
-    std::ifstream stream,
+AllocatedBuffer upload_via_staging_buffer(
+    const void* bytes,
+    size_t num_bytes,
     vma::Allocator allocator,
     vk::BufferUsageFlags desired_flags,
     const std::string& name,
-    const vk::raii::CommandBuffer& command_buffer,
-    std::vector<AllocatedBuffer>& temp_buffers
+    StagingRing& staging
 ) {
-    stream.seekg(0, stream.end);
-    uint32_t length = stream.tellg();
-    stream.seekg(0, stream.beg);
-    auto staging_buffer_name = name + " staging buffer";
-    auto staging_buffer = PersistentlyMappedBuffer(AllocatedBuffer(
-        vk::BufferCreateInfo {
-            .size = length,
-            .usage = vk::BufferUsageFlagBits::eTransferSrc},
-        {
-            .flags = vma::AllocationCreateFlagBits::eMapped
-                | vma::AllocationCreateFlagBits::eHostAccessSequentialWrite,
-            .usage = vma::MemoryUsage::eAuto,
-        },
-        allocator,
-        staging_buffer_name
-    ));
-    stream.read((char*)staging_buffer.mapped_ptr, length);
     auto final_buffer = AllocatedBuffer(
         vk::BufferCreateInfo {
-            .size = length,
+            .size = num_bytes,
             .usage = vk::BufferUsageFlagBits::eTransferDst | desired_flags},
         {
             .usage = vma::MemoryUsage::eAuto,
@@ -82,13 +280,7 @@ std::pair<AllocatedBuffer, size_t> upload_from_file_via_staging_buffer(
         name
     );
 
-    command_buffer.copyBuffer(
-        staging_buffer.buffer.buffer,
-        final_buffer.buffer,
-        {vk::BufferCopy {.srcOffset = 0, .dstOffset = 0, .size = length}}
-    );
+    copy_via_staging_buffer(bytes, num_bytes, final_buffer.buffer, 0, staging);
 
-    temp_buffers.push_back(std::move(staging_buffer.buffer));
-
-    return std::make_pair(std::move(final_buffer), length);
+    return final_buffer;
 }
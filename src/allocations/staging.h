@@ -1,20 +1,119 @@
+#pragma once
 #include "persistently_mapped.h"
 
-AllocatedBuffer upload_via_staging_buffer(
-    const void* bytes,
+PersistentlyMappedBuffer create_staging_buffer(
     size_t num_bytes,
+    vk::BufferUsageFlags extra_usage,
     vma::Allocator allocator,
-    vk::BufferUsageFlags desired_flags,
-    const std::string& name,
-    const vk::raii::CommandBuffer& command_buffer,
-    std::vector<AllocatedBuffer>& temp_buffers
+    const std::string& name
 );
 
-std::pair<AllocatedBuffer, size_t> upload_from_file_via_staging_buffer(
-    std::ifstream stream,
+struct StagingAllocation {
+    void* mapped_ptr;
+    vk::Buffer buffer;
+    vk::DeviceSize offset;
+    // For reading the staged data directly in a compute shader.
+    uint64_t address;
+};
+
+// A fixed-size staging buffer for uploads, split into chunks that each have
+// their own command buffer and fence. When the current chunk is full its
+// commands are submitted and recording moves onto the next chunk, waiting
+// for that chunk's previous submission to finish first if needed. This caps
+// the amount of host-visible memory used while loading, no matter how large
+// the scene is.
+//
+// Commands that read from an allocation have to be recorded into
+// `command_buffer()` before the next call to `allocate`, as that may
+// submit the current chunk.
+struct StagingRing {
+    struct Chunk {
+        vk::raii::CommandBuffer command_buffer;
+        vk::raii::Fence fence;
+        vk::DeviceSize offset;
+        vk::DeviceSize used = 0;
+        bool in_flight = false;
+        // Dedicated buffers for what couldn't fit into the chunk while it was
+        // being submitted.
+        std::vector<AllocatedBuffer> oversized;
+        std::vector<std::function<void()>> on_complete;
+    };
+
+    const vk::raii::Device& device;
+    const vk::raii::Queue& queue;
+    // Set when the queue is shared with another thread.
+    std::mutex* queue_mutex;
+    vma::Allocator allocator;
+    PersistentlyMappedBuffer buffer;
+    uint64_t buffer_address;
+    vk::raii::CommandPool pool;
+    vk::DeviceSize chunk_size;
+    std::vector<Chunk> chunks;
+    size_t current = 0;
+    // Called right before the current chunk is submitted, to record any
+    // commands that have been deferred until then. It can't call `allocate`,
+    // as that could recursively flush.
+    std::function<void()> before_submit;
+
+    StagingRing(
+        const vk::raii::Device& device_,
+        vma::Allocator allocator_,
+        const vk::raii::Queue& queue_,
+        uint32_t queue_family,
+        vk::DeviceSize budget,
+        uint32_t num_chunks = 4,
+        std::mutex* queue_mutex_ = nullptr
+    );
+
+    const vk::raii::CommandBuffer& command_buffer() const;
+
+    // Never submits anything. Returns `std::nullopt` if the current chunk
+    // doesn't have enough space left.
+    std::optional<StagingAllocation>
+    try_allocate(vk::DeviceSize size, vk::DeviceSize alignment = 16);
+
+    // `size` can be at most `chunk_size`, larger uploads have to be split up.
+    StagingAllocation
+    allocate(vk::DeviceSize size, vk::DeviceSize alignment = 16);
+
+    // Allocate a separate staging buffer that lives until the current chunk
+    // has finished executing. Never submits anything, so it's for small
+    // allocations made from `before_submit` once the chunk is full.
+    StagingAllocation allocate_dedicated(vk::DeviceSize size);
+
+    // Call `callback` on the loading thread once everything recorded so far
+    // has finished executing on the GPU.
+    void on_complete(std::function<void()> callback);
+
+    // Submit the current chunk and start recording into the next one.
+    void flush();
+
+    // Retire any submitted chunks that have finished, without blocking.
+    void poll();
+
+    // Submit everything and block until all uploads have completed.
+    void finish();
+
+  private:
+    void begin_chunk(Chunk& chunk);
+
+    void retire(Chunk& chunk);
+};
+
+// Copy `bytes` into a range of an existing buffer.
+void copy_via_staging_buffer(
+    const void* bytes,
+    size_t num_bytes,
+    vk::Buffer dst_buffer,
+    vk::DeviceSize dst_offset,
+    StagingRing& staging
+);
+
+AllocatedBuffer upload_via_staging_buffer(
+    const void* bytes,
+    size_t num_bytes,
     vma::Allocator allocator,
     vk::BufferUsageFlags desired_flags,
     const std::string& name,
-    const vk::raii::CommandBuffer& command_buffer,
-    std::vector<AllocatedBuffer>& temp_buffers
+    StagingRing& staging
 );
@@ -0,0 +1,538 @@
+#include "benchmarks.h"
+
+#include "resources/bounding_sphere.h"
+#include "resources/image_loading.h"
+#include "resources/mesh_loading.h"
+#include "resources/position_kernels.h"
+#include "thread_pool.h"
+
+// Run `func` a few times and return the best vertices per second.
+template<class F>
+double vertices_per_second(size_t num_vertices, const F& func) {
+    double best_seconds = std::numeric_limits<double>::max();
+
+    for (int i = 0; i < 10; i++) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        best_seconds = std::min(best_seconds, elapsed.count());
+    }
+
+    return double(num_vertices) / best_seconds;
+}
+
+void print_result(const char* kernel, const char* level, double rate) {
+    std::cout << kernel << " (" << level << "): " << rate / 1'000'000.0
+              << " million vertices/s" << std::endl;
+}
+
+void benchmark_kernels() {
+    const size_t num_vertices = 1 << 22;
+
+    // Points scattered inside a sphere, so that the bounding sphere grows
+    // a realistic number of times.
+    std::vector<uint16_t> padded(num_vertices * 4);
+    std::mt19937 rng(0);
+    std::normal_distribution<float> distribution(32768.0f, 8000.0f);
+    for (size_t i = 0; i < num_vertices * 4; i++) {
+        padded[i] = i % 4 == 3 ? 0
+                               : uint16_t(std::clamp(
+                                   distribution(rng),
+                                   0.0f,
+                                   65535.0f
+                               ));
+    }
+
+    std::vector<float> positions(num_vertices * 3);
+
+    // What `process_primitive` used to do.
+    print_result(
+        "dequantize",
+        "baseline",
+        vertices_per_second(num_vertices, [&]() {
+            for (size_t i = 0; i < num_vertices; i++) {
+                positions[i * 3] = float(padded[i * 4]);
+                positions[i * 3 + 1] = float(padded[i * 4 + 1]);
+                positions[i * 3 + 2] = float(padded[i * 4 + 2]);
+            }
+        })
+    );
+
+    float baseline_sphere[4];
+    print_result(
+        "bounding sphere",
+        "baseline",
+        vertices_per_second(num_vertices, [&]() {
+            computeBoundingSphere(
+                baseline_sphere,
+                positions.data(),
+                num_vertices
+            );
+        })
+    );
+
+    auto levels = std::array {
+        KernelLevel::Scalar,
+        KernelLevel::Sse41,
+        KernelLevel::Avx2};
+
+    for (auto level : levels) {
+        // Don't run instructions that the CPU doesn't have.
+        if (level > detected_kernel_level()) {
+            continue;
+        }
+
+        print_result(
+            "dequantize",
+            kernel_level_name(level),
+            vertices_per_second(num_vertices, [&]() {
+                dequantize_positions(
+                    padded.data(),
+                    positions.data(),
+                    num_vertices,
+                    level
+                );
+            })
+        );
+
+        glm::vec4 sphere;
+        print_result(
+            "bounding sphere",
+            kernel_level_name(level),
+            vertices_per_second(num_vertices, [&]() {
+                sphere = compute_bounding_sphere(
+                    padded.data(),
+                    num_vertices,
+                    level
+                );
+            })
+        );
+
+        if (sphere != glm::vec4(
+                baseline_sphere[0],
+                baseline_sphere[1],
+                baseline_sphere[2],
+                baseline_sphere[3]
+            )) {
+            dbg(kernel_level_name(level), sphere.x, sphere.y, sphere.z, sphere.w
+            );
+            abort();
+        }
+    }
+}
+
+struct VertexFetchTotals {
+    double bytes_fetched = 0.0;
+    double bytes_referenced = 0.0;
+    double build_seconds = 0.0;
+};
+
+void print_vertex_fetch(const char* order, const VertexFetchTotals& totals) {
+    std::cout << "vertex fetch (" << order
+              << "): " << totals.bytes_fetched / (1024.0 * 1024.0)
+              << " MiB fetched, overfetch "
+              << totals.bytes_fetched / totals.bytes_referenced
+              << ", meshlets built in " << totals.build_seconds << "s"
+              << std::endl;
+}
+
+void benchmark_vertex_fetch(const std::filesystem::path& gltf_filepath) {
+    auto asset = parse_gltf(gltf_filepath);
+    auto source_buffers =
+        map_gltf_buffers(asset, gltf_filepath.parent_path());
+    auto mesh_nodes = collect_mesh_nodes(asset);
+    auto jobs = gather_primitive_jobs(asset, gltf_filepath, mesh_nodes);
+
+    // The packed sizes of the position, normal and uv streams, which are
+    // each fetched from their own buffer.
+    auto strides = std::array {
+        sizeof(uint16_t) * 3,
+        sizeof(int8_t) * 3,
+        sizeof(uint16_t) * 2};
+
+    VertexFetchTotals original;
+    VertexFetchTotals optimized;
+
+    for (auto& job : jobs) {
+        auto& positions =
+            get_accessor(asset, job.primitive, "POSITION", job.name);
+        auto& indices = asset.accessors[job.primitive.indicesAccessor.value()];
+        bool uses_32_bit_indices =
+            indices.componentType == fastgltf::ComponentType::UnsignedInt;
+
+        auto* uint_positions = reinterpret_cast<const uint16_t*>(
+            accessor_data(asset, positions, source_buffers)
+        );
+
+        std::vector<float> float_positions(positions.count * 3);
+        dequantize_positions(
+            uint_positions,
+            float_positions.data(),
+            positions.count
+        );
+
+        for (auto optimize : {false, true}) {
+            auto& totals = optimize ? optimized : original;
+
+            auto config = MeshletConfig::global();
+            config.optimize_vertex_order = optimize;
+            config.build_lods = false;
+
+            auto start = std::chrono::steady_clock::now();
+            auto meshlets = build_meshlets(
+                accessor_data(asset, indices, source_buffers),
+                indices.count,
+                float_positions.data(),
+                positions.count,
+                uses_32_bit_indices,
+                compute_mesh_bounds(uint_positions, positions.count),
+                config
+            );
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            totals.build_seconds += elapsed.count();
+
+            for (auto stride : strides) {
+                auto stats = meshlet_vertex_fetch_statistics(
+                    meshlets,
+                    positions.count,
+                    stride
+                );
+                totals.bytes_fetched += stats.bytes_fetched;
+                // `overfetch` is relative to the unique vertices used.
+                if (stats.overfetch > 0.0f) {
+                    totals.bytes_referenced +=
+                        double(stats.bytes_fetched) / stats.overfetch;
+                }
+            }
+        }
+    }
+
+    print_vertex_fetch("original", original);
+    print_vertex_fetch("optimized", optimized);
+}
+
+// Everything built with one config, summed over all the primitives.
+struct MeshletConfigTotals {
+    double build_seconds = 0.0;
+    size_t meshlets = 0;
+    size_t triangles = 0;
+    // Summed over all the viewpoints.
+    size_t draws = 0;
+    size_t triangles_drawn = 0;
+    double position_bytes_fetched = 0.0;
+    double position_bytes_referenced = 0.0;
+};
+
+// How many frames each config's render run averages over.
+const static uint32_t MESHLET_CONFIG_GPU_TIMING_FRAMES = 200;
+
+// Render `gltf_filepath` with `config` in a fresh process and return the
+// `--gpu-timings` line that it prints, or nothing if it didn't print one.
+std::optional<std::string> meshlet_config_gpu_timings(
+    const std::filesystem::path& executable,
+    const std::filesystem::path& gltf_filepath,
+    const MeshletConfig& config
+) {
+    auto quote = [](const std::string& string) {
+        std::string quoted = "'";
+        for (auto character : string) {
+            if (character == '\'') {
+                quoted += "'\\''";
+            } else {
+                quoted += character;
+            }
+        }
+        return quoted + "'";
+    };
+
+    std::stringstream command;
+    command << quote(executable.string()) << " --meshlet-config "
+            << config.max_vertices << ',' << config.max_triangles << ','
+            << config.cone_weight << " --gpu-timings "
+            << MESHLET_CONFIG_GPU_TIMING_FRAMES << ' '
+            << quote(gltf_filepath.string()) << " 2>/dev/null";
+
+    auto* pipe = popen(command.str().c_str(), "r");
+
+    if (!pipe) {
+        dbg(command.str(), "could not be run");
+        return std::nullopt;
+    }
+
+    std::optional<std::string> timings = std::nullopt;
+    std::array<char, 1024> line;
+
+    while (std::fgets(line.data(), line.size(), pipe)) {
+        auto string = std::string(line.data());
+
+        if (string.starts_with("gpu timings")) {
+            while (!string.empty() && string.back() == '\n') {
+                string.pop_back();
+            }
+            timings = string;
+        }
+    }
+
+    pclose(pipe);
+
+    return timings;
+}
+
+void benchmark_meshlet_configs(
+    const std::filesystem::path& gltf_filepath,
+    const std::filesystem::path& executable
+) {
+    auto asset = parse_gltf(gltf_filepath);
+    auto source_buffers =
+        map_gltf_buffers(asset, gltf_filepath.parent_path());
+    auto mesh_nodes = collect_mesh_nodes(asset);
+    auto jobs = gather_primitive_jobs(asset, gltf_filepath, mesh_nodes);
+
+    // Vertex and triangle limits around meshoptimizer's recommended 64/124.
+    auto sizes = std::array {
+        std::pair {32u, 64u},
+        std::pair {64u, 64u},
+        std::pair {64u, 124u},
+        std::pair {128u, 124u},
+        std::pair {128u, 252u}};
+    auto cone_weights = std::array {0.0f, 0.25f, 0.5f};
+
+    // Each primitive is looked at from both sides of every axis, from twice
+    // its radius away.
+    auto view_directions = std::array {
+        glm::vec3(1, 0, 0),
+        glm::vec3(-1, 0, 0),
+        glm::vec3(0, 1, 0),
+        glm::vec3(0, -1, 0),
+        glm::vec3(0, 0, 1),
+        glm::vec3(0, 0, -1)};
+
+    std::vector<MeshletConfig> configs;
+    for (auto [max_vertices, max_triangles] : sizes) {
+        for (auto cone_weight : cone_weights) {
+            configs.push_back(MeshletConfig {
+                .max_vertices = max_vertices,
+                .max_triangles = max_triangles,
+                .cone_weight = cone_weight,
+                .optimize_vertex_order = true,
+                .build_lods = false});
+        }
+    }
+
+    std::vector<MeshletConfigTotals> totals(configs.size());
+
+    for (auto& job : jobs) {
+        auto& positions =
+            get_accessor(asset, job.primitive, "POSITION", job.name);
+        auto& indices = asset.accessors[job.primitive.indicesAccessor.value()];
+        bool uses_32_bit_indices =
+            indices.componentType == fastgltf::ComponentType::UnsignedInt;
+
+        auto* uint_positions = reinterpret_cast<const uint16_t*>(
+            accessor_data(asset, positions, source_buffers)
+        );
+
+        std::vector<float> float_positions(positions.count * 3);
+        dequantize_positions(
+            uint_positions,
+            float_positions.data(),
+            positions.count
+        );
+
+        auto bounds = compute_mesh_bounds(uint_positions, positions.count);
+        auto bounding_sphere = bounds.bounding_sphere;
+
+        for (size_t i = 0; i < configs.size(); i++) {
+            auto& config_totals = totals[i];
+
+            auto start = std::chrono::steady_clock::now();
+            auto meshlets = build_meshlets(
+                accessor_data(asset, indices, source_buffers),
+                indices.count,
+                float_positions.data(),
+                positions.count,
+                uses_32_bit_indices,
+                bounds,
+                configs[i]
+            );
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            config_totals.build_seconds += elapsed.count();
+
+            config_totals.meshlets += meshlets.meshlets.size();
+
+            // The same test as `cull_cone_perspective`.
+            for (auto& part : meshlets.parts) {
+                for (auto j = part.first_meshlet;
+                     j < part.first_meshlet + part.num_meshlets;
+                     j++) {
+                    auto& meshlet = meshlets.meshlets[j];
+                    auto triangles = meshlet_triangle_count(meshlet);
+                    auto sphere = meshlet_bounding_sphere(
+                        meshlet,
+                        part.bounds.bounding_sphere
+                    );
+                    auto axis = meshlet_cone_axis(meshlet);
+                    auto cutoff = meshlet_cone_cutoff(meshlet);
+
+                    config_totals.triangles += triangles;
+
+                    for (auto direction : view_directions) {
+                        auto camera = glm::vec3(bounding_sphere)
+                            + direction * bounding_sphere.w * 2.0f;
+                        auto offset = glm::vec3(sphere) - camera;
+
+                        if (glm::dot(offset, axis)
+                            < cutoff * glm::length(offset) + sphere.w) {
+                            config_totals.draws++;
+                            config_totals.triangles_drawn += triangles;
+                        }
+                    }
+                }
+            }
+
+            auto stats = meshlet_vertex_fetch_statistics(
+                meshlets,
+                positions.count,
+                sizeof(uint16_t) * 3
+            );
+            config_totals.position_bytes_fetched += stats.bytes_fetched;
+            if (stats.overfetch > 0.0f) {
+                config_totals.position_bytes_referenced +=
+                    double(stats.bytes_fetched) / stats.overfetch;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < configs.size(); i++) {
+        auto& config_totals = totals[i];
+        auto gpu_timings =
+            meshlet_config_gpu_timings(executable, gltf_filepath, configs[i]);
+        auto meshlets = double(config_totals.meshlets);
+        auto triangles = double(config_totals.triangles);
+        auto views = double(view_directions.size());
+
+        auto fullness = triangles / (meshlets * configs[i].max_triangles);
+        auto culled = 1.0 - config_totals.triangles_drawn / (triangles * views);
+        auto overfetch = config_totals.position_bytes_fetched
+            / config_totals.position_bytes_referenced;
+
+        std::cout << configs[i].cache_key() << ": " << meshlets
+                  << " meshlets, " << triangles / meshlets
+                  << " triangles per meshlet (" << fullness * 100.0
+                  << "% full), " << culled * 100.0
+                  << "% of triangles cone culled, "
+                  << config_totals.draws / views
+                  << " draws per view, position overfetch " << overfetch
+                  << ", built in " << config_totals.build_seconds << "s"
+                  << std::endl;
+        std::cout << "    "
+                  << gpu_timings.value_or("gpu timings unavailable")
+                  << std::endl;
+    }
+}
+
+// Run `func` a few times and return the best megabytes per second.
+template<class F>
+double megabytes_per_second(size_t num_bytes, const F& func) {
+    double best_seconds = std::numeric_limits<double>::max();
+
+    for (int i = 0; i < 5; i++) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        best_seconds = std::min(best_seconds, elapsed.count());
+    }
+
+    return double(num_bytes) / 1'000'000.0 / best_seconds;
+}
+
+void benchmark_ktx2(const std::vector<std::filesystem::path>& filepaths) {
+    std::vector<ImageSource> sources;
+    sources.reserve(filepaths.size());
+
+    struct Level {
+        size_t source;
+        const LevelSource& level;
+        std::vector<uint8_t> destination;
+    };
+
+    std::vector<Level> levels;
+    size_t num_bytes = 0;
+
+    for (auto& filepath : filepaths) {
+        sources.push_back(parse_image(filepath));
+    }
+
+    for (size_t i = 0; i < sources.size(); i++) {
+        for (auto& level : sources[i].levels) {
+            levels.push_back(Level {
+                .source = i,
+                .level = level,
+                .destination =
+                    std::vector<uint8_t>(level.uncompressed_size)});
+            num_bytes += level.uncompressed_size;
+        }
+    }
+
+    std::cout << sources.size() << " images, " << levels.size()
+              << " levels, " << num_bytes / 1'000'000.0 << " MB" << std::endl;
+
+    // What `load_ktx2_image` used to do.
+    auto baseline = megabytes_per_second(num_bytes, [&]() {
+        for (auto& level : levels) {
+            auto& source = level.level;
+            std::ifstream stream(filepaths[level.source], std::ios::binary);
+            stream.seekg(static_cast<std::ifstream::off_type>(source.offset));
+
+            if (!source.is_zstd_compressed) {
+                stream.read(
+                    reinterpret_cast<char*>(level.destination.data()),
+                    static_cast<std::streamsize>(source.size)
+                );
+                continue;
+            }
+
+            std::vector<uint8_t> compressed_bytes(source.size);
+            stream.read(
+                reinterpret_cast<char*>(compressed_bytes.data()),
+                static_cast<std::streamsize>(source.size)
+            );
+            auto bytes_decompressed = ZSTD_decompress(
+                level.destination.data(),
+                source.uncompressed_size,
+                compressed_bytes.data(),
+                source.size
+            );
+            assert(bytes_decompressed == source.uncompressed_size);
+        }
+    });
+
+    auto serial = megabytes_per_second(num_bytes, [&]() {
+        for (auto& level : levels) {
+            write_level(
+                level.level,
+                sources[level.source].file,
+                level.destination.data()
+            );
+        }
+    });
+
+    auto parallel = megabytes_per_second(num_bytes, [&]() {
+        parallel_for(levels.size(), [&](size_t i) {
+            write_level(
+                levels[i].level,
+                sources[levels[i].source].file,
+                levels[i].destination.data()
+            );
+        });
+    });
+
+    std::cout << "baseline: " << baseline << " MB/s" << std::endl;
+    std::cout << "mapped, reused contexts: " << serial << " MB/s" << std::endl;
+    std::cout << "mapped, reused contexts, parallel: " << parallel << " MB/s"
+              << std::endl;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// Micro-benchmarks for the load-time CPU kernels, run with
+// `lighthugger --bench-kernels`.
+void benchmark_kernels();
+
+// Compare the bytes that rendering a gltf scene's meshlets would fetch from
+// the vertex streams with and without `MeshletConfig::optimize_vertex_order`,
+// run with `lighthugger --bench-vertex-fetch <scene.gltf>`.
+void benchmark_vertex_fetch(const std::filesystem::path& gltf_filepath);
+
+// Build a gltf scene's meshlets with a sweep of `MeshletConfig`s and print
+// the meshlet counts, how full they are, how well they cone cull from a few
+// viewpoints, the resulting draw counts and the position overfetch, run with
+// `lighthugger --bench-meshlets <scene.gltf>`. Each config is then rendered
+// from the default camera by running `executable` with `--gpu-timings`, which
+// builds the meshlets the way the renderer does (so with LODs), and the GPU
+// time per pass is printed under its CPU numbers.
+void benchmark_meshlet_configs(
+    const std::filesystem::path& gltf_filepath,
+    const std::filesystem::path& executable
+);
+
+// Decode the levels of a set of `.ktx2` images into memory the way image
+// loading used to (a fresh read buffer and zstd context per level, one level
+// at a time) and the way it does now, and print the MB/s of both, run with
+// `lighthugger --bench-ktx2 <image.ktx2>...`.
+void benchmark_ktx2(const std::vector<std::filesystem::path>& filepaths);
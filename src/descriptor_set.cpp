@@ -31,7 +31,7 @@ create_descriptor_set_layouts(const vk::raii::Device& device) {
         vk::DescriptorSetLayoutBinding {
             .binding = 0,
             .descriptorType = vk::DescriptorType::eSampledImage,
-            .descriptorCount = 512,
+            .descriptorCount = MAX_BINDLESS_TEXTURES,
             .stageFlags = vk::ShaderStageFlagBits::eCompute
                 | vk::ShaderStageFlagBits::eFragment,
         },
@@ -110,7 +110,11 @@ create_descriptor_set_layouts(const vk::raii::Device& device) {
 
     std::vector<vk::DescriptorBindingFlags> flags(everything_bindings.size());
     // Set the images as being partially bound, so not all slots have to be used.
-    flags[0] = vk::DescriptorBindingFlagBits::ePartiallyBound;
+    // They're also written by the background loader while frames that use
+    // the set are in flight.
+    flags[0] = vk::DescriptorBindingFlagBits::ePartiallyBound
+        | vk::DescriptorBindingFlagBits::eUpdateAfterBind
+        | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
 
     auto flags_create_info = vk::DescriptorSetLayoutBindingFlagsCreateInfo {
         .bindingCount = static_cast<uint32_t>(flags.size()),
@@ -127,6 +131,8 @@ create_descriptor_set_layouts(const vk::raii::Device& device) {
     return DescriptorSetLayouts {
         .everything = device.createDescriptorSetLayout({
             .pNext = &flags_create_info,
+            .flags =
+                vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
             .bindingCount = everything_bindings.size(),
             .pBindings = everything_bindings.data(),
         }),
@@ -137,22 +143,48 @@ create_descriptor_set_layouts(const vk::raii::Device& device) {
     };
 }
 
-uint32_t
-DescriptorSet::write_image(const ImageWithView& image, vk::Device device) {
-    auto index = tracker->push();
-
-    if (index >= 512) {
-        dbg(index);
-        abort();
-    }
+vk::raii::DescriptorPool create_descriptor_pool(const vk::raii::Device& device
+) {
+    auto pool_sizes = std::array {
+        vk::DescriptorPoolSize {
+            .type = vk::DescriptorType::eSampledImage,
+            .descriptorCount = 1024},
+        vk::DescriptorPoolSize {
+            .type = vk::DescriptorType::eSampler,
+            .descriptorCount = 10},
+        vk::DescriptorPoolSize {
+            .type = vk::DescriptorType::eStorageBuffer,
+            .descriptorCount = 10},
+        vk::DescriptorPoolSize {
+            .type = vk::DescriptorType::eStorageImage,
+            .descriptorCount = 10},
+        vk::DescriptorPoolSize {
+            .type = vk::DescriptorType::eUniformBuffer,
+            .descriptorCount = 1}};
+
+    return device.createDescriptorPool(
+        {.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet
+             | vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
+
+         .maxSets = 128,
+         .poolSizeCount = pool_sizes.size(),
+         .pPoolSizes = pool_sizes.data()}
+    );
+}
 
+void write_sampled_image(
+    vk::DescriptorSet set,
+    uint32_t index,
+    const ImageWithView& image,
+    vk::Device device
+) {
     auto image_info = vk::DescriptorImageInfo {
         .imageView = *image.view,
         .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal};
 
     device.updateDescriptorSets(
         {vk::WriteDescriptorSet {
-            .dstSet = *set,
+            .dstSet = set,
             .dstBinding = 0,
             .dstArrayElement = index,
             .descriptorCount = 1,
@@ -160,10 +192,34 @@ DescriptorSet::write_image(const ImageWithView& image, vk::Device device) {
             .pImageInfo = &image_info}},
         {}
     );
+}
+
+uint32_t
+DescriptorSet::write_image(const ImageWithView& image, vk::Device device) {
+    std::unique_lock lock(mutex);
+
+    auto index = tracker->push();
+
+    if (index >= MAX_BINDLESS_TEXTURES) {
+        dbg(index);
+        abort();
+    }
+
+    write_sampled_image(*set, index, image, device);
 
     return index;
 }
 
+void DescriptorSet::replace_image(
+    uint32_t index,
+    const ImageWithView& image,
+    vk::Device device
+) {
+    std::unique_lock lock(mutex);
+
+    write_sampled_image(*set, index, image, device);
+}
+
 DescriptorSet::DescriptorSet(
     vk::raii::DescriptorSet set_,
     std::vector<vk::raii::DescriptorSet> swapchain_image_sets_
@@ -192,6 +248,8 @@ void DescriptorSet::write_resizing_descriptors(
         .imageView = *resizing_resources.visbuffer.view,
         .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal};
 
+    std::unique_lock lock(mutex);
+
     device.updateDescriptorSets(
         {vk::WriteDescriptorSet {
              .dstSet = *set,
@@ -269,6 +327,8 @@ void DescriptorSet::write_descriptors(
         .imageView = *resources.skybox.view,
         .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal};
 
+    std::unique_lock lock(mutex);
+
     // Write initial descriptor sets.
     device.updateDescriptorSets(
         {
@@ -12,6 +12,8 @@ struct DescriptorSetLayouts {
 DescriptorSetLayouts
 create_descriptor_set_layouts(const vk::raii::Device& device);
 
+vk::raii::DescriptorPool create_descriptor_pool(const vk::raii::Device& device);
+
 struct IndexTracker {
     uint32_t next_index = 0;
     std::vector<uint32_t> free_indices;
@@ -29,6 +31,8 @@ struct DescriptorSet {
     vk::raii::DescriptorSet set;
     std::vector<vk::raii::DescriptorSet> swapchain_image_sets;
     std::shared_ptr<IndexTracker> tracker = std::make_shared<IndexTracker>();
+    // Images are written from the loading thread.
+    std::mutex mutex;
 
     DescriptorSet(
         vk::raii::DescriptorSet set_,
@@ -37,6 +41,14 @@ struct DescriptorSet {
 
     uint32_t write_image(const ImageWithView& image, vk::Device device);
 
+    // Point an index from `write_image` at a different image. Only call this
+    // when no frames that sample the old image are in flight.
+    void replace_image(
+        uint32_t index,
+        const ImageWithView& image,
+        vk::Device device
+    );
+
     void write_resizing_descriptors(
         const ResizingResources& resizing_resources,
         const vk::raii::Device& device,
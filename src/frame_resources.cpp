@@ -27,7 +27,11 @@ FrameCommandData create_frame_command_data(
         .render_semaphore = device.createSemaphore({}),
         .render_fence =
             device.createFence({.flags = vk::FenceCreateFlagBits::eSignaled}),
-        .tracy_ctx = RaiiTracyCtx(tracy_ctx)};
+        .tracy_ctx = RaiiTracyCtx(tracy_ctx),
+        .timestamp_queries = device.createQueryPool(
+            {.queryType = vk::QueryType::eTimestamp,
+             .queryCount = PASS_TIMESTAMP_COUNT}
+        )};
 }
 
 RaiiTracyCtx::RaiiTracyCtx(tracy::VkCtx* inner_) : inner(inner_) {}
@@ -72,18 +72,17 @@ struct ResizingResources {
         )) {}
 };
 
-struct InstanceResources {
-    AllocatedBuffer instances;
-    AllocatedBuffer meshlet_references;
-    AllocatedBuffer num_meshlets_prefix_sum;
-};
-
 struct Resources {
     ResizingResources resizing;
     ImageWithView shadowmap;
     AllocatedBuffer misc_storage_buffer;
     AllocatedBuffer draw_calls_buffer;
     AllocatedBuffer dispatches_buffer;
+    // `MiscStorage::culling_stats`, copied back at the end of every frame.
+    PersistentlyMappedBuffer culling_stats_readback;
+    // `MiscStorage::texture_feedback`, copied back at the end of every frame
+    // for the texture streamer.
+    PersistentlyMappedBuffer texture_feedback_readback;
     std::array<vk::raii::ImageView, 4> shadowmap_layer_views;
     ImageWithView display_transform_lut;
     ImageWithView skybox;
@@ -118,6 +117,17 @@ struct FlipFlipResource {
     }
 };
 
+// Timestamps written around the main passes, so that their GPU time can be
+// read back without Tracy. See `read_pass_timings`.
+const static uint32_t PASS_TIMESTAMP_CULL_START = 0;
+const static uint32_t PASS_TIMESTAMP_CULL_END = 1;
+const static uint32_t PASS_TIMESTAMP_VISBUFFER_END = 2;
+const static uint32_t PASS_TIMESTAMP_SHADOWS_START = 3;
+const static uint32_t PASS_TIMESTAMP_SHADOWS_END = 4;
+const static uint32_t PASS_TIMESTAMP_GEOMETRY_START = 5;
+const static uint32_t PASS_TIMESTAMP_GEOMETRY_END = 6;
+const static uint32_t PASS_TIMESTAMP_COUNT = 7;
+
 struct FrameCommandData {
     vk::raii::CommandPool pool;
     vk::raii::CommandBuffer buffer;
@@ -125,6 +135,10 @@ struct FrameCommandData {
     vk::raii::Semaphore render_semaphore;
     vk::raii::Fence render_fence;
     RaiiTracyCtx tracy_ctx;
+    // `PASS_TIMESTAMP_COUNT` timestamps, reset and written by `render`.
+    vk::raii::QueryPool timestamp_queries;
+    // Queries can't be read before they've been reset on the GPU once.
+    bool timestamps_written = false;
 };
 
 FrameCommandData create_frame_command_data(
@@ -167,11 +181,27 @@ struct UploadingBuffer {
             name
         )) {}
 
-    void flush(const vk::raii::CommandBuffer& command_buffer, size_t size) {
+    void flush(
+        const vk::raii::CommandBuffer& command_buffer,
+        size_t size,
+        size_t offset = 0
+    ) {
         command_buffer.copyBuffer(
             staging.buffer.buffer,
             buffer.buffer,
-            {vk::BufferCopy {.srcOffset = 0, .dstOffset = 0, .size = size}}
+            {vk::BufferCopy {
+                .srcOffset = offset,
+                .dstOffset = offset,
+                .size = size}}
         );
     }
 };
+
+struct InstanceResources {
+    // Appended to as the scene loads.
+    UploadingBuffer instances;
+    AllocatedBuffer meshlet_references;
+    // Per instance, then per meshlet group.
+    AllocatedBuffer num_meshlet_groups_prefix_sum;
+    AllocatedBuffer num_meshlets_prefix_sum;
+};
@@ -104,8 +104,23 @@ void glfw_key_callback(
     }
 }
 
+void draw_culling_counts(const char* name, const CullingCounts& counts) {
+    auto percent = [&](uint32_t count) {
+        return counts.tested > 0 ? 100.0f * count / counts.tested : 0.0f;
+    };
+
+    ImGui::Text(
+        "%s: %u tested, %.1f%% culled by spheres, %.1f%% more by boxes",
+        name,
+        counts.tested,
+        percent(counts.culled_by_sphere),
+        percent(counts.culled_by_aabb)
+    );
+}
+
 void draw_imgui_window(
     Uniforms* uniforms,
+    const CullingStats& culling_stats,
     CameraParams& camera_params,
     KeyboardState& keyboard_state,
     bool& copy_view
@@ -124,6 +139,31 @@ void draw_imgui_window(
         0.0f,
         10.0f
     );
+    ImGui::SliderFloat(
+        "lod_pixel_error",
+        &uniforms->lod_pixel_error,
+        0.0f,
+        16.0f
+    );
+    ImGui::CheckboxFlags("count culling", &uniforms->count_culling, 1);
+    if (uniforms->count_culling) {
+        draw_culling_counts("instances", culling_stats.instances);
+        draw_culling_counts("meshlet groups", culling_stats.meshlet_groups);
+        draw_culling_counts("meshlets", culling_stats.meshlets);
+        draw_culling_counts(
+            "shadow instances",
+            culling_stats.shadow_instances
+        );
+        draw_culling_counts(
+            "shadow meshlet groups",
+            culling_stats.shadow_meshlet_groups
+        );
+        draw_culling_counts("shadow meshlets", culling_stats.shadow_meshlets);
+        ImGui::Text(
+            "dropped meshlet groups: %u",
+            culling_stats.dropped_meshlet_groups
+        );
+    }
     ImGui::SliderFloat("fov", &camera_params.fov, 0.0f, 90.0f);
     ImGui::SliderFloat(
         "sun_intensity",
@@ -86,6 +86,7 @@ void glfw_key_callback(
 
 void draw_imgui_window(
     Uniforms* uniforms,
+    const CullingStats& culling_stats,
     CameraParams& camera_params,
     KeyboardState& keyboard_state,
     bool& copy_view
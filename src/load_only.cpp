@@ -0,0 +1,116 @@
+#include "load_only.h"
+
+#include "allocations/geometry_arena.h"
+#include "allocations/staging.h"
+#include "descriptor_set.h"
+#include "load_stats.h"
+#include "resources/baked_scene.h"
+#include "resources/mesh_loading.h"
+
+const vk::DeviceSize LOAD_ONLY_STAGING_BUDGET = 256 * 1024 * 1024;
+const vk::DeviceSize LOAD_ONLY_GEOMETRY_ARENA_BLOCK_SIZE = 256 * 1024 * 1024;
+
+int run_load_only(
+    const std::filesystem::path& scene_filepath,
+    const vk::raii::Instance& instance,
+    const vk::raii::PhysicalDevice& phys_device,
+    const vk::raii::Device& device,
+    const vk::raii::Queue& queue,
+    uint32_t queue_family,
+    uint32_t vulkan_version
+) {
+    ZoneScopedN("load only");
+
+    auto start = std::chrono::steady_clock::now();
+
+    vma::AllocatorCreateInfo allocatorCreateInfo = {
+        .flags = vma::AllocatorCreateFlagBits::eBufferDeviceAddress,
+        .physicalDevice = *phys_device,
+        .device = *device,
+        .instance = *instance,
+        .vulkanApiVersion = vulkan_version,
+    };
+
+    vma::Allocator allocator;
+    check_vk_result(vma::createAllocator(&allocatorCreateInfo, &allocator));
+    RaiiAllocator raii_allocator = {.allocator = allocator};
+
+    auto descriptor_set_layouts = create_descriptor_set_layouts(device);
+    auto pipelines =
+        Pipelines::compile_pipelines(device, descriptor_set_layouts);
+
+    auto descriptor_pool = create_descriptor_pool(device);
+
+    std::vector<vk::raii::DescriptorSet> descriptor_sets =
+        device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo {
+            .descriptorPool = *descriptor_pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &*descriptor_set_layouts.everything});
+
+    auto descriptor_set = DescriptorSet(std::move(descriptor_sets[0]), {});
+
+    auto geometry_arena = std::make_shared<GeometryArena>(
+        allocator,
+        LOAD_ONLY_GEOMETRY_ARENA_BLOCK_SIZE
+    );
+
+    auto staging = StagingRing(
+        device,
+        allocator,
+        queue,
+        queue_family,
+        LOAD_ONLY_STAGING_BUDGET
+    );
+
+    auto receiver = SceneReceiver {
+        .on_nodes = [&](std::vector<SceneNode> nodes) {
+            LoadStats::global().num_nodes += nodes.size();
+        },
+        .on_resident =
+            [&](const std::vector<NodeInstance>& instances) {
+                LoadStats::global().num_instances += instances.size();
+            }};
+
+    // Nothing ever requests a stop.
+    auto stop_source = std::stop_source();
+
+    {
+        auto mesh = scene_filepath.extension() == ".hscene"
+            ? load_baked_scene(
+                scene_filepath,
+                allocator,
+                device,
+                queue_family,
+                staging,
+                descriptor_set,
+                nullptr,
+                geometry_arena,
+                stop_source.get_token(),
+                receiver
+            )
+            : load_gltf(
+                scene_filepath,
+                allocator,
+                device,
+                queue_family,
+                staging,
+                descriptor_set,
+                nullptr,
+                geometry_arena,
+                pipelines,
+                stop_source.get_token(),
+                receiver
+            );
+
+        staging.finish();
+
+        std::chrono::duration<double> total =
+            std::chrono::steady_clock::now() - start;
+
+        std::cout << LoadStats::global().to_json(total.count());
+
+        device.waitIdle();
+    }
+
+    return 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "pipelines.h"
+
+// Load a scene without opening a window or rendering anything, then print a
+// JSON report of where the time went to stdout. Used by
+// `lighthugger --load-only`, which also works on software Vulkan drivers.
+int run_load_only(
+    const std::filesystem::path& scene_filepath,
+    const vk::raii::Instance& instance,
+    const vk::raii::PhysicalDevice& phys_device,
+    const vk::raii::Device& device,
+    const vk::raii::Queue& queue,
+    uint32_t queue_family,
+    uint32_t vulkan_version
+);
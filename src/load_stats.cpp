@@ -0,0 +1,59 @@
+#include "load_stats.h"
+
+LoadStats& LoadStats::global() {
+    static LoadStats stats;
+    return stats;
+}
+
+std::string LoadStats::to_json(double total_seconds) const {
+    auto phases = std::array {
+        std::pair {"json_parse", &json_parse},
+        std::pair {"file_io", &file_io},
+        std::pair {"meshlet_build", &meshlet_build},
+        std::pair {"cache_hit", &cache_hit},
+        std::pair {"cache_miss", &cache_miss},
+        std::pair {"texture_decode", &texture_decode},
+        std::pair {"geometry_decode", &geometry_decode},
+        std::pair {"staging_copy", &staging_copy},
+        std::pair {"gpu_submit", &gpu_submit},
+        std::pair {"fence_wait", &fence_wait}};
+
+    std::stringstream stream;
+    stream << "{\n  \"total_seconds\": " << total_seconds
+           << ",\n  \"num_nodes\": " << num_nodes.load()
+           << ",\n  \"num_instances\": " << num_instances.load()
+           << ",\n  \"phases\": {";
+
+    for (size_t i = 0; i < phases.size(); i++) {
+        auto& [name, stats] = phases[i];
+
+        stream << (i == 0 ? "\n" : ",\n") << "    \"" << name
+               << "\": {\"seconds\": "
+               << double(stats->nanoseconds.load()) / 1'000'000'000.0
+               << ", \"bytes\": " << stats->bytes.load()
+               << ", \"count\": " << stats->count.load() << "}";
+    }
+
+    stream << "\n  }\n}\n";
+
+    return stream.str();
+}
+
+void PhaseStats::add(
+    std::chrono::steady_clock::duration duration,
+    uint64_t bytes_
+) {
+    nanoseconds +=
+        static_cast<uint64_t>(std::chrono::nanoseconds(duration).count());
+    bytes += bytes_;
+    count++;
+}
+
+PhaseTimer::PhaseTimer(PhaseStats& stats_, uint64_t bytes_) :
+    stats(stats_),
+    bytes(bytes_),
+    start(std::chrono::steady_clock::now()) {}
+
+PhaseTimer::~PhaseTimer() {
+    stats.add(std::chrono::steady_clock::now() - start, bytes);
+}
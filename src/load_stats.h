@@ -0,0 +1,45 @@
+#pragma once
+
+// Time and bytes spent in each part of loading a scene, reported by
+// `lighthugger --load-only`. Phases that run on several threads at once
+// (like meshlet building) add up the time of every thread.
+struct PhaseStats {
+    std::atomic<uint64_t> nanoseconds = 0;
+    std::atomic<uint64_t> bytes = 0;
+    std::atomic<uint64_t> count = 0;
+
+    void add(std::chrono::steady_clock::duration duration, uint64_t bytes_);
+};
+
+struct LoadStats {
+    PhaseStats json_parse;
+    PhaseStats file_io;
+    PhaseStats meshlet_build;
+    PhaseStats cache_hit;
+    PhaseStats cache_miss;
+    PhaseStats texture_decode;
+    PhaseStats geometry_decode;
+    PhaseStats staging_copy;
+    PhaseStats gpu_submit;
+    PhaseStats fence_wait;
+
+    // The size of the loaded scene, so that runs can be compared.
+    std::atomic<uint64_t> num_nodes = 0;
+    std::atomic<uint64_t> num_instances = 0;
+
+    static LoadStats& global();
+
+    std::string to_json(double total_seconds) const;
+};
+
+// Adds the time until it goes out of scope to a phase. Use alongside a
+// `ZoneScopedN` so that the same phases show up in Tracy.
+struct PhaseTimer {
+    PhaseStats& stats;
+    uint64_t bytes;
+    std::chrono::steady_clock::time_point start;
+
+    PhaseTimer(PhaseStats& stats_, uint64_t bytes_ = 0);
+
+    ~PhaseTimer();
+};
@@ -1,18 +1,32 @@
 #include "allocations/base.h"
 #include "allocations/persistently_mapped.h"
 #include "allocations/staging.h"
+#include "benchmarks.h"
 #include "debugging.h"
 #include "descriptor_set.h"
 #include "frame_resources.h"
 #include "input.h"
+#include "load_only.h"
 #include "pch.h"
 #include "pipelines.h"
 #include "projection.h"
 #include "rendering.h"
+#include "scene_graph.h"
+#include "resources/background_loader.h"
+#include "resources/baked_scene.h"
 #include "resources/image_loading.h"
 #include "resources/mesh_loading.h"
+#include "resources/texture_streaming.h"
 
 const auto u64_max = std::numeric_limits<uint64_t>::max();
+const vk::DeviceSize STAGING_BUDGET = 256 * 1024 * 1024;
+const vk::DeviceSize INIT_STAGING_BUDGET = 32 * 1024 * 1024;
+const vk::DeviceSize GEOMETRY_ARENA_BLOCK_SIZE = 256 * 1024 * 1024;
+const vk::DeviceSize TEXTURE_STREAMING_BUDGET = 512 * 1024 * 1024;
+const vk::DeviceSize TEXTURE_STREAMING_STAGING_BUDGET = 64 * 1024 * 1024;
+// Frames skipped after loading before `--gpu-timings` starts averaging, so
+// that the frames in flight and anything still settling aren't counted.
+const uint32_t GPU_TIMING_WARMUP_FRAMES = 16;
 
 // Sources:
 // https://vkguide.dev
@@ -23,23 +37,95 @@ const auto u64_max = std::numeric_limits<uint64_t>::max();
 // https://lesleylai.info/en/vk-khr-dynamic-rendering/
 // https://github.com/dokipen3d/vulkanHppMinimalExample/blob/master/main.cpp
 
-struct RaiiAllocator {
-    vma::Allocator allocator;
-
-    ~RaiiAllocator() {
-        allocator.destroy();
-    }
-};
-
 struct PhysicalDeviceInfo {
     vk::raii::PhysicalDevice device;
     uint32_t graphics_queue_family;
+    // Not set with `--load-only`.
     vk::SurfaceCapabilitiesKHR surface_caps;
     vk::SurfaceFormatKHR surface_format;
 };
 
-int main() {
-    glfwInit();
+int main(int argc, char** argv) {
+    // The options below shift `argv` past themselves.
+    auto executable = std::filesystem::path(argv[0]);
+
+    // `lighthugger --meshlet-config <max vertices>,<max triangles>,<cone
+    // weight> ...` changes how meshlets are built for the rest of the
+    // arguments.
+    if (argc >= 3 && std::string(argv[1]) == "--meshlet-config") {
+        auto config = parse_meshlet_config(argv[2]);
+
+        if (!config) {
+            dbg(argv[2], "isn't a valid meshlet config");
+            return 1;
+        }
+
+        MeshletConfig::global() = config.value();
+        argc -= 2;
+        argv += 2;
+    }
+
+    // `lighthugger --cache-zstd <level> ...` compresses newly cached blobs
+    // with zstd on top of their stream codecs.
+    if (argc >= 3 && std::string(argv[1]) == "--cache-zstd") {
+        FsCache::zstd_level() = std::clamp(std::atoi(argv[2]), 0, 22);
+        argc -= 2;
+        argv += 2;
+    }
+
+    // `lighthugger --gpu-timings <frames> ...` renders that many frames once
+    // the scene has finished loading, prints the average GPU time of the main
+    // passes and exits.
+    std::optional<uint32_t> gpu_timing_frames = std::nullopt;
+
+    if (argc >= 3 && std::string(argv[1]) == "--gpu-timings") {
+        gpu_timing_frames = std::max(std::atoi(argv[2]), 1);
+        argc -= 2;
+        argv += 2;
+    }
+
+    // `lighthugger --bake <scene.gltf> <scene.hscene>` bakes a gltf scene
+    // into a file that loads without any parsing or repacking.
+    if (argc == 4 && std::string(argv[1]) == "--bake") {
+        bake_scene(argv[2], argv[3]);
+        return 0;
+    }
+
+    if (argc == 2 && std::string(argv[1]) == "--bench-kernels") {
+        benchmark_kernels();
+        return 0;
+    }
+
+    if (argc == 3 && std::string(argv[1]) == "--bench-vertex-fetch") {
+        benchmark_vertex_fetch(argv[2]);
+        return 0;
+    }
+
+    if (argc >= 3 && std::string(argv[1]) == "--bench-ktx2") {
+        auto filepaths =
+            std::vector<std::filesystem::path>(argv + 2, argv + argc);
+        benchmark_ktx2(filepaths);
+        return 0;
+    }
+
+    if (argc == 3 && std::string(argv[1]) == "--bench-meshlets") {
+        benchmark_meshlet_configs(argv[2], executable);
+        return 0;
+    }
+
+    // `lighthugger --load-only [scene]` loads the scene headlessly and prints
+    // a report of how long each part of loading took.
+    auto load_only = argc > 1 && std::string(argv[1]) == "--load-only";
+    auto scene_arg = load_only ? 2 : 1;
+
+    // Either a gltf or a baked scene.
+    auto scene_filepath = std::filesystem::path(
+        argc > scene_arg ? argv[scene_arg] : "models/San_Miguel/packed.gltf"
+    );
+
+    if (!load_only) {
+        glfwInit();
+    }
 
     auto vulkan_version = VK_API_VERSION_1_3;
 
@@ -50,16 +136,23 @@ int main() {
         .engineVersion = VK_MAKE_API_VERSION(0, 1, 0, 0),
         .apiVersion = vulkan_version};
 
-    auto glfwExtensionCount = 0u;
-    auto glfwExtensions =
-        glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-    std::vector<const char*> instance_extensions(
-        glfwExtensions,
-        glfwExtensions + glfwExtensionCount
-    );
+    std::vector<const char*> instance_extensions;
+
+    if (!load_only) {
+        auto glfwExtensionCount = 0u;
+        auto glfwExtensions =
+            glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        instance_extensions.insert(
+            instance_extensions.end(),
+            glfwExtensions,
+            glfwExtensions + glfwExtensionCount
+        );
+    }
+
     std::vector<const char*> layers;
 
-    auto debug_enabled = true;
+    // Validation would dominate the timings.
+    auto debug_enabled = !load_only;
 
     if (debug_enabled) {
         instance_extensions.push_back("VK_EXT_debug_utils");
@@ -105,28 +198,36 @@ int main() {
         .height = 480,
     };
 
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    auto window = glfwCreateWindow(
-        static_cast<int>(extent.width),
-        static_cast<int>(extent.height),
-        "lighthugger",
-        nullptr,
-        nullptr
-    );
+    GLFWwindow* window = nullptr;
+    std::optional<vk::raii::SurfaceKHR> opt_surface = std::nullopt;
 
-    VkSurfaceKHR _surface;
-    check_vk_result(static_cast<vk::Result>(
-        glfwCreateWindowSurface(*instance, window, nullptr, &_surface)
-    ));
-    vk::raii::SurfaceKHR surface = vk::raii::SurfaceKHR(instance, _surface);
+    if (!load_only) {
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        window = glfwCreateWindow(
+            static_cast<int>(extent.width),
+            static_cast<int>(extent.height),
+            "lighthugger",
+            nullptr,
+            nullptr
+        );
+
+        VkSurfaceKHR _surface;
+        check_vk_result(static_cast<vk::Result>(
+            glfwCreateWindowSurface(*instance, window, nullptr, &_surface)
+        ));
+        opt_surface = vk::raii::SurfaceKHR(instance, _surface);
+    }
 
     std::vector<PhysicalDeviceInfo> acceptable_devices_and_queues;
 
     // Physical device selection.
     for (auto phys_device : instance.enumeratePhysicalDevices()) {
         auto props = phys_device.getProperties();
+        // Software drivers (like lavapipe) are fine for measuring loading.
         if (!(props.deviceType == vk::PhysicalDeviceType::eDiscreteGpu
-              || props.deviceType == vk::PhysicalDeviceType::eIntegratedGpu)) {
+              || props.deviceType == vk::PhysicalDeviceType::eIntegratedGpu
+              || (load_only
+                  && props.deviceType == vk::PhysicalDeviceType::eCpu))) {
             continue;
         }
 
@@ -134,7 +235,8 @@ int main() {
         std::optional<uint32_t> opt_graphics_queue_family = std::nullopt;
         for (uint32_t i = 0; i < queue_families.size(); i++) {
             if (queue_families[i].queueFlags & vk::QueueFlagBits::eGraphics
-                && phys_device.getSurfaceSupportKHR(i, *surface)) {
+                && (load_only
+                    || phys_device.getSurfaceSupportKHR(i, **opt_surface))) {
                 opt_graphics_queue_family = i;
                 break;
             }
@@ -146,6 +248,16 @@ int main() {
 
         auto graphics_queue_family = opt_graphics_queue_family.value();
 
+        if (load_only) {
+            acceptable_devices_and_queues.push_back(
+                {.device = phys_device,
+                 .graphics_queue_family = graphics_queue_family}
+            );
+            continue;
+        }
+
+        auto& surface = *opt_surface;
+
         auto surface_caps = phys_device.getSurfaceCapabilitiesKHR(*surface);
 
         auto surface_formats = phys_device.getSurfaceFormatsKHR(*surface);
@@ -192,11 +304,20 @@ int main() {
     auto phys_device = phys_device_info.device;
     auto graphics_queue_family = phys_device_info.graphics_queue_family;
 
-    float queue_prio = 1.0f;
+    // Use a second queue from the graphics family for background uploads if
+    // there is one. The uploads run compute shaders and transition images
+    // for sampling, so a transfer-only queue isn't enough.
+    auto separate_upload_queue =
+        phys_device.getQueueFamilyProperties()[graphics_queue_family]
+            .queueCount
+        > 1;
+
+    auto queue_priorities = std::array {1.0f, 0.5f};
 
     vk::DeviceQueueCreateInfo device_queue_create_info = {
-        .queueCount = 1,
-        .pQueuePriorities = &queue_prio};
+        .queueFamilyIndex = graphics_queue_family,
+        .queueCount = separate_upload_queue ? 2u : 1u,
+        .pQueuePriorities = queue_priorities.data()};
 
     auto shader_clock_features =
         vk::PhysicalDeviceShaderClockFeaturesKHR {.shaderSubgroupClock = true};
@@ -213,6 +334,8 @@ int main() {
         .shaderBufferInt64Atomics = true,
         .shaderInt8 = true,
         .shaderSampledImageArrayNonUniformIndexing = true,
+        .descriptorBindingSampledImageUpdateAfterBind = true,
+        .descriptorBindingUpdateUnusedWhilePending = true,
         .descriptorBindingPartiallyBound = true,
         .runtimeDescriptorArray = true,
         .scalarBlockLayout = true,
@@ -231,8 +354,11 @@ int main() {
         .shaderInt16 = true,
     };
 
-    auto device_extensions =
-        std::array {"VK_KHR_swapchain", "VK_KHR_shader_clock"};
+    auto device_extensions = std::vector {"VK_KHR_shader_clock"};
+
+    if (!load_only) {
+        device_extensions.push_back("VK_KHR_swapchain");
+    }
 
     vk::raii::Device device = phys_device_info.device.createDevice(
         {
@@ -253,6 +379,39 @@ int main() {
         .init(*instance, vkGetInstanceProcAddr, *device);
 
     auto graphics_queue = device.getQueue(graphics_queue_family, 0);
+    auto upload_queue =
+        device.getQueue(graphics_queue_family, separate_upload_queue ? 1 : 0);
+    // Guards submissions to the graphics queue when it's also used for uploads.
+    std::mutex graphics_queue_mutex;
+    // The loader and the texture streamer both submit to the upload queue.
+    std::mutex separate_upload_queue_mutex;
+    auto upload_queue_mutex = separate_upload_queue
+        ? &separate_upload_queue_mutex
+        : &graphics_queue_mutex;
+
+    if (load_only) {
+        return run_load_only(
+            scene_filepath,
+            instance,
+            phys_device,
+            device,
+            upload_queue,
+            graphics_queue_family,
+            vulkan_version
+        );
+    }
+
+    auto& surface = *opt_surface;
+
+    auto timestamp_period = phys_device.getProperties().limits.timestampPeriod;
+
+    if (gpu_timing_frames
+        && phys_device.getQueueFamilyProperties()[graphics_queue_family]
+                .timestampValidBits
+            == 0) {
+        dbg("The graphics queue doesn't support timestamps");
+        return 1;
+    }
 
     vk::SwapchainCreateInfoKHR swapchain_create_info = {
         .surface = *surface,
@@ -313,30 +472,7 @@ int main() {
     auto pipelines =
         Pipelines::compile_pipelines(device, descriptor_set_layouts);
 
-    auto pool_sizes = std::array {
-        vk::DescriptorPoolSize {
-            .type = vk::DescriptorType::eSampledImage,
-            .descriptorCount = 1024},
-        vk::DescriptorPoolSize {
-            .type = vk::DescriptorType::eSampler,
-            .descriptorCount = 10},
-        vk::DescriptorPoolSize {
-            .type = vk::DescriptorType::eStorageBuffer,
-            .descriptorCount = 10},
-        vk::DescriptorPoolSize {
-            .type = vk::DescriptorType::eStorageImage,
-            .descriptorCount = 10},
-        vk::DescriptorPoolSize {
-            .type = vk::DescriptorType::eUniformBuffer,
-            .descriptorCount = 1}};
-
-    auto descriptor_pool = device.createDescriptorPool(
-        {.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
-
-         .maxSets = 128,
-         .poolSizeCount = pool_sizes.size(),
-         .pPoolSizes = pool_sizes.data()}
-    );
+    auto descriptor_pool = create_descriptor_pool(device);
 
     std::vector<vk::DescriptorSetLayout> descriptor_sets_to_create;
     descriptor_sets_to_create.reserve(swapchain_images.size() + 1);
@@ -364,22 +500,16 @@ int main() {
         std::move(swapchain_image_sets)
     );
 
-    std::vector<AllocatedBuffer> temp_buffers;
-
-    command_buffer.get().buffer.begin(
-        {.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit}
-    );
-
-    auto san_mig = load_gltf(
-        "models/San_Miguel/packed.gltf",
-        allocator,
+    // Only the small, always needed resources are loaded up front.
+    // The scene itself is streamed in by the background loader.
+    auto staging = StagingRing(
         device,
-        command_buffer.get().buffer,
+        allocator,
+        graphics_queue,
         graphics_queue_family,
-        temp_buffers,
-        descriptor_set,
-        pipelines
+        INIT_STAGING_BUDGET
     );
+
     // Load all resources
 
     auto shadowmap = ImageWithView(
@@ -430,25 +560,13 @@ int main() {
         create_shadow_view(2),
         create_shadow_view(3)};
 
-    std::vector<Instance> instances;
-
-    for (auto& primitive : san_mig.primitives) {
-        instances.push_back(Instance(
-            primitive.transform,
-            device.getBufferAddress({.buffer = primitive.mesh_info.buffer})
-        ));
-    }
-
     auto instance_resources = InstanceResources {
-        .instances = upload_via_staging_buffer(
-            instances.data(),
-            instances.size() * sizeof(Instance),
-            allocator,
+        .instances = UploadingBuffer(
+            sizeof(Instance) * MAX_INSTANCES,
             vk::BufferUsageFlagBits::eStorageBuffer
                 | vk::BufferUsageFlagBits::eShaderDeviceAddress,
             "instance buffer",
-            command_buffer.get().buffer,
-            temp_buffers
+            allocator
         ),
         .meshlet_references = AllocatedBuffer(
             vk::BufferCreateInfo {
@@ -465,7 +583,7 @@ int main() {
             allocator,
             "meshlet reference buffer"
         ),
-        .num_meshlets_prefix_sum = AllocatedBuffer(
+        .num_meshlet_groups_prefix_sum = AllocatedBuffer(
             vk::BufferCreateInfo {
                 .size =
                     (sizeof(PrefixSumValue) * MAX_INSTANCES + sizeof(uint64_t))
@@ -477,6 +595,20 @@ int main() {
                 .usage = vma::MemoryUsage::eAuto,
             },
             allocator,
+            "num meshlet groups prefix sum buffer"
+        ),
+        .num_meshlets_prefix_sum = AllocatedBuffer(
+            vk::BufferCreateInfo {
+                .size = (sizeof(PrefixSumValue) * MAX_VISIBLE_MESHLET_GROUPS
+                         + sizeof(uint64_t))
+                    * 4,
+                .usage = vk::BufferUsageFlagBits::eStorageBuffer
+                    | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+            },
+            {
+                .usage = vma::MemoryUsage::eAuto,
+            },
+            allocator,
             "num meshlets prefix sum buffer"
         )};
 
@@ -496,7 +628,8 @@ int main() {
                 .size = sizeof(MiscStorage),
                 .usage = vk::BufferUsageFlagBits::eStorageBuffer
                     | vk::BufferUsageFlagBits::eShaderDeviceAddress
-                    | vk::BufferUsageFlagBits::eIndirectBuffer},
+                    | vk::BufferUsageFlagBits::eIndirectBuffer
+                    | vk::BufferUsageFlagBits::eTransferSrc},
             {
                 .usage = vma::MemoryUsage::eAuto,
             },
@@ -520,7 +653,7 @@ int main() {
         ),
         .dispatches_buffer = AllocatedBuffer(
             vk::BufferCreateInfo {
-                .size = sizeof(vk::DispatchIndirectCommand) * 3,
+                .size = sizeof(vk::DispatchIndirectCommand) * 4,
                 .usage = vk::BufferUsageFlagBits::eIndirectBuffer
                     | vk::BufferUsageFlagBits::eStorageBuffer
                     | vk::BufferUsageFlagBits::eShaderDeviceAddress},
@@ -530,22 +663,44 @@ int main() {
             allocator,
             "dispatches buffer"
         ),
+        .culling_stats_readback = PersistentlyMappedBuffer(AllocatedBuffer(
+            vk::BufferCreateInfo {
+                .size = sizeof(CullingStats),
+                .usage = vk::BufferUsageFlagBits::eTransferDst},
+            {
+                .flags = vma::AllocationCreateFlagBits::eMapped
+                    | vma::AllocationCreateFlagBits::eHostAccessRandom,
+                .usage = vma::MemoryUsage::eAuto,
+            },
+            allocator,
+            "culling stats readback"
+        )),
+        .texture_feedback_readback = PersistentlyMappedBuffer(AllocatedBuffer(
+            vk::BufferCreateInfo {
+                .size = sizeof(MiscStorage::texture_feedback),
+                .usage = vk::BufferUsageFlagBits::eTransferDst},
+            {
+                .flags = vma::AllocationCreateFlagBits::eMapped
+                    | vma::AllocationCreateFlagBits::eHostAccessRandom,
+                .usage = vma::MemoryUsage::eAuto,
+            },
+            allocator,
+            "texture feedback readback"
+        )),
         .shadowmap_layer_views = std::move(shadowmap_layer_views),
         .display_transform_lut = load_dds(
             "external/tony-mc-mapface/shader/tony_mc_mapface.dds",
             allocator,
             device,
-            command_buffer.get().buffer,
             graphics_queue_family,
-            temp_buffers
+            staging
         ),
         .skybox = load_dds(
             "hdr-cubemap-1024x1024.dds",
             allocator,
             device,
-            command_buffer.get().buffer,
             graphics_queue_family,
-            temp_buffers
+            staging
         ),
         .repeat_sampler = device.createSampler(vk::SamplerCreateInfo {
             .magFilter = vk::Filter::eLinear,
@@ -580,25 +735,7 @@ int main() {
                 .minLod = 0.0f,
                 .maxLod = VK_LOD_CLAMP_NONE})};
 
-    command_buffer.get().buffer.end();
-
-    {
-        vk::PipelineStageFlags dst_stage_mask =
-            vk::PipelineStageFlagBits::eTransfer;
-
-        vk::SubmitInfo submit_info = {
-            .pWaitDstStageMask = &dst_stage_mask,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &*command_buffer.get().buffer,
-        };
-        auto init_fence = device.createFence({});
-        graphics_queue.submit(submit_info, *init_fence);
-
-        check_vk_result(device.waitForFences({*init_fence}, true, u64_max));
-
-        // Drop temp buffers.
-        temp_buffers.clear();
-    }
+    staging.finish();
 
     // Write initial descriptor sets.
     descriptor_set.write_descriptors(resources, device, swapchain_image_views);
@@ -645,32 +782,80 @@ int main() {
 
     Uniforms* uniforms =
         reinterpret_cast<Uniforms*>(uniform_buffer.staging.mapped_ptr);
-    uniforms->num_instances = instances.size();
+    uniforms->num_instances = 0;
     uniforms->sun_intensity = glm::vec3(1.0);
     // Set the camera to be a fixed distance away from the frustum center, so that
     // we don't get clipping on the near plane or far planes. I haven't observed any
     // quality loss when setting this value to be absurdly high.
     uniforms->shadow_cam_distance = 1024.0;
     uniforms->cascade_split_pow = 3.0;
+    uniforms->lod_pixel_error = 1.0;
+    uniforms->count_culling = 0;
     uniforms->meshlet_references = device.getBufferAddress(
         {.buffer = instance_resources.meshlet_references.buffer}
     );
-    uniforms->instances =
-        device.getBufferAddress({.buffer = instance_resources.instances.buffer}
-        );
+    uniforms->instances = device.getBufferAddress(
+        {.buffer = instance_resources.instances.buffer.buffer}
+    );
     uniforms->draw_calls =
         device.getBufferAddress({.buffer = resources.draw_calls_buffer.buffer});
     uniforms->misc_storage =
         device.getBufferAddress({.buffer = resources.misc_storage_buffer.buffer}
         );
+    uniforms->num_meshlet_groups_prefix_sum = device.getBufferAddress(
+        {.buffer = instance_resources.num_meshlet_groups_prefix_sum.buffer}
+    );
     uniforms->num_meshlets_prefix_sum = device.getBufferAddress(
         {.buffer = instance_resources.num_meshlets_prefix_sum.buffer}
     );
     uniforms->dispatches =
         device.getBufferAddress({.buffer = resources.dispatches_buffer.buffer});
 
+    auto geometry_arena =
+        std::make_shared<GeometryArena>(allocator, GEOMETRY_ARENA_BLOCK_SIZE);
+
+    // Nothing has asked for any detail until the first frame is copied back.
+    std::memset(
+        resources.texture_feedback_readback.mapped_ptr,
+        0,
+        sizeof(MiscStorage::texture_feedback)
+    );
+    resources.texture_feedback_readback.flush();
+
+    auto texture_streamer = TextureStreamer(
+        allocator,
+        device,
+        upload_queue,
+        upload_queue_mutex,
+        graphics_queue_family,
+        TEXTURE_STREAMING_STAGING_BUDGET,
+        TEXTURE_STREAMING_BUDGET,
+        &resources.texture_feedback_readback
+    );
+
+    auto loader = BackgroundLoader(
+        scene_filepath,
+        allocator,
+        device,
+        upload_queue,
+        upload_queue_mutex,
+        graphics_queue_family,
+        descriptor_set,
+        geometry_arena,
+        pipelines,
+        STAGING_BUDGET,
+        &texture_streamer
+    );
+
+    SceneGraph scene;
+
     auto copy_view = true;
 
+    // For `--gpu-timings`.
+    auto frames_since_loaded = 0u;
+    auto timed_frames = 0u;
+    PassTimings timing_totals;
+
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
 
@@ -680,7 +865,10 @@ int main() {
             .width = static_cast<uint32_t>(current_width),
             .height = static_cast<uint32_t>(current_height)};
         if (extent != current_extent) {
-            graphics_queue.waitIdle();
+            {
+                std::unique_lock lock(graphics_queue_mutex);
+                graphics_queue.waitIdle();
+            }
 
             extent = current_extent;
 
@@ -722,8 +910,12 @@ int main() {
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
         if (keyboard_state.ui_toggled) {
+            resources.culling_stats_readback.invalidate();
             draw_imgui_window(
                 uniforms,
+                *reinterpret_cast<const CullingStats*>(
+                    resources.culling_stats_readback.mapped_ptr
+                ),
                 camera_params,
                 keyboard_state,
                 copy_view
@@ -768,6 +960,45 @@ int main() {
         );
         device.resetFences({*data.render_fence});
 
+        if (gpu_timing_frames && data.timestamps_written
+            && frames_since_loaded > GPU_TIMING_WARMUP_FRAMES) {
+            auto timings =
+                read_pass_timings(data.timestamp_queries, timestamp_period);
+
+            if (timings) {
+                timing_totals.cull += timings->cull;
+                timing_totals.visbuffer += timings->visbuffer;
+                timing_totals.shadows += timings->shadows;
+                timing_totals.geometry += timings->geometry;
+                timed_frames++;
+            }
+
+            if (timed_frames == gpu_timing_frames.value()) {
+                auto frames = double(timed_frames);
+                std::cout << "gpu timings over " << timed_frames
+                          << " frames: cull " << timing_totals.cull / frames
+                          << " ms, visbuffer "
+                          << timing_totals.visbuffer / frames
+                          << " ms, shadows " << timing_totals.shadows / frames
+                          << " ms, geometry "
+                          << timing_totals.geometry / frames << " ms"
+                          << std::endl;
+                glfwSetWindowShouldClose(window, true);
+            }
+        }
+
+        // The other frame in flight could still be sampling the streamed
+        // textures that are about to be replaced.
+        if (texture_streamer.has_swaps()) {
+            auto& other_data = command_buffer.items[!command_buffer.flipped];
+            check_vk_result(device.waitForFences(
+                {*other_data.render_fence},
+                true,
+                1000000000
+            ));
+            texture_streamer.apply_swaps(descriptor_set, *device);
+        }
+
         // Acquire the next swapchain image (waiting on the gpu-side and signaling the present semaphore when finished).
         auto [acquire_err, swapchain_image_index] =
             swapchain.acquireNextImage(1000000000, *data.swapchain_semaphore);
@@ -781,6 +1012,19 @@ int main() {
             {.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit}
         );
 
+        // Checked first, so that once it's set everything has been taken.
+        if (loader.finished()) {
+            frames_since_loaded++;
+        }
+
+        // Add any instances that the loader has finished uploading, and
+        // upload the ones that have been added or moved.
+        loader.take_resident(scene);
+        scene.update();
+
+        scene.flush(instance_resources.instances, data.buffer);
+        uniforms->num_instances = static_cast<uint32_t>(scene.instances.size());
+
         uniform_buffer.flush(data.buffer, sizeof(Uniforms));
 
         render(
@@ -793,6 +1037,7 @@ int main() {
             extent,
             graphics_queue_family,
             data.tracy_ctx.inner,
+            data.timestamp_queries,
             swapchain_image_index,
             device.getBufferAddress({.buffer = uniform_buffer.buffer.buffer})
         );
@@ -813,8 +1058,11 @@ int main() {
             .signalSemaphoreCount = 1,
             .pSignalSemaphores = &*data.render_semaphore,
         };
+        std::unique_lock queue_lock(graphics_queue_mutex);
+
         // This wraps vkQueueSubmit.
         graphics_queue.submit(submit_info, *data.render_fence);
+        data.timestamps_written = true;
 
         // Present the swapchain image after having wated on the render semaphore.
         // This wraps vkQueuePresentKHR.
@@ -826,11 +1074,18 @@ int main() {
             .pImageIndices = &swapchain_image_index,
         }));
 
+        queue_lock.unlock();
+
         command_buffer.flip();
 
         FrameMark;
     }
 
+    // Stop the loader and streamer before waiting so that nothing new gets
+    // submitted.
+    loader.stop();
+    texture_streamer.stop();
+
     // Wait until the device is idle so that we don't get destructor warnings about currently in-use resources.
     device.waitIdle();
 
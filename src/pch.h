@@ -8,8 +8,25 @@
 #include <dbg.h>
 #include <thsvs_simpler_vulkan_synchronization.h>
 
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
 #include <fstream>
+#include <functional>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include <mutex>
+#include <numeric>
 #include <numbers>
+#include <random>
+#include <sstream>
+#include <stop_token>
+#include <thread>
 #include <tracy/Tracy.hpp>
 #include <tracy/TracyVulkan.hpp>
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -20,4 +37,8 @@
 
 #include <fastgltf/parser.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_precision.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/norm.hpp>
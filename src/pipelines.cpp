@@ -380,6 +380,16 @@ Pipelines Pipelines::compile_pipelines(
             pipeline_layout,
             "compiled_shaders/compute/reset_buffers_c.spv"
         ),
+        .reset_buffers_d = create_compute_pipeline_from_shader(
+            device,
+            pipeline_layout,
+            "compiled_shaders/compute/reset_buffers_d.spv"
+        ),
+        .reset_buffers_e = create_compute_pipeline_from_shader(
+            device,
+            pipeline_layout,
+            "compiled_shaders/compute/reset_buffers_e.spv"
+        ),
         .write_draw_calls_shadows = create_compute_pipeline_from_shader(
             device,
             pipeline_layout,
@@ -395,6 +405,16 @@ Pipelines Pipelines::compile_pipelines(
             pipeline_layout,
             "compiled_shaders/cull_instances_shadows.spv"
         ),
+        .cull_meshlet_groups = create_compute_pipeline_from_shader(
+            device,
+            pipeline_layout,
+            "compiled_shaders/cull_meshlet_groups.spv"
+        ),
+        .cull_meshlet_groups_shadows = create_compute_pipeline_from_shader(
+            device,
+            pipeline_layout,
+            "compiled_shaders/cull_meshlet_groups_shadows.spv"
+        ),
         .pipeline_layout = std::move(pipeline_layout),
         .copy_quantized_positions = create_compute_pipeline_from_shader(
             device,
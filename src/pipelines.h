@@ -18,9 +18,13 @@ struct Pipelines {
     vk::raii::Pipeline reset_buffers_a;
     vk::raii::Pipeline reset_buffers_b;
     vk::raii::Pipeline reset_buffers_c;
+    vk::raii::Pipeline reset_buffers_d;
+    vk::raii::Pipeline reset_buffers_e;
     vk::raii::Pipeline write_draw_calls_shadows;
     vk::raii::Pipeline cull_instances;
     vk::raii::Pipeline cull_instances_shadows;
+    vk::raii::Pipeline cull_meshlet_groups;
+    vk::raii::Pipeline cull_meshlet_groups_shadows;
 
     vk::raii::PipelineLayout pipeline_layout;
 
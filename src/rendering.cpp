@@ -35,12 +35,23 @@ void render(
     vk::Extent2D extent,
     uint32_t graphics_queue_family,
     tracy::VkCtx* tracy_ctx,
+    const vk::raii::QueryPool& timestamp_queries,
     uint32_t swapchain_image_index,
     uint64_t uniform_buffer_address
 ) {
     ZoneScoped;
     TracyVkZone(tracy_ctx, *command_buffer, "render");
 
+    command_buffer.resetQueryPool(*timestamp_queries, 0, PASS_TIMESTAMP_COUNT);
+
+    auto write_timestamp = [&](uint32_t index) {
+        command_buffer.writeTimestamp(
+            vk::PipelineStageFlagBits::eAllCommands,
+            *timestamp_queries,
+            index
+        );
+    };
+
     auto dispatch_scalar = [&](const vk::raii::Pipeline& pipeline) {
         command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline);
         command_buffer.dispatch(1, 1, 1);
@@ -136,6 +147,8 @@ void render(
                  THSVS_ACCESS_INDIRECT_BUFFER}})
     );
 
+    write_timestamp(PASS_TIMESTAMP_CULL_START);
+
     {
         TracyVkZone(tracy_ctx, *command_buffer, "cull instances");
 
@@ -168,6 +181,38 @@ void render(
                  THSVS_ACCESS_INDIRECT_BUFFER}}
     );
 
+    {
+        TracyVkZone(tracy_ctx, *command_buffer, "cull meshlet groups");
+
+        command_buffer.bindPipeline(
+            vk::PipelineBindPoint::eCompute,
+            *pipelines.cull_meshlet_groups
+        );
+        dispatch_indirect(PER_MESHLET_GROUP_DISPATCH);
+    }
+
+    insert_global_barrier(
+        command_buffer,
+        GlobalBarrier<1, 1> {
+            .prev_accesses = {THSVS_ACCESS_COMPUTE_SHADER_WRITE},
+            .next_accesses = {THSVS_ACCESS_COMPUTE_SHADER_READ_OTHER}}
+    );
+
+    dispatch_scalar(pipelines.reset_buffers_d);
+
+    insert_global_barrier(
+        command_buffer,
+        GlobalBarrier<3, 3> {
+            .prev_accesses =
+                {THSVS_ACCESS_COMPUTE_SHADER_WRITE,
+                 THSVS_ACCESS_COMPUTE_SHADER_READ_OTHER,
+                 THSVS_ACCESS_INDIRECT_BUFFER},
+            .next_accesses =
+                {THSVS_ACCESS_COMPUTE_SHADER_WRITE,
+                 THSVS_ACCESS_COMPUTE_SHADER_READ_OTHER,
+                 THSVS_ACCESS_INDIRECT_BUFFER}}
+    );
+
     {
         TracyVkZone(
             tracy_ctx,
@@ -182,6 +227,8 @@ void render(
         dispatch_indirect(PER_MESHLET_DISPATCH);
     }
 
+    write_timestamp(PASS_TIMESTAMP_CULL_END);
+
     insert_global_barrier(
         command_buffer,
         GlobalBarrier<1, 1> {
@@ -265,6 +312,8 @@ void render(
         command_buffer.endRendering();
     }
 
+    write_timestamp(PASS_TIMESTAMP_VISBUFFER_END);
+
     insert_color_image_barriers(
         command_buffer,
         std::array {
@@ -301,6 +350,8 @@ void render(
 
     dispatch_scalar(pipelines.generate_matrices);
 
+    write_timestamp(PASS_TIMESTAMP_SHADOWS_START);
+
     {
         TracyVkZone(tracy_ctx, *command_buffer, "cull instances for shadows");
 
@@ -351,6 +402,40 @@ void render(
                             THSVS_ACCESS_INDIRECT_BUFFER}}
             );
 
+            {
+                TracyVkZone(tracy_ctx, *command_buffer, "cull meshlet groups");
+
+                command_buffer.bindPipeline(
+                    vk::PipelineBindPoint::eCompute,
+                    *pipelines.cull_meshlet_groups_shadows
+                );
+                dispatch_indirect(PER_MESHLET_GROUP_DISPATCH);
+            }
+
+            insert_global_barrier(
+                command_buffer,
+                GlobalBarrier<1, 1> {
+                    .prev_accesses =
+                        std::array<ThsvsAccessType, 1> {
+                            THSVS_ACCESS_COMPUTE_SHADER_WRITE},
+                    .next_accesses =
+                        std::array<ThsvsAccessType, 1> {
+                            THSVS_ACCESS_COMPUTE_SHADER_READ_OTHER}}
+            );
+
+            dispatch_scalar(pipelines.reset_buffers_e);
+
+            insert_global_barrier(
+                command_buffer,
+                GlobalBarrier<1, 1> {
+                    .prev_accesses =
+                        std::array<ThsvsAccessType, 1> {
+                            THSVS_ACCESS_COMPUTE_SHADER_WRITE},
+                    .next_accesses =
+                        std::array<ThsvsAccessType, 1> {
+                            THSVS_ACCESS_INDIRECT_BUFFER}}
+            );
+
             {
                 TracyVkZone(
                     tracy_ctx,
@@ -437,6 +522,8 @@ void render(
         }
     }
 
+    write_timestamp(PASS_TIMESTAMP_SHADOWS_END);
+
     insert_color_image_barriers(
         command_buffer,
         std::array {
@@ -459,6 +546,33 @@ void render(
         }
     );
 
+    // All the culling is done by now. The CPU reads this back once the
+    // frame's fence has been waited on, so it's always a frame or two old.
+    insert_global_barrier(
+        command_buffer,
+        GlobalBarrier<1, 1> {
+            .prev_accesses = {THSVS_ACCESS_COMPUTE_SHADER_WRITE},
+            .next_accesses = {THSVS_ACCESS_TRANSFER_READ}}
+    );
+
+    command_buffer.copyBuffer(
+        resources.misc_storage_buffer.buffer,
+        resources.culling_stats_readback.buffer.buffer,
+        {vk::BufferCopy {
+            .srcOffset = offsetof(MiscStorage, culling_stats),
+            .dstOffset = 0,
+            .size = sizeof(CullingStats)}}
+    );
+
+    insert_global_barrier(
+        command_buffer,
+        GlobalBarrier<1, 1> {
+            .prev_accesses = {THSVS_ACCESS_TRANSFER_WRITE},
+            .next_accesses = {THSVS_ACCESS_HOST_READ}}
+    );
+
+    write_timestamp(PASS_TIMESTAMP_GEOMETRY_START);
+
     {
         TracyVkZone(tracy_ctx, *command_buffer, "render geometry");
 
@@ -473,6 +587,33 @@ void render(
         );
     }
 
+    write_timestamp(PASS_TIMESTAMP_GEOMETRY_END);
+
+    // Read by the texture streamer whenever it next looks, so like the
+    // culling stats it's always a frame or two old.
+    insert_global_barrier(
+        command_buffer,
+        GlobalBarrier<1, 1> {
+            .prev_accesses = {THSVS_ACCESS_COMPUTE_SHADER_WRITE},
+            .next_accesses = {THSVS_ACCESS_TRANSFER_READ}}
+    );
+
+    command_buffer.copyBuffer(
+        resources.misc_storage_buffer.buffer,
+        resources.texture_feedback_readback.buffer.buffer,
+        {vk::BufferCopy {
+            .srcOffset = offsetof(MiscStorage, texture_feedback),
+            .dstOffset = 0,
+            .size = sizeof(MiscStorage::texture_feedback)}}
+    );
+
+    insert_global_barrier(
+        command_buffer,
+        GlobalBarrier<1, 1> {
+            .prev_accesses = {THSVS_ACCESS_TRANSFER_WRITE},
+            .next_accesses = {THSVS_ACCESS_HOST_READ}}
+    );
+
     insert_color_image_barriers(
         command_buffer,
         std::array {
@@ -546,3 +687,40 @@ void render(
             .image = swapchain_image}}
     );
 }
+
+std::optional<PassTimings> read_pass_timings(
+    const vk::raii::QueryPool& timestamp_queries,
+    float timestamp_period
+) {
+    auto [result, timestamps] = timestamp_queries.getResults<uint64_t>(
+        0,
+        PASS_TIMESTAMP_COUNT,
+        PASS_TIMESTAMP_COUNT * sizeof(uint64_t),
+        sizeof(uint64_t),
+        vk::QueryResultFlagBits::e64
+    );
+
+    if (result != vk::Result::eSuccess) {
+        return std::nullopt;
+    }
+
+    // `timestamp_period` is in nanoseconds per tick.
+    auto milliseconds = [&](uint32_t start, uint32_t end) {
+        return double(timestamps[end] - timestamps[start]) * timestamp_period
+            / 1'000'000.0;
+    };
+
+    return PassTimings {
+        .cull =
+            milliseconds(PASS_TIMESTAMP_CULL_START, PASS_TIMESTAMP_CULL_END),
+        .visbuffer =
+            milliseconds(PASS_TIMESTAMP_CULL_END, PASS_TIMESTAMP_VISBUFFER_END),
+        .shadows = milliseconds(
+            PASS_TIMESTAMP_SHADOWS_START,
+            PASS_TIMESTAMP_SHADOWS_END
+        ),
+        .geometry = milliseconds(
+            PASS_TIMESTAMP_GEOMETRY_START,
+            PASS_TIMESTAMP_GEOMETRY_END
+        )};
+}
@@ -11,6 +11,25 @@ void render(
     vk::Extent2D extent,
     uint32_t graphics_queue_family,
     tracy::VkCtx* tracy_ctx,
+    const vk::raii::QueryPool& timestamp_queries,
     uint32_t swapchain_image_index,
     uint64_t uniform_buffer_address
 );
+
+// GPU time spent in the main passes of a frame, in milliseconds.
+struct PassTimings {
+    // Culling instances, meshlet groups and meshlets, and writing the draw
+    // calls for the main view.
+    double cull = 0.0;
+    double visbuffer = 0.0;
+    // Culling and rasterizing all the shadow cascades.
+    double shadows = 0.0;
+    double geometry = 0.0;
+};
+
+// Read the timestamps that `render` wrote into `timestamp_queries`. Returns
+// nothing if the frame hasn't finished yet.
+std::optional<PassTimings> read_pass_timings(
+    const vk::raii::QueryPool& timestamp_queries,
+    float timestamp_period
+);
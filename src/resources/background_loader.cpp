@@ -0,0 +1,115 @@
+#include "background_loader.h"
+
+#include "baked_scene.h"
+
+BackgroundLoader::BackgroundLoader(
+    std::filesystem::path filepath,
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    const vk::raii::Queue& queue,
+    std::mutex* queue_mutex,
+    uint32_t queue_family,
+    DescriptorSet& descriptor_set,
+    std::shared_ptr<GeometryArena> geometry_arena,
+    const Pipelines& pipelines,
+    vk::DeviceSize staging_budget,
+    TextureStreamer* texture_streamer
+) {
+    thread = std::jthread([=,
+                           this,
+                           &device,
+                           &queue,
+                           &descriptor_set,
+                           &pipelines](std::stop_token stop_token) {
+        ZoneScopedN("background loading");
+
+        auto staging = StagingRing(
+            device,
+            allocator,
+            queue,
+            queue_family,
+            staging_budget,
+            4,
+            queue_mutex
+        );
+
+        // `on_resident` is called from `staging` when batches complete,
+        // which can be after the loading function has returned.
+        auto receiver = SceneReceiver {
+            .on_nodes =
+                [&](std::vector<SceneNode> nodes) {
+                    std::unique_lock lock(mutex);
+                    resident_nodes = std::move(nodes);
+                },
+            .on_resident =
+                [&](const std::vector<NodeInstance>& instances) {
+                    std::unique_lock lock(mutex);
+                    resident_instances.insert(
+                        resident_instances.end(),
+                        instances.begin(),
+                        instances.end()
+                    );
+                }};
+
+        // `GltfMesh` can't be moved, so construct it in place.
+        auto loaded = std::unique_ptr<GltfMesh>(
+            filepath.extension() == ".hscene"
+                ? new GltfMesh(load_baked_scene(
+                    filepath,
+                    allocator,
+                    device,
+                    queue_family,
+                    staging,
+                    descriptor_set,
+                    texture_streamer,
+                    geometry_arena,
+                    stop_token,
+                    receiver
+                ))
+                : new GltfMesh(load_gltf(
+                    filepath,
+                    allocator,
+                    device,
+                    queue_family,
+                    staging,
+                    descriptor_set,
+                    texture_streamer,
+                    geometry_arena,
+                    pipelines,
+                    stop_token,
+                    receiver
+                ))
+        );
+
+        staging.finish();
+
+        std::unique_lock lock(mutex);
+        mesh = std::move(loaded);
+    });
+}
+
+void BackgroundLoader::take_resident(SceneGraph& scene) {
+    std::unique_lock lock(mutex);
+
+    // The nodes always arrive before any of the instances that use them.
+    if (!resident_nodes.empty()) {
+        scene.add_nodes(resident_nodes);
+        resident_nodes.clear();
+    }
+
+    scene.add_instances(resident_instances);
+    resident_instances.clear();
+}
+
+bool BackgroundLoader::finished() {
+    std::unique_lock lock(mutex);
+    return mesh != nullptr;
+}
+
+void BackgroundLoader::stop() {
+    thread.request_stop();
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
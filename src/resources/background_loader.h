@@ -0,0 +1,44 @@
+#pragma once
+#include "mesh_loading.h"
+#include "texture_streaming.h"
+
+// Loads a gltf or baked (`.hscene`) scene on its own thread, recording into
+// its own staging ring, so that the render loop can start straight away.
+// Instances are handed over as soon as the data they point to has finished
+// uploading.
+struct BackgroundLoader {
+    std::mutex mutex;
+    std::vector<SceneNode> resident_nodes;
+    std::vector<NodeInstance> resident_instances;
+    // Set once loading has finished (or been stopped), keeping the uploaded
+    // buffers and images alive.
+    std::unique_ptr<GltfMesh> mesh;
+    std::jthread thread;
+
+    BackgroundLoader(
+        std::filesystem::path filepath,
+        vma::Allocator allocator,
+        const vk::raii::Device& device,
+        const vk::raii::Queue& queue,
+        // Only needs to be set if `queue` is also used by another thread.
+        std::mutex* queue_mutex,
+        uint32_t queue_family,
+        DescriptorSet& descriptor_set,
+        std::shared_ptr<GeometryArena> geometry_arena,
+        const Pipelines& pipelines,
+        vk::DeviceSize staging_budget,
+        // Takes the scene's textures if set, see `load_scene_images`.
+        TextureStreamer* texture_streamer
+    );
+
+    // Add the scene's nodes and any instances that have become resident
+    // since the last call to `scene`.
+    void take_resident(SceneGraph& scene);
+
+    // Whether loading has finished. Every instance has been handed over to
+    // `take_resident` by then.
+    bool finished();
+
+    // Cancel loading and wait for the thread to exit.
+    void stop();
+};
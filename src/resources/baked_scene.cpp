@@ -0,0 +1,654 @@
+#include "baked_scene.h"
+
+#include "image_loading.h"
+#include "vertex_repacking.h"
+
+#include "../load_stats.h"
+#include "../thread_pool.h"
+
+size_t align_to_16(size_t offset) {
+    return (offset + 15) & ~size_t(15);
+}
+
+// A range of the decoded geometry section that still needs encoding.
+struct UnencodedStream {
+    uint64_t offset;
+    // Rounded up to whole elements.
+    size_t num_bytes;
+    size_t stride;
+    bool index_sequence;
+};
+
+// The decoded geometry section and the streams it'll be encoded as.
+struct BakedGeometry {
+    std::vector<uint8_t> bytes;
+    std::vector<UnencodedStream> streams;
+};
+
+// Append `num_bytes` made up of `stride` sized elements to the geometry
+// section and return their offset.
+uint64_t append_geometry(
+    BakedGeometry& geometry,
+    const void* bytes,
+    size_t num_bytes,
+    size_t stride,
+    bool index_sequence = false
+) {
+    auto element_size = stream_element_size(stride, index_sequence);
+    auto offset = align_to_16(geometry.bytes.size());
+
+    // The stream gets rounded up to whole elements, which the zeroed
+    // padding takes care of.
+    geometry.bytes.resize(
+        offset + stream_padded_size(num_bytes, element_size)
+    );
+    if (num_bytes > 0) {
+        std::memcpy(geometry.bytes.data() + offset, bytes, num_bytes);
+    }
+
+    geometry.streams.push_back(UnencodedStream {
+        .offset = offset,
+        .num_bytes = stream_padded_size(num_bytes, element_size),
+        .stride = stride,
+        .index_sequence = index_sequence});
+
+    return offset;
+}
+
+void bake_scene(
+    const std::filesystem::path& gltf_filepath,
+    const std::filesystem::path& output_filepath
+) {
+    ZoneScoped;
+
+    auto parent_path = gltf_filepath.parent_path();
+    auto asset = parse_gltf(gltf_filepath);
+    auto source_buffers = map_gltf_buffers(asset, parent_path);
+
+    // Texture indices are baked as indices into the image path list, and get
+    // remapped to descriptor indices at load time.
+    std::string image_paths;
+    std::vector<uint32_t> image_indices(asset.images.size());
+
+    for (size_t i = 0; i < asset.images.size(); i++) {
+        auto* uri = std::get_if<fastgltf::sources::URI>(&asset.images[i].data);
+
+        if (!uri) {
+            dbg(i, "is not a uri image");
+            abort();
+        }
+
+        auto image_path = std::filesystem::proximate(
+            parent_path / uri->uri.fspath(),
+            output_filepath.parent_path()
+        );
+
+        image_paths += image_path.string();
+        image_paths.push_back('\0');
+        image_indices[i] = static_cast<uint32_t>(i);
+    }
+
+    auto mesh_nodes = collect_mesh_nodes(asset);
+    auto jobs = gather_primitive_jobs(asset, gltf_filepath, mesh_nodes);
+
+    std::vector<BakedNode> nodes;
+    for (auto& node : gltf_scene_nodes(asset)) {
+        nodes.push_back(BakedNode {
+            .local_transform = node.local_transform,
+            .parent = node.parent,
+            .padding = {}});
+    }
+
+    auto cache = FsCache(gltf_filepath);
+    std::vector<PrimitiveCpuData> cpu_data(jobs.size());
+
+    parallel_for(jobs.size(), [&](size_t i) {
+        cpu_data[i] = process_primitive(asset, jobs[i], source_buffers, cache);
+    });
+
+    cache.write();
+
+    std::vector<MeshInfo> mesh_infos;
+    mesh_infos.reserve(jobs.size());
+    std::vector<BakedInstance> instances;
+    BakedGeometry geometry;
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        auto& primitive = jobs[i].primitive;
+        auto& primitive_name = jobs[i].name;
+        auto& meshlets = cpu_data[i].meshlets;
+
+        auto& positions =
+            get_accessor(asset, primitive, "POSITION", primitive_name);
+        auto& normals =
+            get_accessor(asset, primitive, "NORMAL", primitive_name);
+        auto& uvs =
+            get_accessor(asset, primitive, "TEXCOORD_0", primitive_name);
+        assert(normals.componentType == fastgltf::ComponentType::Byte);
+        assert(uvs.componentType == fastgltf::ComponentType::UnsignedShort);
+
+        // Strip the padding element that the gltf stores, doing on the CPU
+        // what `VertexRepacker` does at gltf load time.
+        std::vector<uint16_t> repacked_positions(positions.count * 3);
+        repack_positions(
+            reinterpret_cast<const uint16_t*>(
+                accessor_data(asset, positions, source_buffers)
+            ),
+            repacked_positions.data(),
+            positions.count
+        );
+
+        std::vector<int8_t> repacked_normals(normals.count * 3);
+        repack_normals(
+            reinterpret_cast<const int8_t*>(
+                accessor_data(asset, normals, source_buffers)
+            ),
+            repacked_normals.data(),
+            normals.count
+        );
+
+        std::vector<uint16_t> packed_positions(positions.count * 3);
+        remap_vertices(
+            packed_positions.data(),
+            repacked_positions.data(),
+            positions.count,
+            sizeof(uint16_t) * 3,
+            meshlets.vertex_remap
+        );
+
+        std::vector<int8_t> packed_normals(normals.count * 3);
+        remap_vertices(
+            packed_normals.data(),
+            repacked_normals.data(),
+            normals.count,
+            sizeof(int8_t) * 3,
+            meshlets.vertex_remap
+        );
+
+        std::vector<uint16_t> packed_uvs(uvs.count * 2);
+        remap_vertices(
+            packed_uvs.data(),
+            accessor_data(asset, uvs, source_buffers),
+            uvs.count,
+            sizeof(uint16_t) * 2,
+            meshlets.vertex_remap
+        );
+
+        auto mesh_info =
+            create_mesh_info(asset, primitive, primitive_name, image_indices);
+
+        mesh_info.positions = append_geometry(
+            geometry,
+            packed_positions.data(),
+            packed_positions.size() * sizeof(uint16_t),
+            sizeof(uint16_t) * 3
+        );
+        mesh_info.normals = append_geometry(
+            geometry,
+            packed_normals.data(),
+            packed_normals.size(),
+            sizeof(int8_t) * 3
+        );
+        mesh_info.uvs = append_geometry(
+            geometry,
+            packed_uvs.data(),
+            packed_uvs.size() * sizeof(uint16_t),
+            sizeof(uint16_t) * 2
+        );
+        mesh_info.indices = (mesh_info.flags & MESH_INFO_FLAGS_32_BIT_INDICES)
+            ? append_geometry(
+                geometry,
+                meshlets.indices_32bit.data(),
+                meshlets.indices_32bit.size() * sizeof(uint32_t),
+                sizeof(uint32_t),
+                true
+            )
+            : append_geometry(
+                geometry,
+                meshlets.indices_16bit.data(),
+                meshlets.indices_16bit.size() * sizeof(uint16_t),
+                sizeof(uint16_t),
+                true
+            );
+        mesh_info.micro_indices = append_geometry(
+            geometry,
+            meshlets.micro_indices.data(),
+            meshlets.micro_indices.size(),
+            sizeof(uint8_t)
+        );
+        mesh_info.meshlets = append_geometry(
+            geometry,
+            meshlets.meshlets.data(),
+            meshlets.meshlets.size() * sizeof(Meshlet),
+            sizeof(Meshlet)
+        );
+        mesh_info.meshlet_lods = append_geometry(
+            geometry,
+            meshlets.lods.data(),
+            meshlets.lods.size() * sizeof(MeshletLod),
+            sizeof(MeshletLod)
+        );
+        mesh_info.meshlet_groups = append_geometry(
+            geometry,
+            meshlets.groups.data(),
+            meshlets.groups.size() * sizeof(MeshletGroup),
+            sizeof(MeshletGroup)
+        );
+
+        // Parts are baked as primitives of their own.
+        for (auto& part_info : split_mesh_info(mesh_info, meshlets)) {
+            for (auto node : jobs[i].nodes) {
+                instances.push_back(BakedInstance {
+                    .node = node,
+                    .primitive_index =
+                        static_cast<uint32_t>(mesh_infos.size())});
+            }
+
+            mesh_infos.push_back(part_info);
+        }
+    }
+
+    std::vector<EncodedStream> encoded_streams(geometry.streams.size());
+
+    parallel_for(geometry.streams.size(), [&](size_t i) {
+        auto& stream = geometry.streams[i];
+        encoded_streams[i] = encode_stream(
+            geometry.bytes.data() + stream.offset,
+            stream.num_bytes,
+            stream.stride,
+            stream.index_sequence
+        );
+    });
+
+    std::vector<BakedStream> streams;
+    std::vector<uint8_t> encoded_geometry;
+
+    for (size_t i = 0; i < encoded_streams.size(); i++) {
+        auto& encoded = encoded_streams[i];
+
+        streams.push_back(BakedStream {
+            .offset = geometry.streams[i].offset,
+            .encoded_offset = encoded_geometry.size(),
+            .encoded_size = encoded.bytes.size(),
+            .codec = encoded.codec,
+            .count = encoded.count,
+            .element_size = encoded.element_size,
+            .padding = 0});
+
+        encoded_geometry.insert(
+            encoded_geometry.end(),
+            encoded.bytes.begin(),
+            encoded.bytes.end()
+        );
+    }
+
+    BakedSceneHeader header = {
+        .magic = BAKED_SCENE_MAGIC,
+        .version = BAKED_SCENE_VERSION,
+        .meshlet_size = sizeof(Meshlet),
+        .mesh_info_size = sizeof(MeshInfo),
+        .num_images = static_cast<uint32_t>(asset.images.size()),
+        .num_primitives = static_cast<uint32_t>(mesh_infos.size()),
+        .num_nodes = static_cast<uint32_t>(nodes.size()),
+        .num_instances = static_cast<uint32_t>(instances.size()),
+        .num_streams = static_cast<uint32_t>(streams.size()),
+        .padding = 0};
+    header.image_paths_offset = align_to_16(sizeof(BakedSceneHeader));
+    header.mesh_infos_offset =
+        align_to_16(header.image_paths_offset + image_paths.size());
+    header.nodes_offset = align_to_16(
+        header.mesh_infos_offset + mesh_infos.size() * sizeof(MeshInfo)
+    );
+    header.instances_offset = align_to_16(
+        header.nodes_offset + nodes.size() * sizeof(BakedNode)
+    );
+    header.streams_offset = align_to_16(
+        header.instances_offset + instances.size() * sizeof(BakedInstance)
+    );
+    header.geometry_offset = align_to_16(
+        header.streams_offset + streams.size() * sizeof(BakedStream)
+    );
+    header.encoded_geometry_size = encoded_geometry.size();
+    header.geometry_size = geometry.bytes.size();
+
+    auto stream = std::ofstream(output_filepath, std::ios::binary);
+
+    auto write_section = [&](uint64_t offset, const void* bytes, size_t size) {
+        // Zero the padding up to the start of the section.
+        static const char zeros[16] = {};
+        stream.write(zeros, offset - static_cast<uint64_t>(stream.tellp()));
+        stream.write(static_cast<const char*>(bytes), size);
+    };
+
+    write_section(0, &header, sizeof(BakedSceneHeader));
+    write_section(
+        header.image_paths_offset,
+        image_paths.data(),
+        image_paths.size()
+    );
+    write_section(
+        header.mesh_infos_offset,
+        mesh_infos.data(),
+        mesh_infos.size() * sizeof(MeshInfo)
+    );
+    write_section(
+        header.nodes_offset,
+        nodes.data(),
+        nodes.size() * sizeof(BakedNode)
+    );
+    write_section(
+        header.instances_offset,
+        instances.data(),
+        instances.size() * sizeof(BakedInstance)
+    );
+    write_section(
+        header.streams_offset,
+        streams.data(),
+        streams.size() * sizeof(BakedStream)
+    );
+    write_section(
+        header.geometry_offset,
+        encoded_geometry.data(),
+        encoded_geometry.size()
+    );
+
+    if (!stream) {
+        dbg(output_filepath, "failed to write");
+        abort();
+    }
+
+    dbg(output_filepath,
+        header.num_primitives,
+        header.num_instances,
+        header.geometry_size,
+        header.encoded_geometry_size);
+}
+
+GltfMesh load_baked_scene(
+    const std::filesystem::path& filepath,
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    uint32_t graphics_queue_family,
+    StagingRing& staging,
+    DescriptorSet& descriptor_set,
+    TextureStreamer* texture_streamer,
+    const std::shared_ptr<GeometryArena>& geometry_arena,
+    std::stop_token stop_token,
+    const SceneReceiver& receiver
+) {
+    ZoneScoped;
+
+    auto file = MappedFile(filepath);
+
+    if (file.size < sizeof(BakedSceneHeader)) {
+        dbg(filepath, file.size);
+        abort();
+    }
+
+    BakedSceneHeader header;
+    std::memcpy(&header, file.data, sizeof(BakedSceneHeader));
+
+    if (header.magic != BAKED_SCENE_MAGIC
+        || header.version != BAKED_SCENE_VERSION
+        || header.meshlet_size != sizeof(Meshlet)
+        || header.mesh_info_size != sizeof(MeshInfo)) {
+        dbg(filepath,
+            header.magic,
+            header.version,
+            header.meshlet_size,
+            header.mesh_info_size,
+            "needs rebaking");
+        abort();
+    }
+
+    auto section_in_bounds = [&](uint64_t offset, uint64_t size) {
+        return offset <= file.size && size <= file.size - offset;
+    };
+
+    if (!section_in_bounds(header.image_paths_offset, 0)
+        || header.mesh_infos_offset < header.image_paths_offset
+        || !section_in_bounds(
+            header.mesh_infos_offset,
+            uint64_t(header.num_primitives) * sizeof(MeshInfo)
+        )
+        || !section_in_bounds(
+            header.nodes_offset,
+            uint64_t(header.num_nodes) * sizeof(BakedNode)
+        )
+        || !section_in_bounds(
+            header.instances_offset,
+            uint64_t(header.num_instances) * sizeof(BakedInstance)
+        )
+        || !section_in_bounds(
+            header.streams_offset,
+            uint64_t(header.num_streams) * sizeof(BakedStream)
+        )
+        || !section_in_bounds(
+            header.geometry_offset,
+            header.encoded_geometry_size
+        )) {
+        dbg(filepath, file.size, "is truncated");
+        abort();
+    }
+
+    std::vector<std::filesystem::path> image_paths;
+    image_paths.reserve(header.num_images);
+
+    // The paths have to end before the mesh infos start.
+    auto image_path = reinterpret_cast<const char*>(
+        file.data + header.image_paths_offset
+    );
+    auto image_paths_end = reinterpret_cast<const char*>(
+        file.data + header.mesh_infos_offset
+    );
+
+    for (uint32_t i = 0; i < header.num_images; i++) {
+        auto terminator = std::find(image_path, image_paths_end, '\0');
+
+        if (terminator == image_paths_end) {
+            dbg(filepath, i, "has an unterminated image path");
+            abort();
+        }
+
+        image_paths.push_back(filepath.parent_path() / image_path);
+        image_path = terminator + 1;
+    }
+
+    std::vector<ImageWithView> images;
+    auto image_indices = load_scene_images(
+        image_paths,
+        allocator,
+        device,
+        graphics_queue_family,
+        staging,
+        descriptor_set,
+        texture_streamer,
+        images
+    );
+
+    if (stop_token.stop_requested()) {
+        return {
+            .images = std::move(images),
+            .image_indices = std::move(image_indices),
+            .image_index_tracker = descriptor_set.tracker,
+            .geometry_arena = geometry_arena};
+    }
+
+    // Decode all the streams in parallel, then all the geometry goes up in
+    // one go.
+    std::vector<uint8_t> decoded_geometry(header.geometry_size);
+
+    {
+        ZoneScopedN("geometry decode");
+        auto timer = PhaseTimer(
+            LoadStats::global().geometry_decode,
+            header.geometry_size
+        );
+
+        parallel_for(header.num_streams, [&](size_t i) {
+            BakedStream stream;
+            std::memcpy(
+                &stream,
+                file.data + header.streams_offset + i * sizeof(BakedStream),
+                sizeof(BakedStream)
+            );
+
+            if (stream.offset + size_t(stream.count) * stream.element_size
+                    > header.geometry_size
+                || stream.encoded_offset + stream.encoded_size
+                    > header.encoded_geometry_size) {
+                dbg(filepath, i, "has an out of bounds stream");
+                abort();
+            }
+
+            if (!decode_stream(
+                    decoded_geometry.data() + stream.offset,
+                    stream.codec,
+                    stream.count,
+                    stream.element_size,
+                    file.data + header.geometry_offset + stream.encoded_offset,
+                    stream.encoded_size
+                )) {
+                dbg(filepath, i, "has a corrupt stream");
+                abort();
+            }
+        });
+    }
+
+    auto geometry = geometry_arena->allocate(header.geometry_size);
+    copy_via_staging_buffer(
+        decoded_geometry.data(),
+        decoded_geometry.size(),
+        geometry.buffer,
+        geometry.offset,
+        staging
+    );
+
+    // Each mesh info gets its own 16 byte aligned slot as the shaders
+    // reference them individually.
+    auto mesh_info_stride = align_to_16(sizeof(MeshInfo));
+    std::vector<uint8_t> mesh_info_bytes(
+        header.num_primitives * mesh_info_stride
+    );
+
+    std::vector<GltfPrimitive> primitives;
+    primitives.reserve(header.num_primitives);
+
+    auto mesh_infos = geometry_arena->allocate(mesh_info_bytes.size());
+
+    auto remap_texture_index = [&](uint16_t index) {
+        if (index == UNUSED_TEXTURE_INDEX) {
+            return index;
+        }
+
+        if (index >= image_indices.size()) {
+            dbg(filepath, index, image_indices.size(), "is not an image");
+            abort();
+        }
+
+        return static_cast<uint16_t>(image_indices[index]);
+    };
+
+    for (uint32_t i = 0; i < header.num_primitives; i++) {
+        MeshInfo mesh_info;
+        std::memcpy(
+            &mesh_info,
+            file.data + header.mesh_infos_offset + i * sizeof(MeshInfo),
+            sizeof(MeshInfo)
+        );
+
+        mesh_info.positions += geometry.address;
+        mesh_info.indices += geometry.address;
+        mesh_info.normals += geometry.address;
+        mesh_info.uvs += geometry.address;
+        mesh_info.micro_indices += geometry.address;
+        mesh_info.meshlets += geometry.address;
+        mesh_info.meshlet_lods += geometry.address;
+        mesh_info.meshlet_groups += geometry.address;
+        mesh_info.base_color_texture_index =
+            remap_texture_index(mesh_info.base_color_texture_index);
+        mesh_info.metallic_roughness_texture_index =
+            remap_texture_index(mesh_info.metallic_roughness_texture_index);
+        mesh_info.normal_texture_index =
+            remap_texture_index(mesh_info.normal_texture_index);
+
+        std::memcpy(
+            mesh_info_bytes.data() + i * mesh_info_stride,
+            &mesh_info,
+            sizeof(MeshInfo)
+        );
+
+        primitives.push_back(GltfPrimitive {
+            .mesh_info_addresses = {mesh_infos.address + i * mesh_info_stride},
+            .num_meshlets = mesh_info.num_meshlets});
+    }
+
+    copy_via_staging_buffer(
+        mesh_info_bytes.data(),
+        mesh_info_bytes.size(),
+        mesh_infos.buffer,
+        mesh_infos.offset,
+        staging
+    );
+
+    std::vector<SceneNode> nodes(header.num_nodes);
+
+    for (uint32_t i = 0; i < header.num_nodes; i++) {
+        BakedNode baked;
+        std::memcpy(
+            &baked,
+            file.data + header.nodes_offset + i * sizeof(BakedNode),
+            sizeof(BakedNode)
+        );
+
+        if (baked.parent != NO_PARENT && baked.parent >= header.num_nodes) {
+            dbg(filepath, i, baked.parent, "has an out of bounds parent");
+            abort();
+        }
+
+        nodes[i] = SceneNode {
+            .parent = baked.parent,
+            .local_transform = baked.local_transform};
+    }
+
+    receiver.on_nodes(std::move(nodes));
+
+    std::vector<NodeInstance> instances(header.num_instances);
+
+    for (uint32_t i = 0; i < header.num_instances; i++) {
+        BakedInstance baked;
+        std::memcpy(
+            &baked,
+            file.data + header.instances_offset + i * sizeof(BakedInstance),
+            sizeof(BakedInstance)
+        );
+
+        if (baked.node >= header.num_nodes
+            || baked.primitive_index >= header.num_primitives) {
+            dbg(filepath,
+                i,
+                baked.node,
+                baked.primitive_index,
+                "has an out of bounds instance");
+            abort();
+        }
+
+        instances[i] = NodeInstance {
+            .node = baked.node,
+            .mesh_info_address =
+                primitives[baked.primitive_index].mesh_info_addresses[0]};
+    }
+
+    staging.on_complete([instances = std::move(instances), &receiver]() {
+        receiver.on_resident(instances);
+    });
+    staging.flush();
+
+    return {
+        .images = std::move(images),
+        .image_indices = std::move(image_indices),
+        .primitives = std::move(primitives),
+        .geometry_allocations = {geometry, mesh_infos},
+        .image_index_tracker = descriptor_set.tracker,
+        .geometry_arena = geometry_arena};
+}
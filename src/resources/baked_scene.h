@@ -0,0 +1,88 @@
+#pragma once
+#include "mesh_loading.h"
+#include "stream_codec.h"
+
+// A scene baked out of a gltf file, with everything the GPU needs already in
+// its final layout, so that loading it is one mapping and a few big copies.
+//
+// Layout (each section starts on a 16 byte boundary):
+//   BakedSceneHeader
+//   image paths: `num_images` null-terminated paths, relative to the file
+//   mesh infos: `num_primitives` `MeshInfo`s
+//   nodes: `num_nodes` `BakedNode`s
+//   instances: `num_instances` `BakedInstance`s
+//   streams: `num_streams` `BakedStream`s
+//   geometry: the encoded streams, back to back
+//
+// The geometry decodes to `geometry_size` bytes holding every primitive's
+// streams, each aligned to 16 bytes. The buffer addresses in the baked mesh
+// infos are offsets into the decoded geometry and the texture indices index
+// into the image paths.
+// Bump `BAKED_SCENE_VERSION` whenever any of this (or `Meshlet`/`MeshInfo`)
+// changes.
+
+const static uint32_t BAKED_SCENE_MAGIC = 0x4e435348; // "HSCN"
+const static uint32_t BAKED_SCENE_VERSION = 9;
+
+struct BakedSceneHeader {
+    uint32_t magic;
+    uint32_t version;
+    // Catch stale files after a struct changes without a version bump.
+    uint32_t meshlet_size;
+    uint32_t mesh_info_size;
+    uint32_t num_images;
+    uint32_t num_primitives;
+    uint32_t num_nodes;
+    uint32_t num_instances;
+    uint32_t num_streams;
+    uint32_t padding;
+    uint64_t image_paths_offset;
+    uint64_t mesh_infos_offset;
+    uint64_t nodes_offset;
+    uint64_t instances_offset;
+    uint64_t streams_offset;
+    uint64_t geometry_offset;
+    uint64_t encoded_geometry_size;
+    uint64_t geometry_size;
+};
+
+struct BakedNode {
+    glm::mat4 local_transform;
+    uint32_t parent;
+    uint32_t padding[3];
+};
+
+struct BakedInstance {
+    uint32_t node;
+    uint32_t primitive_index;
+};
+
+// One encoded range of the geometry section, see `stream_codec.h`.
+struct BakedStream {
+    uint64_t offset;
+    uint64_t encoded_offset;
+    uint64_t encoded_size;
+    StreamCodec codec;
+    uint32_t count;
+    uint32_t element_size;
+    uint32_t padding;
+};
+
+// Parse, meshletize and repack a gltf file and write it out as a baked scene.
+void bake_scene(
+    const std::filesystem::path& gltf_filepath,
+    const std::filesystem::path& output_filepath
+);
+
+GltfMesh load_baked_scene(
+    const std::filesystem::path& filepath,
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    uint32_t graphics_queue_family,
+    StagingRing& staging,
+    DescriptorSet& descriptor_set,
+    TextureStreamer* texture_streamer,
+    const std::shared_ptr<GeometryArena>& geometry_arena,
+    std::stop_token stop_token,
+    const SceneReceiver& receiver
+);
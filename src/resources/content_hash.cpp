@@ -0,0 +1,111 @@
+#include "content_hash.h"
+
+const static uint64_t PRIME_1 = 0x9E3779B185EBCA87ull;
+const static uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+const static uint64_t PRIME_3 = 0x165667B19E3779F9ull;
+const static uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ull;
+const static uint64_t PRIME_5 = 0x27D4EB2F165667C5ull;
+
+uint64_t rotate_left(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Unaligned little-endian reads. `memcpy` reads in host order, so swap on
+// big-endian hosts to get the same hash for the same bytes everywhere.
+uint64_t read_u64(const uint8_t* bytes) {
+    uint64_t value;
+    std::memcpy(&value, bytes, sizeof(uint64_t));
+    if constexpr (std::endian::native == std::endian::big) {
+        value = __builtin_bswap64(value);
+    }
+    return value;
+}
+
+uint32_t read_u32(const uint8_t* bytes) {
+    uint32_t value;
+    std::memcpy(&value, bytes, sizeof(uint32_t));
+    if constexpr (std::endian::native == std::endian::big) {
+        value = __builtin_bswap32(value);
+    }
+    return value;
+}
+
+uint64_t hash_round(uint64_t accumulator, uint64_t input) {
+    accumulator += input * PRIME_2;
+    accumulator = rotate_left(accumulator, 31);
+    return accumulator * PRIME_1;
+}
+
+uint64_t hash_merge_round(uint64_t accumulator, uint64_t value) {
+    accumulator ^= hash_round(0, value);
+    return accumulator * PRIME_1 + PRIME_4;
+}
+
+uint64_t hash_bytes(const void* data, size_t num_bytes, uint64_t seed) {
+    auto* bytes = static_cast<const uint8_t*>(data);
+    auto* end = bytes + num_bytes;
+
+    uint64_t hash;
+
+    if (num_bytes >= 32) {
+        uint64_t lanes[4] = {
+            seed + PRIME_1 + PRIME_2,
+            seed + PRIME_2,
+            seed,
+            seed - PRIME_1};
+
+        // Four independent lanes of 8 bytes each.
+        for (; end - bytes >= 32; bytes += 32) {
+            for (size_t i = 0; i < 4; i++) {
+                lanes[i] = hash_round(lanes[i], read_u64(bytes + i * 8));
+            }
+        }
+
+        hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7)
+            + rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+
+        for (auto lane : lanes) {
+            hash = hash_merge_round(hash, lane);
+        }
+    } else {
+        hash = seed + PRIME_5;
+    }
+
+    hash += num_bytes;
+
+    for (; end - bytes >= 8; bytes += 8) {
+        hash ^= hash_round(0, read_u64(bytes));
+        hash = rotate_left(hash, 27) * PRIME_1 + PRIME_4;
+    }
+
+    if (end - bytes >= 4) {
+        hash ^= uint64_t(read_u32(bytes)) * PRIME_1;
+        hash = rotate_left(hash, 23) * PRIME_2 + PRIME_3;
+        bytes += 4;
+    }
+
+    for (; bytes < end; bytes++) {
+        hash ^= uint64_t(*bytes) * PRIME_5;
+        hash = rotate_left(hash, 11) * PRIME_1;
+    }
+
+    // Avalanche.
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+std::string hash_to_string(uint64_t hash) {
+    const char* digits = "0123456789abcdef";
+    std::string string(16, '0');
+
+    for (size_t i = 0; i < 16; i++) {
+        string[15 - i] = digits[(hash >> (i * 4)) & 0xf];
+    }
+
+    return string;
+}
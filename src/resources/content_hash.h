@@ -0,0 +1,18 @@
+#pragma once
+
+// XXH64 (https://github.com/Cyan4973/xxHash), implemented here so that cache
+// keys stay the same across standard libraries and platforms. Hashes can be
+// chained by passing one as the seed of the next.
+//
+// The same bytes hash the same on any host, but `hash_value` hashes the
+// in-memory representation, so it still depends on the host's endianness.
+uint64_t hash_bytes(const void* data, size_t num_bytes, uint64_t seed = 0);
+
+template<class T>
+uint64_t hash_value(const T& value, uint64_t seed) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    return hash_bytes(&value, sizeof(T), seed);
+}
+
+// 16 lowercase hex digits.
+std::string hash_to_string(uint64_t hash);
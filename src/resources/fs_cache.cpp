@@ -0,0 +1,309 @@
+#include "fs_cache.h"
+
+std::optional<FsCachePack>
+FsCachePack::open(const std::filesystem::path& path) {
+    if (!std::filesystem::exists(path)) {
+        return std::nullopt;
+    }
+
+    auto file = MappedFile(path);
+
+    if (file.size < sizeof(FsCachePackHeader)) {
+        dbg(path, "is too small");
+        return std::nullopt;
+    }
+
+    FsCachePackHeader header;
+    std::memcpy(&header, file.data, sizeof(FsCachePackHeader));
+
+    if (header.magic != FS_CACHE_PACK_MAGIC
+        || header.version != FS_CACHE_PACK_VERSION
+        || header.num_entries
+            > (file.size - sizeof(FsCachePackHeader))
+                / sizeof(FsCachePackEntry)) {
+        dbg(path, header.magic, header.version, "is stale or corrupt");
+        return std::nullopt;
+    }
+
+    std::vector<FsCachePackEntry> entries(header.num_entries);
+    std::memcpy(
+        entries.data(),
+        file.data + sizeof(FsCachePackHeader),
+        entries.size() * sizeof(FsCachePackEntry)
+    );
+
+    for (auto& entry : entries) {
+        if (entry.size < sizeof(FsCacheHeader) || entry.offset > file.size
+            || entry.size > file.size - entry.offset) {
+            dbg(path, entry.key, "has an out of bounds blob");
+            return std::nullopt;
+        }
+    }
+
+    auto num_entries = entries.size();
+
+    return FsCachePack {
+        .filepath = path,
+        .file = std::move(file),
+        .entries = std::move(entries),
+        .used = std::vector<uint8_t>(num_entries, false)};
+}
+
+FsCache::FsCache(const std::filesystem::path& asset_filepath) {
+    // So that different spellings of the same path share a pack.
+    auto asset_path =
+        std::filesystem::weakly_canonical(asset_filepath).string();
+    auto cache_dir = std::filesystem::path("cache");
+    filepath = cache_dir
+        / (hash_to_string(hash_bytes(asset_path.data(), asset_path.size()))
+           + ".pack");
+
+    if (auto pack = FsCachePack::open(filepath)) {
+        packs.push_back(std::move(*pack));
+    }
+
+    if (!std::filesystem::is_directory(cache_dir)) {
+        return;
+    }
+
+    for (auto& dir_entry : std::filesystem::directory_iterator(cache_dir)) {
+        auto& path = dir_entry.path();
+
+        if (path.extension() != ".pack" || path == filepath) {
+            continue;
+        }
+
+        if (auto pack = FsCachePack::open(path)) {
+            packs.push_back(std::move(*pack));
+        }
+    }
+}
+
+int& FsCache::zstd_level() {
+    static int level = 0;
+    return level;
+}
+
+const uint8_t* FsCache::find(const std::string& key, size_t& size) {
+    auto hash = hash_bytes(key.data(), key.size());
+
+    for (auto& pack : packs) {
+        auto entry = std::lower_bound(
+            pack.entries.begin(),
+            pack.entries.end(),
+            hash,
+            [](const FsCachePackEntry& entry, uint64_t hash) {
+                return entry.key < hash;
+            }
+        );
+
+        if (entry == pack.entries.end() || entry->key != hash) {
+            continue;
+        }
+
+        {
+            auto lock = std::lock_guard(mutex);
+            pack.used[entry - pack.entries.begin()] = true;
+        }
+
+        size = entry->size;
+        return pack.file.data + entry->offset;
+    }
+
+    return nullptr;
+}
+
+void FsCache::insert_blob(const std::string& key, std::vector<uint8_t> blob) {
+    auto hash = hash_bytes(key.data(), key.size());
+
+    auto lock = std::lock_guard(mutex);
+    inserted.push_back({hash, std::move(blob)});
+}
+
+bool FsCache::decode_blob(
+    void* destination,
+    const FsCacheHeader& header,
+    const uint8_t* encoded,
+    size_t size
+) {
+    auto encoded_size = size - sizeof(FsCacheHeader);
+
+    if (!(header.flags & FS_CACHE_FLAGS_ZSTD)) {
+        return decode_stream(
+            destination,
+            header.codec,
+            header.count,
+            header.element_size,
+            encoded,
+            encoded_size
+        );
+    }
+
+    auto decompressed_size = ZSTD_getFrameContentSize(encoded, encoded_size);
+
+    // Streams are only ever stored encoded when that's smaller than the raw
+    // data, so anything bigger is corrupt. This also bounds the allocation
+    // below, as the frame size comes from the file.
+    if (decompressed_size == ZSTD_CONTENTSIZE_UNKNOWN
+        || decompressed_size == ZSTD_CONTENTSIZE_ERROR
+        || decompressed_size > size_t(header.count) * header.element_size) {
+        dbg(decompressed_size, "is not a valid zstd frame size");
+        return false;
+    }
+
+    std::vector<uint8_t> decompressed(decompressed_size);
+    auto bytes_decompressed = ZSTD_decompress(
+        decompressed.data(),
+        decompressed.size(),
+        encoded,
+        encoded_size
+    );
+
+    if (ZSTD_isError(bytes_decompressed)
+        || bytes_decompressed != decompressed_size) {
+        dbg(bytes_decompressed, decompressed_size, "failed to decompress");
+        return false;
+    }
+
+    return decode_stream(
+        destination,
+        header.codec,
+        header.count,
+        header.element_size,
+        decompressed.data(),
+        decompressed.size()
+    );
+}
+
+std::vector<uint8_t>
+FsCache::encode_blob(FsCacheHeader header, std::vector<uint8_t> encoded) {
+    if (zstd_level() > 0) {
+        std::vector<uint8_t> compressed(ZSTD_compressBound(encoded.size()));
+        auto compressed_size = ZSTD_compress(
+            compressed.data(),
+            compressed.size(),
+            encoded.data(),
+            encoded.size(),
+            zstd_level()
+        );
+
+        // Keep the data as-is if compressing didn't help.
+        if (!ZSTD_isError(compressed_size)
+            && compressed_size < encoded.size()) {
+            compressed.resize(compressed_size);
+            encoded = std::move(compressed);
+            header.flags |= FS_CACHE_FLAGS_ZSTD;
+        }
+    }
+
+    std::vector<uint8_t> blob(sizeof(FsCacheHeader) + encoded.size());
+    std::memcpy(blob.data(), &header, sizeof(FsCacheHeader));
+    if (!encoded.empty()) {
+        std::memcpy(
+            blob.data() + sizeof(FsCacheHeader),
+            encoded.data(),
+            encoded.size()
+        );
+    }
+
+    return blob;
+}
+
+void FsCache::write() {
+    ZoneScoped;
+
+    auto lock = std::lock_guard(mutex);
+
+    // Blobs from other assets' packs need copying in even if nothing was
+    // inserted, so that this pack stops depending on them.
+    auto uses_other_packs = std::any_of(
+        packs.begin(),
+        packs.end(),
+        [&](const FsCachePack& pack) {
+            return pack.filepath != filepath
+                && std::find(pack.used.begin(), pack.used.end(), true)
+                != pack.used.end();
+        }
+    );
+
+    if (inserted.empty() && !uses_other_packs) {
+        return;
+    }
+
+    struct Blob {
+        uint64_t key;
+        const uint8_t* data;
+        size_t size;
+    };
+
+    std::vector<Blob> blobs;
+
+    // Inserted blobs go first so that they win over old entries with the same
+    // key, which were looked up but turned out to be corrupt.
+    for (auto& [key, blob] : inserted) {
+        blobs.push_back(
+            Blob {.key = key, .data = blob.data(), .size = blob.size()}
+        );
+    }
+
+    for (auto& pack : packs) {
+        for (size_t i = 0; i < pack.entries.size(); i++) {
+            if (pack.used[i]) {
+                blobs.push_back(Blob {
+                    .key = pack.entries[i].key,
+                    .data = pack.file.data + pack.entries[i].offset,
+                    .size = pack.entries[i].size});
+            }
+        }
+    }
+
+    // Identical primitives can insert the same key more than once, and the
+    // same blob can be in several packs.
+    std::stable_sort(blobs.begin(), blobs.end(), [](auto& a, auto& b) {
+        return a.key < b.key;
+    });
+    blobs.erase(
+        std::unique(
+            blobs.begin(),
+            blobs.end(),
+            [](auto& a, auto& b) { return a.key == b.key; }
+        ),
+        blobs.end()
+    );
+
+    FsCachePackHeader header = {
+        .magic = FS_CACHE_PACK_MAGIC,
+        .version = FS_CACHE_PACK_VERSION,
+        .num_entries = blobs.size()};
+
+    std::vector<FsCachePackEntry> new_entries;
+    uint64_t offset = sizeof(FsCachePackHeader)
+        + blobs.size() * sizeof(FsCachePackEntry);
+
+    for (auto& blob : blobs) {
+        new_entries.push_back(FsCachePackEntry {
+            .key = blob.key,
+            .offset = offset,
+            .size = blob.size});
+        offset += blob.size;
+    }
+
+    // Written next to the old pack and then moved over it, so that the old
+    // one stays intact in the mapping until this is done.
+    auto temp_filepath = filepath;
+    temp_filepath += ".tmp";
+
+    {
+        auto stream = std::ofstream(temp_filepath, std::ios::binary);
+        stream.write((char*)&header, sizeof(FsCachePackHeader));
+        stream.write(
+            (char*)new_entries.data(),
+            new_entries.size() * sizeof(FsCachePackEntry)
+        );
+        for (auto& blob : blobs) {
+            stream.write((const char*)blob.data, blob.size);
+        }
+    }
+
+    std::filesystem::rename(temp_filepath, filepath);
+}
@@ -1,25 +1,192 @@
 #pragma once
+#include "content_hash.h"
+#include "mapped_file.h"
+#include "stream_codec.h"
 
+const static uint32_t FS_CACHE_FLAGS_ZSTD = 1 << 0;
+
+// Every blob starts with this, followed by the encoded stream.
+struct FsCacheHeader {
+    StreamCodec codec;
+    uint32_t element_size;
+    uint32_t count;
+    uint32_t flags;
+    // Before rounding up to whole elements.
+    uint64_t num_bytes;
+};
+
+// Layout of a pack file:
+//   FsCachePackHeader
+//   entries: `num_entries` `FsCachePackEntry`s, sorted by key
+//   blobs: each an `FsCacheHeader` followed by the encoded stream
+// Bump `FS_CACHE_PACK_VERSION` whenever any of this changes.
+
+const static uint32_t FS_CACHE_PACK_MAGIC = 0x4b435048; // "HPCK"
+const static uint32_t FS_CACHE_PACK_VERSION = 1;
+
+struct FsCachePackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t num_entries;
+};
+
+struct FsCachePackEntry {
+    // `hash_bytes` of the key string.
+    uint64_t key;
+    // From the start of the file.
+    uint64_t offset;
+    // Including the `FsCacheHeader`.
+    uint64_t size;
+};
+
+// A pack file that's been mapped and had its entries checked.
+struct FsCachePack {
+    std::filesystem::path filepath;
+    MappedFile file;
+    std::vector<FsCachePackEntry> entries;
+    // Which entries have been looked up since the pack was opened.
+    std::vector<uint8_t> used;
+
+    // Returns nullopt if the pack doesn't exist, is stale or is corrupt.
+    static std::optional<FsCachePack> open(const std::filesystem::path& path);
+};
+
+// The cached blobs of one source asset, packed into a single file that's
+// mapped once instead of opening a file per blob.
+//
+// `get` and `insert` can be called from any thread. Blobs are decoded
+// straight out of the mapping, and inserted blobs are kept in memory until
+// `write`, which replaces the pack with just the blobs that were looked up or
+// inserted since it was opened. That way the entries of edited primitives
+// don't pile up.
+//
+// Keys are content hashes, so the packs of the other assets are searched too
+// when this one misses. Blobs found there get copied into this pack on
+// `write`, which keeps each pack self-contained: an asset dropping its stale
+// entries never takes blobs away from another one.
 struct FsCache {
-    static std::filesystem::path filepath_for_key(std::string key) {
-        return std::filesystem::path("cache")
-            / std::to_string(std::hash<std::string> {}(key));
-    }
+    // Of this asset's pack.
+    std::filesystem::path filepath;
+
+    // This asset's pack first, if it exists, then the other assets' packs.
+    std::vector<FsCachePack> packs;
+
+    std::mutex mutex;
+    std::vector<std::pair<uint64_t, std::vector<uint8_t>>> inserted;
+
+    explicit FsCache(const std::filesystem::path& asset_filepath);
+
+    // The zstd level that inserted blobs are compressed with on top of the
+    // stream codecs, or 0 to leave them as they are. Trades load time CPU
+    // for smaller packs.
+    static int& zstd_level();
 
-    static std::optional<std::ifstream> get(std::string key) {
-        auto filepath = filepath_for_key(key);
+    // 16 and 32-bit integers are assumed to be indices.
+    template<class T>
+    static constexpr bool is_index_sequence =
+        std::is_same_v<T, uint16_t> || std::is_same_v<T, uint32_t>;
+
+    // The blob for `key` in any of the mapped packs, or null if there isn't
+    // one.
+    const uint8_t* find(const std::string& key, size_t& size);
+
+    void insert_blob(const std::string& key, std::vector<uint8_t> blob);
+
+    template<class T>
+    std::optional<std::vector<T>> get(const std::string& key) {
+        size_t size;
+        auto* blob = find(key, size);
 
-        if (std::filesystem::exists(filepath)) {
-            return std::ifstream(filepath, std::ios::binary);
-        } else {
+        if (!blob) {
             return std::nullopt;
         }
+
+        FsCacheHeader header;
+        std::memcpy(&header, blob, sizeof(FsCacheHeader));
+
+        // Checked before anything is allocated based on the header. `insert`
+        // always writes this element size.
+        if (header.element_size
+                != stream_element_size(sizeof(T), is_index_sequence<T>)
+            || (header.codec != StreamCodec::Raw
+                && header.codec != StreamCodec::Vertex
+                && !(header.codec == StreamCodec::IndexSequence
+                     && is_index_sequence<T>))) {
+            dbg(filepath, key, "has an invalid header");
+            return std::nullopt;
+        }
+
+        auto padded_size = size_t(header.count) * header.element_size;
+
+        if (header.num_bytes % sizeof(T) != 0
+            || padded_size < header.num_bytes
+            || padded_size % sizeof(T) != 0) {
+            dbg(filepath, key, "is corrupt");
+            return std::nullopt;
+        }
+
+        std::vector<T> data(padded_size / sizeof(T));
+
+        // Treated as a miss, so the entry gets rebuilt and replaced.
+        if (!decode_blob(
+                data.data(),
+                header,
+                blob + sizeof(FsCacheHeader),
+                size
+            )) {
+            dbg(filepath, key, "failed to decode");
+            return std::nullopt;
+        }
+
+        data.resize(header.num_bytes / sizeof(T));
+        return data;
     }
 
     template<class T>
-    static void insert(std::string key, const std::vector<T>& data) {
-        auto filepath = filepath_for_key(key);
-        auto stream = std::ofstream(filepath, std::ios::binary);
-        stream.write((char*)data.data(), data.size() * sizeof(T));
+    void insert(const std::string& key, const std::vector<T>& data) {
+        auto num_bytes = data.size() * sizeof(T);
+        auto padded_size = stream_padded_size(
+            num_bytes,
+            stream_element_size(sizeof(T), is_index_sequence<T>)
+        );
+
+        std::vector<uint8_t> padded(padded_size);
+        if (num_bytes > 0) {
+            std::memcpy(padded.data(), data.data(), num_bytes);
+        }
+
+        auto encoded = encode_stream(
+            padded.data(),
+            padded.size(),
+            sizeof(T),
+            is_index_sequence<T>
+        );
+
+        FsCacheHeader header = {
+            .codec = encoded.codec,
+            .element_size = encoded.element_size,
+            .count = encoded.count,
+            .flags = 0,
+            .num_bytes = num_bytes};
+
+        insert_blob(key, encode_blob(header, std::move(encoded.bytes)));
     }
+
+    // Replace the pack file if anything was inserted or came from another
+    // asset's pack. Only call this once everything that uses the pack has
+    // been loaded, as blobs that weren't looked up are dropped.
+    void write();
+
+    // `size` includes the header. Returns false if the blob is corrupt.
+    static bool decode_blob(
+        void* destination,
+        const FsCacheHeader& header,
+        const uint8_t* encoded,
+        size_t size
+    );
+
+    // Compresses `encoded` if `zstd_level` is set and puts the header in
+    // front.
+    static std::vector<uint8_t>
+    encode_blob(FsCacheHeader header, std::vector<uint8_t> encoded);
 };
@@ -1,7 +1,9 @@
 #include "image_loading.h"
 
-#include "../allocations/persistently_mapped.h"
+#include "../load_stats.h"
+
 #include "../sync.h"
+#include "../thread_pool.h"
 #include "dds.h"
 #include "ktx2.h"
 
@@ -64,39 +66,38 @@ uint32_t round_up(uint32_t value, uint32_t round_to) {
         * round_to;
 }
 
-ImageWithView load_dds(
-    const std::filesystem::path& filepath,
-    vma::Allocator allocator,
-    const vk::raii::Device& device,
-    const vk::raii::CommandBuffer& command_buffer,
-    uint32_t graphics_queue_family,
-    std::vector<AllocatedBuffer>& temp_buffers
-) {
+ImageSource parse_dds(const std::filesystem::path& filepath) {
     if (!std::filesystem::exists(filepath)) {
         dbg(filepath, "does not exist");
         abort();
     }
 
-    std::ifstream stream(filepath, std::ios::binary);
-
-    assert(stream);
+    auto file = MappedFile(filepath);
 
     std::array<char, 4> dwMagic;
     DDS_HEADER header;
     DDS_HEADER_DXT10 header10;
-    stream.read(dwMagic.data(), sizeof dwMagic);
 
-    auto expected_magic = std::array {'D', 'D', 'S', ' '};
+    auto data_offset = sizeof dwMagic + sizeof header + sizeof header10;
 
-    assert(dwMagic == expected_magic);
+    if (file.size < data_offset) {
+        dbg(filepath, file.size, "is too small");
+        abort();
+    }
 
-    stream.read(reinterpret_cast<char*>(&header), sizeof header);
+    std::memcpy(dwMagic.data(), file.data, sizeof dwMagic);
+    std::memcpy(&header, file.data + sizeof dwMagic, sizeof header);
+    std::memcpy(
+        &header10,
+        file.data + sizeof dwMagic + sizeof header,
+        sizeof header10
+    );
 
-    stream.read(reinterpret_cast<char*>(&header10), sizeof header10);
+    auto expected_magic = std::array {'D', 'D', 'S', ' '};
 
-    auto format = translate_format(header10.dxgiFormat);
+    assert(dwMagic == expected_magic);
 
-    auto data_offset = sizeof dwMagic + sizeof header + sizeof header10;
+    auto format = translate_format(header10.dxgiFormat);
 
     auto dimension = translate_dimension(header10.resourceDimension);
 
@@ -104,9 +105,7 @@ ImageWithView load_dds(
     auto height = header.dwHeight;
     auto depth = std::max(header.dwDepth, 1u);
 
-    stream.seekg(0, stream.end);
-    auto bytes_remaining = static_cast<uint32_t>(stream.tellg()) - data_offset;
-    stream.seekg(static_cast<std::ifstream::off_type>(data_offset), stream.beg);
+    auto bytes_remaining = file.size - data_offset;
 
     auto mip_levels = header.dwMipMapCount;
     bool is_cubemap = header.dwCaps2 & DDSCAPS2_CUBEMAP;
@@ -119,84 +118,14 @@ ImageWithView load_dds(
         .layerCount = is_cubemap ? 6u : 1u,
     };
 
-    auto image_name = std::string("'") + filepath.string() + "'";
-
-    auto image = ImageWithView(
-        vk::ImageCreateInfo {
-            .flags = is_cubemap ? vk::ImageCreateFlagBits::eCubeCompatible
-                                : vk::ImageCreateFlagBits(0),
-            .imageType = dimension.type,
-            .format = format.format,
-            .extent =
-                vk::Extent3D {
-                    .width = width,
-                    .height = height,
-                    .depth = depth,
-                },
-            .mipLevels = mip_levels,
-            .arrayLayers = is_cubemap ? 6u : 1u,
-            .usage = vk::ImageUsageFlagBits::eSampled
-                | vk::ImageUsageFlagBits::eTransferDst},
-        allocator,
-        device,
-        image_name.data(),
-        subresource_range,
-        is_cubemap ? vk::ImageViewType::eCube : dimension.view_type
-    );
-
-    auto staging_buffer_name = filepath.string() + " staging buffer";
-
-    auto staging_buffer = PersistentlyMappedBuffer(AllocatedBuffer(
-        vk::BufferCreateInfo {
-            .size = bytes_remaining,
-            .usage = vk::BufferUsageFlagBits::eTransferSrc},
-        {
-            .flags = vma::AllocationCreateFlagBits::eMapped
-                | vma::AllocationCreateFlagBits::eHostAccessSequentialWrite,
-            .usage = vma::MemoryUsage::eAuto,
-        },
-        allocator,
-        staging_buffer_name
-    ));
-
-    stream.read(
-        reinterpret_cast<char*>(staging_buffer.mapped_ptr),
-        static_cast<std::streamsize>(bytes_remaining)
-    );
-
-    insert_color_image_barriers(
-        command_buffer,
-        std::array {ImageBarrier {
-            .prev_access = THSVS_ACCESS_TRANSFER_WRITE,
-            .next_access = THSVS_ACCESS_TRANSFER_WRITE,
-            .discard_contents = true,
-            .queue_family = graphics_queue_family,
-            .image = image.image.image,
-            .subresource_range = subresource_range}}
-    );
-
     uint64_t buffer_offset = 0;
 
-    std::vector<vk::BufferImageCopy> regions(mip_levels);
+    std::vector<LevelSource> levels(mip_levels);
 
     for (uint32_t i = 0; i < mip_levels; i++) {
         auto level_width = std::max(width >> i, 1u);
         auto level_height = std::max(height >> i, 1u);
 
-        regions[i] = vk::BufferImageCopy {
-            .bufferOffset = buffer_offset,
-            .imageSubresource =
-                {
-                    .aspectMask = vk::ImageAspectFlagBits::eColor,
-                    .mipLevel = static_cast<uint32_t>(i),
-                    .baseArrayLayer = 0,
-                    .layerCount = is_cubemap ? 6u : 1u,
-                },
-            .imageExtent = vk::Extent3D {
-                .width = level_width,
-                .height = level_height,
-                .depth = depth}};
-
         // We need to round up the width and heights here because for block
         // compressed textures, the minimum amount of data a miplevel can use
         // is the equivalent of 4x4 pixels, even when the actual mip size is smaller.
@@ -206,9 +135,20 @@ ImageWithView load_dds(
             ? round_up(level_height, 4)
             : level_height;
 
-        buffer_offset +=
+        auto level_size =
             (rounded_width * rounded_height * depth * (is_cubemap ? 6 : 1))
             * format.bits_per_pixel / 8;
+
+        levels[i] = LevelSource {
+            .offset = data_offset + buffer_offset,
+            .size = level_size,
+            .uncompressed_size = level_size,
+            .is_zstd_compressed = false,
+            .extent = vk::Extent3D {
+                .width = level_width,
+                .height = level_height,
+                .depth = depth}};
+        buffer_offset += level_size;
     }
 
     if (buffer_offset != bytes_remaining) {
@@ -216,196 +156,515 @@ ImageWithView load_dds(
         assert(buffer_offset == bytes_remaining);
     }
 
-    command_buffer.copyBufferToImage(
-        staging_buffer.buffer.buffer,
-        image.image.image,
-        vk::ImageLayout::eTransferDstOptimal,
-        regions
-    );
+    return ImageSource {
+        .file = std::move(file),
+        .name = std::string("'") + filepath.string() + "'",
+        .create_info =
+            vk::ImageCreateInfo {
+                .flags = is_cubemap ? vk::ImageCreateFlagBits::eCubeCompatible
+                                    : vk::ImageCreateFlagBits(0),
+                .imageType = dimension.type,
+                .format = format.format,
+                .extent =
+                    vk::Extent3D {
+                        .width = width,
+                        .height = height,
+                        .depth = depth,
+                    },
+                .mipLevels = mip_levels,
+                .arrayLayers = is_cubemap ? 6u : 1u,
+                .usage = vk::ImageUsageFlagBits::eSampled
+                    | vk::ImageUsageFlagBits::eTransferDst},
+        .subresource_range = subresource_range,
+        .view_type =
+            is_cubemap ? vk::ImageViewType::eCube : dimension.view_type,
+        .levels = std::move(levels)};
+}
 
-    insert_color_image_barriers(
-        command_buffer,
-        std::array {ImageBarrier {
-            .prev_access = THSVS_ACCESS_TRANSFER_WRITE,
-            .next_access =
-                THSVS_ACCESS_FRAGMENT_SHADER_READ_SAMPLED_IMAGE_OR_UNIFORM_TEXEL_BUFFER,
-            .queue_family = graphics_queue_family,
-            .image = image.image.image,
-            .subresource_range = subresource_range}}
-    );
+ImageSource parse_ktx2(const std::filesystem::path& filepath) {
+    auto file = MappedFile(filepath);
 
-    temp_buffers.push_back(std::move(staging_buffer.buffer));
+    std::array<uint8_t, 12> identifier;
+    Ktx2Header header;
+    Ktx2Index index;
 
-    return image;
-}
+    auto level_index_offset =
+        sizeof identifier + sizeof header + sizeof index;
 
-ImageWithView load_ktx2_image(
-    const std::filesystem::path& filepath,
-    vma::Allocator allocator,
-    const vk::raii::Device& device,
-    const vk::raii::CommandBuffer& command_buffer,
-    uint32_t graphics_queue_family,
-    std::vector<AllocatedBuffer>& temp_buffers
-) {
-    std::ifstream stream(filepath, std::ios::binary);
+    if (file.size < level_index_offset) {
+        dbg(filepath, file.size, "is too small");
+        abort();
+    }
 
-    std::array<uint8_t, 12> identifier;
-    stream.read((char*)identifier.data(), identifier.size());
+    std::memcpy(identifier.data(), file.data, identifier.size());
 
     if (identifier != KTX2_IDENTIFIER) {
         dbg(filepath);
         abort();
     }
 
-    Ktx2Header header;
+    std::memcpy(&header, file.data + sizeof identifier, sizeof header);
+    std::memcpy(
+        &index,
+        file.data + sizeof identifier + sizeof header,
+        sizeof index
+    );
+
+    if (header.supercompression_scheme != Ktx2SupercompressionScheme::None
+        && header.supercompression_scheme
+            != Ktx2SupercompressionScheme::Zstandard) {
+        dbg(filepath, header.supercompression_scheme);
+        abort();
+    }
 
-    stream.read((char*)&header, sizeof header);
+    auto num_levels = std::max(1u, header.level_count);
 
-    Ktx2Index index;
+    if (file.size
+        < level_index_offset + num_levels * sizeof(Ktx2LevelIndex)) {
+        dbg(filepath, file.size, num_levels, "is truncated");
+        abort();
+    }
 
-    stream.read((char*)&index, sizeof index);
+    std::vector<LevelSource> levels(num_levels);
 
-    std::vector<Ktx2LevelIndex> levels(std::max(1u, header.level_count));
+    for (uint32_t i = 0; i < num_levels; i++) {
+        Ktx2LevelIndex level;
+        std::memcpy(
+            &level,
+            file.data + level_index_offset + i * sizeof level,
+            sizeof level
+        );
 
-    vk::DeviceSize total_size = 0;
+        if (level.byte_offset > file.size
+            || level.byte_length > file.size - level.byte_offset) {
+            dbg(filepath, i, "is out of bounds");
+            abort();
+        }
 
-    for (size_t i = 0; i < std::max(1u, header.level_count); i++) {
-        stream.read((char*)&levels[i], sizeof levels[i]);
-        total_size += levels[i].uncompressed_byte_length;
+        levels[i] = LevelSource {
+            .offset = level.byte_offset,
+            .size = level.byte_length,
+            .uncompressed_size = level.uncompressed_byte_length,
+            .is_zstd_compressed = header.supercompression_scheme
+                == Ktx2SupercompressionScheme::Zstandard,
+            .extent = vk::Extent3D {
+                .width = std::max(header.width >> i, 1u),
+                .height = std::max(header.height >> i, 1u),
+                .depth = std::max(header.depth, 1u)}};
     }
 
-    auto subresource_range = vk::ImageSubresourceRange {
-        .aspectMask = vk::ImageAspectFlagBits::eColor,
-        .baseMipLevel = 0,
-        .levelCount = header.level_count,
-        .baseArrayLayer = 0,
-        .layerCount = header.face_count,
-    };
-
     bool is_cubemap = header.face_count == 6;
 
-    auto image = ImageWithView(
-        vk::ImageCreateInfo {
-            .flags = is_cubemap ? vk::ImageCreateFlagBits::eCubeCompatible
-                                : vk::ImageCreateFlagBits(0),
-            .imageType = vk::ImageType::e2D,
-            .format = header.format,
-            .extent =
-                vk::Extent3D {
-                    .width = header.width,
-                    .height = header.height,
-                    .depth = std::max(header.depth, 1u),
-                },
-            .mipLevels = header.level_count,
-            .arrayLayers = header.face_count,
-            .usage = vk::ImageUsageFlagBits::eSampled
-                | vk::ImageUsageFlagBits::eTransferDst},
-        allocator,
-        device,
-        filepath.string(),
-        subresource_range,
-        is_cubemap ? vk::ImageViewType::eCube : vk::ImageViewType::e2D
-    );
+    return ImageSource {
+        .file = std::move(file),
+        .name = filepath.string(),
+        .create_info =
+            vk::ImageCreateInfo {
+                .flags = is_cubemap ? vk::ImageCreateFlagBits::eCubeCompatible
+                                    : vk::ImageCreateFlagBits(0),
+                .imageType = vk::ImageType::e2D,
+                .format = header.format,
+                .extent =
+                    vk::Extent3D {
+                        .width = header.width,
+                        .height = header.height,
+                        .depth = std::max(header.depth, 1u),
+                    },
+                .mipLevels = header.level_count,
+                .arrayLayers = header.face_count,
+                .usage = vk::ImageUsageFlagBits::eSampled
+                    | vk::ImageUsageFlagBits::eTransferDst},
+        .subresource_range =
+            vk::ImageSubresourceRange {
+                .aspectMask = vk::ImageAspectFlagBits::eColor,
+                .baseMipLevel = 0,
+                .levelCount = header.level_count,
+                .baseArrayLayer = 0,
+                .layerCount = header.face_count,
+            },
+        .view_type =
+            is_cubemap ? vk::ImageViewType::eCube : vk::ImageViewType::e2D,
+        .levels = std::move(levels)};
+}
 
-    auto staging_buffer = PersistentlyMappedBuffer(AllocatedBuffer(
-        vk::BufferCreateInfo {
-            .size = total_size,
-            .usage = vk::BufferUsageFlagBits::eTransferSrc},
-        {
-            .flags = vma::AllocationCreateFlagBits::eMapped
-                | vma::AllocationCreateFlagBits::eHostAccessSequentialWrite,
-            .usage = vma::MemoryUsage::eAuto,
-        },
-        allocator,
-        filepath.string() + " staging buffer"
-    ));
+ImageSource parse_image(const std::filesystem::path& filepath) {
+    if (filepath.extension() == ".ktx2") {
+        return parse_ktx2(filepath);
+    } else if (filepath.extension() == ".dds") {
+        return parse_dds(filepath);
+    }
 
-    vk::DeviceSize offset = 0;
-    std::vector<vk::BufferImageCopy> regions(levels.size());
+    dbg(filepath);
+    abort();
+}
 
-    for (uint32_t i = 0; i < levels.size(); i++) {
-        auto level_width = std::max(header.width >> i, 1u);
-        auto level_height = std::max(header.height >> i, 1u);
+void write_level(
+    const LevelSource& level,
+    const MappedFile& file,
+    void* destination
+) {
+    if (!level.is_zstd_compressed) {
+        ZoneScopedN("file io");
+        auto timer = PhaseTimer(LoadStats::global().file_io, level.size);
+        std::memcpy(destination, file.data + level.offset, level.size);
+        return;
+    }
 
-        auto level = levels[i];
+    // Creating a context is much slower than decompressing a small level, so
+    // each thread keeps one around instead of using `ZSTD_decompress`.
+    thread_local auto context =
+        std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)>(
+            ZSTD_createDCtx(),
+            ZSTD_freeDCtx
+        );
+
+    ZoneScopedN("texture decode");
+    auto timer = PhaseTimer(
+        LoadStats::global().texture_decode,
+        level.uncompressed_size
+    );
+    auto bytes_decompressed = ZSTD_decompressDCtx(
+        context.get(),
+        destination,
+        level.uncompressed_size,
+        file.data + level.offset,
+        level.size
+    );
 
-        stream.seekg(level.byte_offset, stream.beg);
+    if (bytes_decompressed != level.uncompressed_size) {
+        dbg(bytes_decompressed, level.uncompressed_size);
+        abort();
+    }
+}
 
-        if (header.supercompression_scheme
-            == Ktx2SupercompressionScheme::Zstandard) {
-            std::vector<uint8_t> compressed_bytes(level.byte_length);
-            stream.read(
-                reinterpret_cast<char*>(compressed_bytes.data()),
-                level.byte_length
-            );
-            auto bytes_decompressed = ZSTD_decompress(
-                reinterpret_cast<char*>(staging_buffer.mapped_ptr) + offset,
-                level.uncompressed_byte_length,
-                compressed_bytes.data(),
-                level.byte_length
+// Stage a level that's bigger than a staging chunk in bands of block rows
+// that each fit into one, with a copy per band, so that it never needs a
+// staging buffer of its own. The bands are read or decompressed in order on
+// the calling thread. `before_flush` is called before the current chunk has
+// to be submitted to make room.
+void stage_level_in_bands(
+    const LevelSource& level,
+    const MappedFile& file,
+    vk::Format format,
+    uint32_t layer_count,
+    uint32_t mip_level,
+    vk::Image image,
+    StagingRing& staging,
+    const std::function<void()>& before_flush
+) {
+    ZoneScoped;
+
+    // Only 2D images get big enough to need this.
+    assert(level.extent.depth == 1);
+
+    auto block_height = uint32_t(vk::blockExtent(format)[1]);
+    auto block_rows =
+        (level.extent.height + block_height - 1) / block_height;
+    auto layer_size = level.uncompressed_size / layer_count;
+    auto block_row_size = layer_size / block_rows;
+    auto rows_per_band =
+        static_cast<uint32_t>(staging.chunk_size / block_row_size);
+    assert(rows_per_band > 0);
+
+    auto context = std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)>(
+        level.is_zstd_compressed ? ZSTD_createDCtx() : nullptr,
+        ZSTD_freeDCtx
+    );
+    auto input = ZSTD_inBuffer {
+        .src = file.data + level.offset,
+        .size = level.size,
+        .pos = 0};
+    uint64_t read_offset = 0;
+
+    for (uint32_t layer = 0; layer < layer_count; layer++) {
+        for (uint32_t row = 0; row < block_rows; row += rows_per_band) {
+            auto band_rows = std::min(rows_per_band, block_rows - row);
+            auto band_size = band_rows * block_row_size;
+
+            auto allocation = staging.try_allocate(band_size);
+
+            if (!allocation) {
+                before_flush();
+                staging.flush();
+                allocation = staging.try_allocate(band_size);
+            }
+
+            if (!level.is_zstd_compressed) {
+                ZoneScopedN("file io");
+                auto timer = PhaseTimer(LoadStats::global().file_io, band_size);
+                std::memcpy(
+                    allocation->mapped_ptr,
+                    file.data + level.offset + read_offset,
+                    band_size
+                );
+                read_offset += band_size;
+            } else {
+                ZoneScopedN("texture decode");
+                auto timer =
+                    PhaseTimer(LoadStats::global().texture_decode, band_size);
+                auto output = ZSTD_outBuffer {
+                    .dst = allocation->mapped_ptr,
+                    .size = band_size,
+                    .pos = 0};
+
+                while (output.pos < output.size) {
+                    auto result =
+                        ZSTD_decompressStream(context.get(), &output, &input);
+
+                    // With the output not full, everything that could be
+                    // decompressed from the input has been.
+                    if (ZSTD_isError(result)
+                        || (output.pos < output.size
+                            && input.pos == input.size)) {
+                        dbg(result, output.pos, band_size);
+                        abort();
+                    }
+                }
+            }
+
+            auto y = row * block_height;
+
+            staging.command_buffer().copyBufferToImage(
+                allocation->buffer,
+                image,
+                vk::ImageLayout::eTransferDstOptimal,
+                {vk::BufferImageCopy {
+                    .bufferOffset = allocation->offset,
+                    .imageSubresource =
+                        {
+                            .aspectMask = vk::ImageAspectFlagBits::eColor,
+                            .mipLevel = mip_level,
+                            .baseArrayLayer = layer,
+                            .layerCount = 1,
+                        },
+                    .imageOffset = vk::Offset3D {.y = int32_t(y)},
+                    .imageExtent = vk::Extent3D {
+                        .width = level.extent.width,
+                        .height = std::min(
+                            band_rows * block_height,
+                            level.extent.height - y
+                        ),
+                        .depth = 1}}}
             );
-            assert(bytes_decompressed == level.uncompressed_byte_length);
-        } else {
-            assert(
-                header.supercompression_scheme
-                == Ktx2SupercompressionScheme::None
+        }
+    }
+}
+
+// Image creation and command recording happen in order on the calling
+// thread, while the level data is read and decompressed in parallel straight
+// into the staging ring. Levels are staged one at a time, and levels bigger
+// than a chunk in bands, so that large images don't need a staging buffer of
+// their own. Whenever the current chunk fills up, everything staged into it
+// is written out before it's submitted.
+std::vector<ImageWithView> upload_images(
+    const std::vector<ImageUpload>& uploads,
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    uint32_t graphics_queue_family,
+    StagingRing& staging
+) {
+    ZoneScoped;
+
+    struct PendingLevel {
+        const LevelSource& level;
+        const MappedFile& file;
+        void* destination;
+    };
+
+    std::vector<PendingLevel> pending;
+
+    auto write_pending = [&] {
+        parallel_for(pending.size(), [&](size_t i) {
+            write_level(
+                pending[i].level,
+                pending[i].file,
+                pending[i].destination
             );
+        });
+        pending.clear();
+    };
 
-            stream.read(
-                reinterpret_cast<char*>(staging_buffer.mapped_ptr) + offset,
-                level.uncompressed_byte_length
+    std::vector<ImageWithView> images;
+    images.reserve(uploads.size());
+
+    for (auto& upload : uploads) {
+        auto& source = upload.source;
+        auto num_levels =
+            static_cast<uint32_t>(source.levels.size()) - upload.first_level;
+
+        auto create_info = source.create_info;
+        create_info.extent = source.levels[upload.first_level].extent;
+        create_info.mipLevels = num_levels;
+
+        auto subresource_range = source.subresource_range;
+        subresource_range.levelCount = num_levels;
+
+        auto image = ImageWithView(
+            create_info,
+            allocator,
+            device,
+            source.name,
+            subresource_range,
+            source.view_type
+        );
+
+        insert_color_image_barriers(
+            staging.command_buffer(),
+            std::array {ImageBarrier {
+                .prev_access = THSVS_ACCESS_TRANSFER_WRITE,
+                .next_access = THSVS_ACCESS_TRANSFER_WRITE,
+                .discard_contents = true,
+                .queue_family = graphics_queue_family,
+                .image = image.image.image,
+                .subresource_range = subresource_range}}
+        );
+
+        for (uint32_t i = 0; i < num_levels; i++) {
+            auto& level = source.levels[upload.first_level + i];
+
+            if (level.uncompressed_size > staging.chunk_size) {
+                stage_level_in_bands(
+                    level,
+                    source.file,
+                    create_info.format,
+                    subresource_range.layerCount,
+                    i,
+                    image.image.image,
+                    staging,
+                    write_pending
+                );
+                continue;
+            }
+
+            auto allocation = staging.try_allocate(level.uncompressed_size);
+
+            if (!allocation) {
+                write_pending();
+                staging.flush();
+                allocation = staging.try_allocate(level.uncompressed_size);
+            }
+
+            pending.push_back(PendingLevel {
+                .level = level,
+                .file = source.file,
+                .destination = allocation->mapped_ptr});
+
+            // The data doesn't need to be there until the chunk is
+            // submitted.
+            staging.command_buffer().copyBufferToImage(
+                allocation->buffer,
+                image.image.image,
+                vk::ImageLayout::eTransferDstOptimal,
+                {vk::BufferImageCopy {
+                    .bufferOffset = allocation->offset,
+                    .imageSubresource =
+                        {
+                            .aspectMask = vk::ImageAspectFlagBits::eColor,
+                            .mipLevel = i,
+                            .baseArrayLayer = 0,
+                            .layerCount = subresource_range.layerCount,
+                        },
+                    .imageExtent = level.extent}}
             );
         }
-        regions[i] = vk::BufferImageCopy {
-            .bufferOffset = offset,
-            .imageSubresource =
-                {
-                    .aspectMask = vk::ImageAspectFlagBits::eColor,
-                    .mipLevel = i,
-                    .baseArrayLayer = 0,
-                    .layerCount = header.face_count,
-                },
-            .imageExtent = vk::Extent3D {
-                .width = level_width,
-                .height = level_height,
-                .depth = std::max(header.depth, 1u)}};
-        offset += level.uncompressed_byte_length;
-    }
-    if (offset != total_size) {
-        dbg(offset, total_size);
-        abort();
+
+        insert_color_image_barriers(
+            staging.command_buffer(),
+            std::array {ImageBarrier {
+                .prev_access = THSVS_ACCESS_TRANSFER_WRITE,
+                .next_access =
+                    THSVS_ACCESS_FRAGMENT_SHADER_READ_SAMPLED_IMAGE_OR_UNIFORM_TEXEL_BUFFER,
+                .queue_family = graphics_queue_family,
+                .image = image.image.image,
+                .subresource_range = subresource_range}}
+        );
+
+        images.push_back(std::move(image));
     }
 
-    insert_color_image_barriers(
-        command_buffer,
-        std::array {ImageBarrier {
-            .prev_access = THSVS_ACCESS_TRANSFER_WRITE,
-            .next_access = THSVS_ACCESS_TRANSFER_WRITE,
-            .discard_contents = true,
-            .queue_family = graphics_queue_family,
-            .image = image.image.image,
-            .subresource_range = subresource_range}}
-    );
+    write_pending();
 
-    command_buffer.copyBufferToImage(
-        staging_buffer.buffer.buffer,
-        image.image.image,
-        vk::ImageLayout::eTransferDstOptimal,
-        regions
-    );
+    return images;
+}
 
-    insert_color_image_barriers(
-        command_buffer,
-        std::array {ImageBarrier {
-            .prev_access = THSVS_ACCESS_TRANSFER_WRITE,
-            .next_access =
-                THSVS_ACCESS_FRAGMENT_SHADER_READ_SAMPLED_IMAGE_OR_UNIFORM_TEXEL_BUFFER,
-            .queue_family = graphics_queue_family,
-            .image = image.image.image,
-            .subresource_range = subresource_range}}
-    );
+ImageWithView load_dds(
+    const std::filesystem::path& filepath,
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    uint32_t graphics_queue_family,
+    StagingRing& staging
+) {
+    auto source = parse_dds(filepath);
+
+    return std::move(upload_images(
+        {ImageUpload {.source = source}},
+        allocator,
+        device,
+        graphics_queue_family,
+        staging
+    )[0]);
+}
+
+ImageWithView load_ktx2_image(
+    const std::filesystem::path& filepath,
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    uint32_t graphics_queue_family,
+    StagingRing& staging
+) {
+    auto source = parse_ktx2(filepath);
+
+    return std::move(upload_images(
+        {ImageUpload {.source = source}},
+        allocator,
+        device,
+        graphics_queue_family,
+        staging
+    )[0]);
+}
+
+ImageWithView load_image(
+    const std::filesystem::path& filepath,
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    uint32_t graphics_queue_family,
+    StagingRing& staging
+) {
+    return std::move(load_images(
+        {filepath},
+        allocator,
+        device,
+        graphics_queue_family,
+        staging
+    )[0]);
+}
 
-    temp_buffers.push_back(std::move(staging_buffer.buffer));
+std::vector<ImageWithView> load_images(
+    const std::vector<std::filesystem::path>& filepaths,
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    uint32_t graphics_queue_family,
+    StagingRing& staging
+) {
+    std::vector<ImageSource> sources;
+    sources.reserve(filepaths.size());
+
+    for (auto& filepath : filepaths) {
+        sources.push_back(parse_image(filepath));
+    }
 
-    return image;
+    std::vector<ImageUpload> uploads;
+    uploads.reserve(sources.size());
+
+    for (auto& source : sources) {
+        uploads.push_back(ImageUpload {.source = source});
+    }
+
+    return upload_images(
+        uploads,
+        allocator,
+        device,
+        graphics_queue_family,
+        staging
+    );
 }
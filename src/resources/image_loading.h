@@ -1,20 +1,90 @@
+#pragma once
 #include "../allocations/base.h"
 #include "../allocations/image_with_view.h"
+#include "../allocations/staging.h"
+#include "mapped_file.h"
+
+// Where one mip level's data is in the source file.
+struct LevelSource {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t uncompressed_size;
+    bool is_zstd_compressed;
+    vk::Extent3D extent;
+};
+
+// An image file that's been mapped and had its header parsed, but none of its
+// data read yet.
+struct ImageSource {
+    MappedFile file;
+    std::string name;
+    vk::ImageCreateInfo create_info;
+    vk::ImageSubresourceRange subresource_range;
+    vk::ImageViewType view_type;
+    std::vector<LevelSource> levels;
+};
+
+// Map a `.ktx2` or `.dds` image and parse its header, based on the file
+// extension.
+ImageSource parse_image(const std::filesystem::path& filepath);
+
+// Copy or decompress a level of `file` into `destination`, which needs to
+// have `level.uncompressed_size` bytes. Safe to call from any thread, and
+// reading from the mapping is what actually pulls the level in from disk.
+void write_level(
+    const LevelSource& level,
+    const MappedFile& file,
+    void* destination
+);
+
+// An image to upload the levels of, from `first_level` down to the smallest.
+// Level `first_level` becomes the image's level 0.
+struct ImageUpload {
+    const ImageSource& source;
+    uint32_t first_level = 0;
+};
+
+// Upload a batch of images, in order. Their data is read and decompressed on
+// the thread pool.
+std::vector<ImageWithView> upload_images(
+    const std::vector<ImageUpload>& uploads,
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    uint32_t graphics_queue_family,
+    StagingRing& staging
+);
 
 ImageWithView load_dds(
     const std::filesystem::path& filepath,
     vma::Allocator allocator,
     const vk::raii::Device& device,
-    const vk::raii::CommandBuffer& command_buffer,
     uint32_t graphics_queue_family,
-    std::vector<AllocatedBuffer>& temp_buffers
+    StagingRing& staging
 );
 
 ImageWithView load_ktx2_image(
     const std::filesystem::path& filepath,
     vma::Allocator allocator,
     const vk::raii::Device& device,
-    const vk::raii::CommandBuffer& command_buffer,
     uint32_t graphics_queue_family,
-    std::vector<AllocatedBuffer>& temp_buffers
+    StagingRing& staging
+);
+
+// Load a `.ktx2` or `.dds` image, based on the file extension.
+ImageWithView load_image(
+    const std::filesystem::path& filepath,
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    uint32_t graphics_queue_family,
+    StagingRing& staging
+);
+
+// Load a batch of images, in the same order as `filepaths`. Their data is
+// read and decompressed on the thread pool.
+std::vector<ImageWithView> load_images(
+    const std::vector<std::filesystem::path>& filepaths,
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    uint32_t graphics_queue_family,
+    StagingRing& staging
 );
@@ -0,0 +1,62 @@
+#include "mapped_file.h"
+
+#include "../load_stats.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::filesystem::path& filepath) {
+    // Only the mapping itself is timed, pages are read in wherever they're
+    // first touched.
+    ZoneScopedN("file io");
+    auto timer = PhaseTimer(LoadStats::global().file_io);
+
+    int fd = open(filepath.c_str(), O_RDONLY);
+
+    if (fd == -1) {
+        dbg(filepath, "could not be opened");
+        abort();
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+        dbg(filepath, "could not be stat'd");
+        abort();
+    }
+
+    size = static_cast<size_t>(file_stat.st_size);
+    timer.bytes = size;
+
+    if (size > 0) {
+        void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (ptr == MAP_FAILED) {
+            dbg(filepath, "could not be mapped");
+            abort();
+        }
+
+        data = static_cast<const uint8_t*>(ptr);
+    }
+
+    // The mapping keeps its own reference to the file.
+    close(fd);
+}
+
+MappedFile::MappedFile(MappedFile&& other) {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    if (data) {
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// A read-only memory mapping of an entire file. Pages are only read
+// from disk when they're touched, so nothing needs to be copied into
+// an intermediate `std::vector` first.
+struct MappedFile {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    MappedFile(const std::filesystem::path& filepath);
+
+    MappedFile(MappedFile&& other);
+
+    MappedFile& operator=(MappedFile&& other);
+
+    ~MappedFile();
+};
@@ -1,258 +1,639 @@
 #include "mesh_loading.h"
 
 #include "../allocations/staging.h"
-#include "bounding_sphere.h"
 #include "fs_cache.h"
 #include "image_loading.h"
+#include "position_kernels.h"
+#include "vertex_repacking.h"
 
-struct NodeTreeNode {
-    glm::mat4 transform = glm::mat4(1);
-    size_t parent = std::numeric_limits<size_t>::max();
-};
-
-struct NodeTree {
-    std::vector<NodeTreeNode> inner;
-
-    NodeTree(const fastgltf::Asset& asset) : inner(asset.nodes.size()) {
-        for (size_t i = 0; i < asset.nodes.size(); i++) {
-            auto& gltf_node = asset.nodes[i];
-
-            if (auto* trs =
-                    std::get_if<fastgltf::Node::TRS>(&gltf_node.transform)) {
-                // todo: these are probably not correct.
-                inner[i].transform = glm::translate(
-                    glm::scale(
-                        glm::mat4(1.0),
-                        glm::vec3(trs->scale[0], trs->scale[1], trs->scale[2])
-                    ),
-                    glm::vec3(
-                        trs->translation[0],
-                        trs->translation[1],
-                        trs->translation[2]
-                    )
-                );
-            }
-        }
-    }
-
-    glm::mat4 transform_of(size_t index) {
-        glm::mat4 transform_sum = glm::mat4(1.0);
-
-        while (index != std::numeric_limits<size_t>::max()) {
-            auto node = inner[index];
-            transform_sum = node.transform * transform_sum;
-            index = node.parent;
-        }
-
-        return transform_sum;
-    }
-};
+#include "../load_stats.h"
+#include "../thread_pool.h"
 
-void copy_buffer_to_final(
-    const fastgltf::Accessor& accessor,
+// Get a pointer to the start of an accessor's data inside the mapped buffers.
+const uint8_t* accessor_data(
     const fastgltf::Asset& asset,
-    const std::vector<PersistentlyMappedBuffer>& staging_buffers,
-    const AllocatedBuffer& final_buffer,
-    const vk::raii::CommandBuffer& command_buffer,
-    const uint32_t buffer_size
+    const fastgltf::Accessor& accessor,
+    const std::vector<MappedFile>& source_buffers
 ) {
     auto& buffer_view = asset.bufferViews[accessor.bufferViewIndex.value()];
-    command_buffer.copyBuffer(
-        staging_buffers[buffer_view.bufferIndex].buffer.buffer,
-        final_buffer.buffer,
-        {vk::BufferCopy {
-            .srcOffset = buffer_view.byteOffset + accessor.byteOffset,
-            .dstOffset = 0,
-            .size = buffer_size}}
-    );
+    return source_buffers[buffer_view.bufferIndex].data
+        + buffer_view.byteOffset + accessor.byteOffset;
 }
 
-void copy_uint16_t4_to_uint16_3(
-    const vk::raii::Device& device,
-    const vk::raii::CommandBuffer& command_buffer,
-    const AllocatedBuffer& copy_dst,
-    const AllocatedBuffer& copy_src,
-    const Pipelines& pipelines,
-    uint32_t count,
-    uint32_t src_offset
+struct MeshletBuffers {
+    GeometryAllocation meshlets;
+    GeometryAllocation meshlet_lods;
+    GeometryAllocation meshlet_groups;
+    GeometryAllocation indices;
+    GeometryAllocation micro_indices;
+    uint32_t num_meshlets;
+};
+
+GeometryAllocation upload_geometry(
+    const void* bytes,
+    size_t num_bytes,
+    GeometryArena& geometry_arena,
+    StagingRing& staging
 ) {
-    command_buffer.bindPipeline(
-        vk::PipelineBindPoint::eCompute,
-        *pipelines.copy_quantized_positions
+    auto allocation = geometry_arena.allocate(num_bytes);
+    copy_via_staging_buffer(
+        bytes,
+        num_bytes,
+        allocation.buffer,
+        allocation.offset,
+        staging
     );
-    command_buffer.pushConstants<CopyQuantizedPositionsConstant>(
-        *pipelines.copy_pipeline_layout,
-        vk::ShaderStageFlagBits::eCompute,
-        0,
-        {{.dst = device.getBufferAddress({.buffer = copy_dst.buffer}),
-          .src =
-              device.getBufferAddress({.buffer = copy_src.buffer}) + src_offset,
-
-          .count = count}}
-    );
-    command_buffer.dispatch(dispatch_size(count, 64), 1, 1);
+    return allocation;
 }
 
-void copy_uint8_t4_to_uint8_3(
-    const vk::raii::Device& device,
-    const vk::raii::CommandBuffer& command_buffer,
-    const AllocatedBuffer& copy_dst,
-    const AllocatedBuffer& copy_src,
-    const Pipelines& pipelines,
-    uint32_t count,
-    uint32_t src_offset
+const fastgltf::Accessor& get_accessor(
+    const fastgltf::Asset& asset,
+    const fastgltf::Primitive& primitive,
+    const char* name,
+    const std::string& primitive_name
 ) {
-    command_buffer.bindPipeline(
-        vk::PipelineBindPoint::eCompute,
-        *pipelines.copy_quantized_normals
-    );
-    command_buffer.pushConstants<CopyQuantizedPositionsConstant>(
-        *pipelines.copy_pipeline_layout,
-        vk::ShaderStageFlagBits::eCompute,
-        0,
-        {{.dst = device.getBufferAddress({.buffer = copy_dst.buffer}),
-          .src =
-              device.getBufferAddress({.buffer = copy_src.buffer}) + src_offset,
-
-          .count = count}}
-    );
-    command_buffer.dispatch(dispatch_size(count, 64), 1, 1);
+    auto iterator = primitive.findAttribute(name);
+    if (iterator == primitive.attributes.end()) {
+        dbg(primitive_name, name);
+        abort();
+    }
+    return asset.accessors[iterator->second];
 }
 
-struct MeshletBuffers {
-    AllocatedBuffer meshlets;
-    AllocatedBuffer indices;
-    AllocatedBuffer micro_indices;
-    uint32_t num_meshlets;
-};
-
-MeshletBuffers upload_meshlet_buffers_from_cache(
-    std::ifstream meshlets,
-    std::ifstream indices,
-    std::ifstream micro_indices,
-    vma::Allocator allocator,
-    const std::string& primitive_name,
-    const vk::raii::CommandBuffer& command_buffer,
-    std::vector<AllocatedBuffer>& temp_buffers
+// Runs on a worker thread, so this must only read from `asset`
+// and `source_buffers`, and only touch `cache` through `get` and `insert`.
+PrimitiveCpuData process_primitive(
+    const fastgltf::Asset& asset,
+    const PrimitiveJob& job,
+    const std::vector<MappedFile>& source_buffers,
+    FsCache& cache
 ) {
-    auto [indices_buffer, _] = upload_from_file_via_staging_buffer(
-        std::move(indices),
-        allocator,
-        vk::BufferUsageFlagBits::eStorageBuffer
-            | vk::BufferUsageFlagBits::eShaderDeviceAddress,
-        primitive_name + " indices buffer",
-        command_buffer,
-        temp_buffers
-    );
+    ZoneScoped;
 
-    auto [micro_indices_buffer, __] = upload_from_file_via_staging_buffer(
-        std::move(micro_indices),
-        allocator,
-        vk::BufferUsageFlagBits::eStorageBuffer
-            | vk::BufferUsageFlagBits::eShaderDeviceAddress,
-        primitive_name + " micro indices buffer",
-        command_buffer,
-        temp_buffers
+    auto& primitive = job.primitive;
+    auto& primitive_name = job.name;
+
+    auto& positions =
+        get_accessor(asset, primitive, "POSITION", primitive_name);
+    assert(positions.componentType == fastgltf::ComponentType::UnsignedShort);
+    assert(positions.type == fastgltf::AccessorType::Vec3);
+
+    auto& indices = asset.accessors[primitive.indicesAccessor.value()];
+
+    bool uses_32_bit_indices =
+        indices.componentType == fastgltf::ComponentType::UnsignedInt;
+    if (!uses_32_bit_indices) {
+        assert(indices.componentType == fastgltf::ComponentType::UnsignedShort);
+    }
+    assert(indices.type == fastgltf::AccessorType::Scalar);
+
+    // Read straight out of the mapped pages.
+    const uint16_t* uint_positions = reinterpret_cast<const uint16_t*>(
+        accessor_data(asset, positions, source_buffers)
     );
 
-    auto [meshlets_buffer, num_meshlet_bytes] =
-        upload_from_file_via_staging_buffer(
-            std::move(meshlets),
+    auto& config = MeshletConfig::global();
+
+    // Key the cache on everything that goes into building the meshlets
+    // instead of where the primitive is, so that edited assets get rebuilt
+    // and identical primitives share entries.
+    uint64_t content_hash;
+    {
+        ZoneScopedN("hash primitive");
+
+        auto config_key = config.cache_key();
+        content_hash = hash_value(MESHLET_CACHE_VERSION, 0);
+        content_hash =
+            hash_value(uint32_t(MESHOPTIMIZER_VERSION), content_hash);
+        content_hash =
+            hash_bytes(config_key.data(), config_key.size(), content_hash);
+        content_hash = hash_value(uses_32_bit_indices, content_hash);
+        content_hash = hash_bytes(
+            accessor_data(asset, indices, source_buffers),
+            indices.count * (uses_32_bit_indices ? 4 : 2),
+            content_hash
+        );
+        content_hash = hash_bytes(
+            uint_positions,
+            positions.count * sizeof(uint16_t) * 4,
+            content_hash
+        );
+    }
+
+    auto key_prefix = hash_to_string(content_hash);
+    auto meshlets_key = key_prefix + " meshlets";
+    auto indices_key = key_prefix + " indices";
+    auto micro_indices_key = key_prefix + " micro indices";
+    auto vertex_remap_key = key_prefix + " vertex remap";
+    auto meshlet_lods_key = key_prefix + " meshlet lods";
+    auto meshlet_groups_key = key_prefix + " meshlet groups";
+    auto meshlet_parts_key = key_prefix + " meshlet parts";
+
+    auto lookup_start = std::chrono::steady_clock::now();
+
+    auto opt_meshlets = cache.get<Meshlet>(meshlets_key);
+    auto opt_micro_indices = cache.get<uint8_t>(micro_indices_key);
+    auto opt_indices_32bit = uses_32_bit_indices
+        ? cache.get<uint32_t>(indices_key)
+        : std::nullopt;
+    auto opt_indices_16bit = !uses_32_bit_indices
+        ? cache.get<uint16_t>(indices_key)
+        : std::nullopt;
+    auto opt_vertex_remap = config.optimize_vertex_order
+        ? cache.get<uint32_t>(vertex_remap_key)
+        : std::vector<uint32_t>();
+    auto opt_meshlet_lods = cache.get<MeshletLod>(meshlet_lods_key);
+    auto opt_meshlet_groups = cache.get<MeshletGroup>(meshlet_groups_key);
+    auto opt_meshlet_parts = cache.get<MeshletPart>(meshlet_parts_key);
+
+    auto cache_hit = opt_meshlets && opt_micro_indices
+        && (opt_indices_32bit || opt_indices_16bit) && opt_vertex_remap
+        && opt_meshlet_lods && opt_meshlet_groups && opt_meshlet_parts;
+
+    if (cache_hit) {
+        LoadStats::global().cache_hit.add(
+            std::chrono::steady_clock::now() - lookup_start,
+            opt_meshlets->size() * sizeof(Meshlet) + opt_micro_indices->size()
+                + (opt_indices_32bit ? opt_indices_32bit->size() * 4
+                                     : opt_indices_16bit->size() * 2)
+                + opt_vertex_remap->size() * 4
+                + opt_meshlet_lods->size() * sizeof(MeshletLod)
+                + opt_meshlet_groups->size() * sizeof(MeshletGroup)
+                + opt_meshlet_parts->size() * sizeof(MeshletPart)
+        );
+    } else {
+        LoadStats::global().cache_miss.add(
+            std::chrono::steady_clock::now() - lookup_start,
+            0
+        );
+    }
 
-            allocator,
-            vk::BufferUsageFlagBits::eStorageBuffer
-                | vk::BufferUsageFlagBits::eShaderDeviceAddress,
-            primitive_name + " meshlets buffer",
-            command_buffer,
-            temp_buffers
+    Meshlets meshlets;
+
+    if (cache_hit) {
+        meshlets = Meshlets {
+            .meshlets = std::move(opt_meshlets.value()),
+            .micro_indices = std::move(opt_micro_indices.value()),
+            .indices_32bit = std::move(opt_indices_32bit).value_or(
+                std::vector<uint32_t>()
+            ),
+            .indices_16bit = std::move(opt_indices_16bit).value_or(
+                std::vector<uint16_t>()
+            ),
+            .vertex_remap = std::move(opt_vertex_remap.value()),
+            .lods = std::move(opt_meshlet_lods.value()),
+            .groups = std::move(opt_meshlet_groups.value()),
+            .parts = std::move(opt_meshlet_parts.value())};
+    } else {
+        // Only needed to build the meshlets, the part bounds are cached with
+        // them.
+        auto bounds = compute_mesh_bounds(uint_positions, positions.count);
+
+        std::vector<float> float_positions(positions.count * 3);
+        dequantize_positions(
+            uint_positions,
+            float_positions.data(),
+            positions.count
         );
 
-    return {
-        .meshlets = std::move(meshlets_buffer),
-        .indices = std::move(indices_buffer),
-        .micro_indices = std::move(micro_indices_buffer),
-        .num_meshlets =
-            static_cast<uint32_t>(num_meshlet_bytes / sizeof(Meshlet))};
+        {
+            ZoneScopedN("meshlet build");
+            auto timer = PhaseTimer(
+                LoadStats::global().meshlet_build,
+                indices.count * (uses_32_bit_indices ? 4 : 2)
+            );
+
+            meshlets = build_meshlets(
+                accessor_data(asset, indices, source_buffers),
+                indices.count,
+                float_positions.data(),
+                positions.count,
+                uses_32_bit_indices,
+                bounds,
+                config
+            );
+        }
+
+        cache.insert(meshlets_key, meshlets.meshlets);
+        cache.insert(micro_indices_key, meshlets.micro_indices);
+        if (uses_32_bit_indices) {
+            cache.insert(indices_key, meshlets.indices_32bit);
+        } else {
+            cache.insert(indices_key, meshlets.indices_16bit);
+        }
+        if (config.optimize_vertex_order) {
+            cache.insert(vertex_remap_key, meshlets.vertex_remap);
+        }
+        cache.insert(meshlet_lods_key, meshlets.lods);
+        cache.insert(meshlet_groups_key, meshlets.groups);
+        cache.insert(meshlet_parts_key, meshlets.parts);
+    }
+
+    return {.meshlets = std::move(meshlets)};
 }
 
 MeshletBuffers upload_meshlet_buffers(
-    Meshlets meshlets,
+    const Meshlets& meshlets,
     bool uses_32_bit_indices,
-    vma::Allocator allocator,
-    const std::string& primitive_name,
-    const vk::raii::CommandBuffer& command_buffer,
-    std::vector<AllocatedBuffer>& temp_buffers
+    GeometryArena& geometry_arena,
+    StagingRing& staging
 ) {
-    std::optional<AllocatedBuffer> indices_buffer = std::nullopt;
-
-    if (uses_32_bit_indices) {
-        indices_buffer = upload_via_staging_buffer(
+    auto indices = uses_32_bit_indices
+        ? upload_geometry(
             meshlets.indices_32bit.data(),
             meshlets.indices_32bit.size() * sizeof(uint32_t),
-            allocator,
-            vk::BufferUsageFlagBits::eStorageBuffer
-                | vk::BufferUsageFlagBits::eShaderDeviceAddress,
-            primitive_name + " indices buffer",
-            command_buffer,
-            temp_buffers
-        );
-    } else {
-        indices_buffer = upload_via_staging_buffer(
+            geometry_arena,
+            staging
+        )
+        : upload_geometry(
             meshlets.indices_16bit.data(),
             meshlets.indices_16bit.size() * sizeof(uint16_t),
-            allocator,
-            vk::BufferUsageFlagBits::eStorageBuffer
-                | vk::BufferUsageFlagBits::eShaderDeviceAddress,
-            primitive_name + " indices buffer",
-            command_buffer,
-            temp_buffers
+            geometry_arena,
+            staging
         );
-    }
 
-    auto micro_indices = upload_via_staging_buffer(
+    auto micro_indices = upload_geometry(
         meshlets.micro_indices.data(),
         meshlets.micro_indices.size(),
-        allocator,
-        vk::BufferUsageFlagBits::eStorageBuffer
-            | vk::BufferUsageFlagBits::eShaderDeviceAddress,
-        primitive_name + " micro indices buffer",
-        command_buffer,
-        temp_buffers
+        geometry_arena,
+        staging
     );
 
-    auto meshlets_buffer = upload_via_staging_buffer(
+    auto meshlets_allocation = upload_geometry(
         meshlets.meshlets.data(),
         meshlets.meshlets.size() * sizeof(Meshlet),
-        allocator,
-        vk::BufferUsageFlagBits::eStorageBuffer
-            | vk::BufferUsageFlagBits::eShaderDeviceAddress,
-        primitive_name + " meshlets buffer",
-        command_buffer,
-        temp_buffers
+        geometry_arena,
+        staging
+    );
+
+    auto meshlet_lods = upload_geometry(
+        meshlets.lods.data(),
+        meshlets.lods.size() * sizeof(MeshletLod),
+        geometry_arena,
+        staging
+    );
+
+    auto meshlet_groups = upload_geometry(
+        meshlets.groups.data(),
+        meshlets.groups.size() * sizeof(MeshletGroup),
+        geometry_arena,
+        staging
     );
 
     return {
-        .meshlets = std::move(meshlets_buffer),
-        .indices = std::move(indices_buffer.value()),
-        .micro_indices = std::move(micro_indices),
+        .meshlets = meshlets_allocation,
+        .meshlet_lods = meshlet_lods,
+        .meshlet_groups = meshlet_groups,
+        .indices = indices,
+        .micro_indices = micro_indices,
         .num_meshlets = static_cast<uint32_t>(meshlets.meshlets.size())};
 }
 
-GltfMesh load_gltf(
-    const std::filesystem::path& filepath,
-    vma::Allocator allocator,
-    const vk::raii::Device& device,
-    const vk::raii::CommandBuffer& command_buffer,
-    uint32_t graphics_queue_family,
-    std::vector<AllocatedBuffer>& temp_buffers,
-    DescriptorSet& descriptor_set,
-    const Pipelines& pipelines
+MeshInfo create_mesh_info(
+    const fastgltf::Asset& asset,
+    const fastgltf::Primitive& primitive,
+    const std::string& primitive_name,
+    const std::vector<uint32_t>& image_indices
+) {
+    auto& indices = asset.accessors[primitive.indicesAccessor.value()];
+
+    bool uses_32_bit_indices =
+        indices.componentType == fastgltf::ComponentType::UnsignedInt;
+
+    auto& uvs = get_accessor(asset, primitive, "TEXCOORD_0", primitive_name);
+
+    auto material_index = primitive.materialIndex.value();
+    auto& material = asset.materials[material_index];
+
+    auto texture_scale = glm::vec2(1.0);
+    auto texture_offset = glm::vec2(0.0);
+    auto base_color_texture_index = UNUSED_TEXTURE_INDEX;
+    auto metallic_roughness_texture_index = UNUSED_TEXTURE_INDEX;
+    auto normal_texture_index = UNUSED_TEXTURE_INDEX;
+
+    if (material.pbrData.baseColorTexture) {
+        auto& tex = material.pbrData.baseColorTexture.value();
+
+        base_color_texture_index =
+            image_indices[asset.textures[tex.textureIndex]
+                              .imageIndex.value()];
+
+        if (tex.transform != nullptr) {
+            texture_scale = glm::vec2(
+                (*tex.transform).uvScale[0],
+                (*tex.transform).uvScale[1]
+            );
+            texture_offset = glm::vec2(
+                (*tex.transform).uvOffset[0],
+                (*tex.transform).uvOffset[1]
+            );
+        }
+    }
+
+    if (material.pbrData.metallicRoughnessTexture) {
+        auto& tex = material.pbrData.metallicRoughnessTexture.value();
+        metallic_roughness_texture_index =
+            image_indices[asset.textures[tex.textureIndex]
+                              .imageIndex.value()];
+
+        if (tex.transform != nullptr) {
+            texture_scale = glm::vec2(
+                (*tex.transform).uvScale[0],
+                (*tex.transform).uvScale[1]
+            );
+            texture_offset = glm::vec2(
+                (*tex.transform).uvOffset[0],
+                (*tex.transform).uvOffset[1]
+            );
+        }
+    }
+
+    if (material.normalTexture) {
+        auto& tex = material.normalTexture.value();
+        normal_texture_index =
+            image_indices[asset.textures[tex.textureIndex]
+                              .imageIndex.value()];
+
+        if (tex.transform != nullptr) {
+            texture_scale = glm::vec2(
+                (*tex.transform).uvScale[0],
+                (*tex.transform).uvScale[1]
+            );
+            texture_offset = glm::vec2(
+                (*tex.transform).uvOffset[0],
+                (*tex.transform).uvOffset[1]
+            );
+        }
+    }
+
+    if (uvs.normalized) {
+        texture_scale /= float((1 << 16) - 1);
+    }
+
+    uint8_t flags = 0u;
+    if (uses_32_bit_indices) {
+        flags |= MESH_INFO_FLAGS_32_BIT_INDICES;
+    }
+    if (material.alphaMode == fastgltf::AlphaMode::Mask) {
+        flags |= MESH_INFO_FLAGS_ALPHA_CLIP;
+    }
+
+    if (material.alphaCutoff != 0.5) {
+        dbg(material.alphaCutoff);
+        abort();
+    }
+
+    // Assume that all alpha clipped geometry is double-sided
+    // and that all opaque geometry is single sided.
+    if ((material.alphaMode == fastgltf::AlphaMode::Mask)
+        != material.doubleSided) {
+        dbg((material.alphaMode == fastgltf::AlphaMode::Mask),
+            material.doubleSided);
+    }
+
+    if (material.pbrData.baseColorFactor[3] != 1.0) {
+        dbg(material.pbrData.baseColorFactor);
+    }
+
+    return MeshInfo {
+        .flags = flags,
+        .texture_scale = texture_scale,
+        .texture_offset = texture_offset,
+        .base_color_texture_index = base_color_texture_index,
+        .metallic_roughness_texture_index = metallic_roughness_texture_index,
+        .normal_texture_index = normal_texture_index,
+        .base_color_factor = glm::vec3(
+            material.pbrData.baseColorFactor[0],
+            material.pbrData.baseColorFactor[1],
+            material.pbrData.baseColorFactor[2]
+        )};
+}
+
+std::vector<MeshInfo>
+split_mesh_info(const MeshInfo& mesh_info, const Meshlets& meshlets) {
+    auto index_size = (mesh_info.flags & MESH_INFO_FLAGS_32_BIT_INDICES)
+        ? sizeof(uint32_t)
+        : sizeof(uint16_t);
+
+    std::vector<MeshInfo> mesh_infos;
+
+    for (auto& part : meshlets.parts) {
+        auto part_info = mesh_info;
+        part_info.indices += part.index_offset * index_size;
+        part_info.micro_indices += part.micro_index_offset;
+        part_info.meshlets += part.first_meshlet * sizeof(Meshlet);
+        part_info.meshlet_lods += part.first_meshlet * sizeof(MeshletLod);
+        part_info.meshlet_groups +=
+            part.first_meshlet / MESHLET_GROUP_SIZE * sizeof(MeshletGroup);
+        part_info.num_meshlets = static_cast<uint16_t>(part.num_meshlets);
+        part_info.bounding_sphere = part.bounds.bounding_sphere;
+        part_info.aabb_min = part.bounds.aabb_min;
+        part_info.aabb_max = part.bounds.aabb_max;
+        mesh_infos.push_back(part_info);
+    }
+
+    return mesh_infos;
+}
+
+// Stage a padded vertex stream in ranges of vertices that each fit into a
+// staging chunk, so that big primitives stay within the staging budget.
+// `add_jobs` queues the repacking of a range while it's still in the current
+// chunk, before anything else can be staged.
+void stage_padded_vertices(
+    const uint8_t* source,
+    size_t count,
+    size_t padded_stride,
+    size_t packed_stride,
+    const std::vector<uint32_t>& remapped_sources,
+    uint64_t dst,
+    StagingRing& staging,
+    const std::function<void(uint64_t dst, uint64_t src, uint32_t count)>&
+        add_jobs
 ) {
+    auto range_size = staging.chunk_size / padded_stride;
+
+    for (size_t first = 0; first < count; first += range_size) {
+        auto range_count = std::min<size_t>(count - first, range_size);
+        auto allocation = staging.allocate(range_count * padded_stride);
+
+        {
+            ZoneScopedN("staging copy");
+            auto timer = PhaseTimer(
+                LoadStats::global().staging_copy,
+                range_count * padded_stride
+            );
+            auto* staged = static_cast<uint8_t*>(allocation.mapped_ptr);
+
+            if (remapped_sources.empty()) {
+                std::memcpy(
+                    staged,
+                    source + first * padded_stride,
+                    range_count * padded_stride
+                );
+            } else {
+                for (size_t i = 0; i < range_count; i++) {
+                    std::memcpy(
+                        staged + i * padded_stride,
+                        source + remapped_sources[first + i] * padded_stride,
+                        padded_stride
+                    );
+                }
+            }
+        }
+
+        add_jobs(
+            dst + first * packed_stride,
+            allocation.address,
+            static_cast<uint32_t>(range_count)
+        );
+    }
+}
+
+// Record the commands to upload a primitive whose CPU-side data is ready.
+GltfPrimitive upload_primitive(
+    const fastgltf::Asset& asset,
+    const PrimitiveJob& job,
+    PrimitiveCpuData cpu_data,
+    const std::vector<MappedFile>& source_buffers,
+    const std::vector<uint32_t>& image_indices,
+    GeometryArena& geometry_arena,
+    std::vector<GeometryAllocation>& geometry_allocations,
+    StagingRing& staging,
+    VertexRepacker& repacker
+) {
+    auto& primitive = job.primitive;
+    auto& primitive_name = job.name;
+
+    auto& positions =
+        get_accessor(asset, primitive, "POSITION", primitive_name);
+    auto& normals = get_accessor(asset, primitive, "NORMAL", primitive_name);
+    assert(normals.componentType == fastgltf::ComponentType::Byte);
+    assert(normals.type == fastgltf::AccessorType::Vec3);
+
+    // The positions and normals are stored with a padding element in the
+    // gltf, so stage the padded values and strip the padding on the GPU.
+    auto& vertex_remap = cpu_data.meshlets.vertex_remap;
+
+    // The remap scatters source vertices to their new place. Invert it so
+    // that each staged range can gather its own vertices.
+    std::vector<uint32_t> remapped_sources(vertex_remap.size());
+    for (uint32_t i = 0; i < vertex_remap.size(); i++) {
+        remapped_sources[vertex_remap[i]] = i;
+    }
+
+    auto position_allocation =
+        geometry_arena.allocate(positions.count * sizeof(uint16_t) * 3);
+
+    stage_padded_vertices(
+        accessor_data(asset, positions, source_buffers),
+        positions.count,
+        sizeof(uint16_t) * 4,
+        sizeof(uint16_t) * 3,
+        remapped_sources,
+        position_allocation.address,
+        staging,
+        [&](uint64_t dst, uint64_t src, uint32_t count) {
+            repacker.add_positions(dst, src, count);
+        }
+    );
+
+    auto normals_allocation =
+        geometry_arena.allocate(normals.count * sizeof(int8_t) * 3);
+
+    stage_padded_vertices(
+        accessor_data(asset, normals, source_buffers),
+        normals.count,
+        sizeof(int8_t) * 4,
+        sizeof(int8_t) * 3,
+        remapped_sources,
+        normals_allocation.address,
+        staging,
+        [&](uint64_t dst, uint64_t src, uint32_t count) {
+            repacker.add_normals(dst, src, count);
+        }
+    );
+
+    auto& indices = asset.accessors[primitive.indicesAccessor.value()];
+
+    bool uses_32_bit_indices =
+        indices.componentType == fastgltf::ComponentType::UnsignedInt;
+
+    auto& uvs = get_accessor(asset, primitive, "TEXCOORD_0", primitive_name);
+    assert(uvs.componentType == fastgltf::ComponentType::UnsignedShort);
+    assert(uvs.type == fastgltf::AccessorType::Vec2);
+    std::vector<uint16_t> remapped_uvs(uvs.count * 2);
+    remap_vertices(
+        remapped_uvs.data(),
+        accessor_data(asset, uvs, source_buffers),
+        uvs.count,
+        sizeof(uint16_t) * 2,
+        vertex_remap
+    );
+    auto uvs_allocation = upload_geometry(
+        remapped_uvs.data(),
+        uvs.count * sizeof(uint16_t) * 2,
+        geometry_arena,
+        staging
+    );
+
+    auto meshlet_buffers = upload_meshlet_buffers(
+        cpu_data.meshlets,
+        uses_32_bit_indices,
+        geometry_arena,
+        staging
+    );
+
+    auto mesh_info =
+        create_mesh_info(asset, primitive, primitive_name, image_indices);
+    mesh_info.positions = position_allocation.address;
+    mesh_info.indices = meshlet_buffers.indices.address;
+    mesh_info.normals = normals_allocation.address;
+    mesh_info.uvs = uvs_allocation.address;
+    mesh_info.micro_indices = meshlet_buffers.micro_indices.address;
+    mesh_info.meshlets = meshlet_buffers.meshlets.address;
+    mesh_info.meshlet_lods = meshlet_buffers.meshlet_lods.address;
+    mesh_info.meshlet_groups = meshlet_buffers.meshlet_groups.address;
+
+    GltfPrimitive result = {.num_meshlets = meshlet_buffers.num_meshlets};
+
+    for (auto& part_info : split_mesh_info(mesh_info, cpu_data.meshlets)) {
+        auto mesh_info_allocation = upload_geometry(
+            &part_info,
+            sizeof(MeshInfo),
+            geometry_arena,
+            staging
+        );
+        result.mesh_info_addresses.push_back(mesh_info_allocation.address);
+        geometry_allocations.push_back(mesh_info_allocation);
+    }
+
+    geometry_allocations.insert(
+        geometry_allocations.end(),
+        {position_allocation,
+         normals_allocation,
+         uvs_allocation,
+         meshlet_buffers.indices,
+         meshlet_buffers.micro_indices,
+         meshlet_buffers.meshlets,
+         meshlet_buffers.meshlet_lods,
+         meshlet_buffers.meshlet_groups}
+    );
+
+    return result;
+}
+
+fastgltf::Asset parse_gltf(const std::filesystem::path& filepath) {
     if (!std::filesystem::exists(filepath)) {
         dbg(filepath, "does not exist");
         abort();
     }
 
+    ZoneScopedN("json parse");
+    auto timer = PhaseTimer(
+        LoadStats::global().json_parse,
+        std::filesystem::file_size(filepath)
+    );
+
     fastgltf::Parser parser(
         fastgltf::Extensions::KHR_mesh_quantization
         | fastgltf::Extensions::KHR_texture_transform
@@ -260,10 +641,11 @@ GltfMesh load_gltf(
     fastgltf::GltfDataBuffer data;
     data.loadFromFile(filepath);
 
-    auto parent_path = filepath.parent_path();
-
-    auto asset_result =
-        parser.loadGLTF(&data, parent_path, fastgltf::Options::None);
+    auto asset_result = parser.loadGLTF(
+        &data,
+        filepath.parent_path(),
+        fastgltf::Options::None
+    );
     if (auto error = asset_result.error(); error != fastgltf::Error::None) {
         // Some error occurred while reading the buffer, parsing the JSON, or validating the data.
         // 'std::string_view's don't print super well.
@@ -278,36 +660,27 @@ GltfMesh load_gltf(
     auto error = fastgltf::validate(asset);
     assert(error == fastgltf::Error::None);
 
-    std::vector<std::vector<uint8_t>> source_buffers;
-    std::vector<PersistentlyMappedBuffer> staging_buffers;
-    staging_buffers.reserve(asset.buffers.size());
+    return asset;
+}
+
+// Map the buffers instead of reading them, so that only the pages that
+// are actually used get loaded, and then only the ranges that the GPU
+// needs get copied into staging memory.
+std::vector<MappedFile> map_gltf_buffers(
+    const fastgltf::Asset& asset,
+    const std::filesystem::path& parent_path
+) {
+    std::vector<MappedFile> source_buffers;
     source_buffers.reserve(asset.buffers.size());
     for (auto& buffer : asset.buffers) {
         if (auto* uri = std::get_if<fastgltf::sources::URI>(&buffer.data)) {
-            auto source_buffer =
-                read_file_to_bytes(parent_path / uri->uri.fspath());
-
-            auto staging_buffer = PersistentlyMappedBuffer(AllocatedBuffer(
-                vk::BufferCreateInfo {
-                    .size = buffer.byteLength,
-                    .usage = vk::BufferUsageFlagBits::eTransferSrc
-                        | vk::BufferUsageFlagBits::eShaderDeviceAddress},
-                {
-                    .flags = vma::AllocationCreateFlagBits::eMapped
-                        | vma::AllocationCreateFlagBits::
-                            eHostAccessSequentialWrite,
-                    .usage = vma::MemoryUsage::eAuto,
-                },
-                allocator,
-                uri->uri.fspath().string()
-            ));
-
-            memcpy(
-                staging_buffer.mapped_ptr,
-                source_buffer.data(),
-                buffer.byteLength
-            );
-            staging_buffers.push_back(std::move(staging_buffer));
+            auto source_buffer = MappedFile(parent_path / uri->uri.fspath());
+
+            if (source_buffer.size < buffer.byteLength) {
+                dbg(uri->uri.fspath(), source_buffer.size, buffer.byteLength);
+                abort();
+            }
+
             source_buffers.push_back(std::move(source_buffer));
         } else {
             dbg("here");
@@ -315,430 +688,237 @@ GltfMesh load_gltf(
         }
     }
 
-    std::vector<ImageWithView> images;
-    std::vector<uint32_t> image_indices;
-    images.reserve(asset.images.size());
-    image_indices.reserve(asset.images.size());
+    return source_buffers;
+}
 
-    for (size_t i = 0; i < asset.images.size(); i++) {
-        auto& img = asset.images[i];
+std::vector<SceneNode> gltf_scene_nodes(const fastgltf::Asset& asset) {
+    std::vector<SceneNode> nodes(asset.nodes.size());
 
-        if (auto* uri = std::get_if<fastgltf::sources::URI>(&img.data)) {
-            auto image_path = parent_path / uri->uri.fspath();
-
-            if (image_path.extension() == ".ktx2") {
-                auto image = load_ktx2_image(
-                    image_path,
-                    allocator,
-                    device,
-                    command_buffer,
-                    graphics_queue_family,
-                    temp_buffers
-                );
-                auto index = descriptor_set.write_image(image, *device);
-                images.push_back(std::move(image));
-                image_indices.push_back(index);
-            } else if (image_path.extension() == ".dds") {
-                auto image = load_dds(
-                    image_path,
-                    allocator,
-                    device,
-                    command_buffer,
-                    graphics_queue_family,
-                    temp_buffers
+    for (size_t i = 0; i < asset.nodes.size(); i++) {
+        auto& gltf_node = asset.nodes[i];
+
+        if (auto* trs =
+                std::get_if<fastgltf::Node::TRS>(&gltf_node.transform)) {
+            // gltf rotations are stored as xyzw.
+            auto rotation = glm::quat(
+                trs->rotation[3],
+                trs->rotation[0],
+                trs->rotation[1],
+                trs->rotation[2]
+            );
+
+            nodes[i].local_transform =
+                glm::translate(
+                    glm::mat4(1.0),
+                    glm::vec3(
+                        trs->translation[0],
+                        trs->translation[1],
+                        trs->translation[2]
+                    )
+                )
+                * glm::mat4_cast(rotation)
+                * glm::scale(
+                    glm::mat4(1.0),
+                    glm::vec3(trs->scale[0], trs->scale[1], trs->scale[2])
                 );
-                auto index = descriptor_set.write_image(image, *device);
-                images.push_back(std::move(image));
-                image_indices.push_back(index);
-            } else {
-                dbg(image_path);
-                abort();
-            }
+        } else if (auto* matrix = std::get_if<fastgltf::Node::TransformMatrix>(
+                       &gltf_node.transform
+                   )) {
+            nodes[i].local_transform = glm::make_mat4(matrix->data());
+        }
+
+        for (auto child : gltf_node.children) {
+            nodes[child].parent = static_cast<uint32_t>(i);
         }
     }
 
-    auto node_tree = NodeTree(asset);
+    return nodes;
+}
 
-    std::vector<GltfPrimitive> primitives;
+// Collect the nodes that use each mesh, so that the geometry of a mesh is
+// only loaded once no matter how often it's instanced.
+std::vector<std::vector<uint32_t>>
+collect_mesh_nodes(const fastgltf::Asset& asset) {
+    std::vector<std::vector<uint32_t>> mesh_nodes(asset.meshes.size());
 
     for (size_t i = 0; i < asset.nodes.size(); i++) {
         auto& node = asset.nodes[i];
 
         if (node.meshIndex) {
-            auto transform = node_tree.transform_of(i);
-
-            auto& mesh = asset.meshes[node.meshIndex.value()];
-
-            for (size_t j = 0; j < mesh.primitives.size(); j++) {
-                auto& primitive = mesh.primitives[j];
-
-                auto primitive_name = filepath.string() + " mesh "
-                    + std::to_string(i) + " primitive " + std::to_string(j);
-
-                auto create_buffer = [&](uint64_t size, const char* name) {
-                    return AllocatedBuffer(
-                        vk::BufferCreateInfo {
-                            .size = size,
-                            .usage = vk::BufferUsageFlagBits::eTransferDst
-                                | vk::BufferUsageFlagBits::eStorageBuffer
-                                | vk::BufferUsageFlagBits::
-                                    eShaderDeviceAddress},
-                        {
-                            .usage = vma::MemoryUsage::eAuto,
-                        },
-                        allocator,
-                        primitive_name + " " + name
-                    );
-                };
-
-                auto get_accessor = [&](const char* name
-                                    ) -> fastgltf::Accessor& {
-                    auto iterator = primitive.findAttribute(name);
-                    if (iterator == primitive.attributes.end()) {
-                        dbg(primitive_name, name);
-                        abort();
-                    }
-                    return asset.accessors[iterator->second];
-                };
-
-                if (primitive.findAttribute("TEXCOORD_0")
-                    == primitive.attributes.end()) {
-                    dbg(primitive_name, "missing uvs. Skipping.");
-                    continue;
-                }
-
-                auto& positions = get_accessor("POSITION");
-                assert(
-                    positions.componentType
-                    == fastgltf::ComponentType::UnsignedShort
-                );
-                assert(positions.type == fastgltf::AccessorType::Vec3);
-                auto position_buffer = create_buffer(
-                    positions.count * sizeof(uint16_t) * 3,
-                    "positions"
-                );
-
-                auto& positions_buffer_view =
-                    asset.bufferViews[positions.bufferViewIndex.value()];
-
-                {
-                    copy_uint16_t4_to_uint16_3(
-                        device,
-                        command_buffer,
-                        position_buffer,
-                        staging_buffers[positions_buffer_view.bufferIndex]
-                            .buffer,
-                        pipelines,
-                        positions.count,
-                        positions_buffer_view.byteOffset + positions.byteOffset
-                    );
-                }
-
-                auto& indices =
-                    asset.accessors[primitive.indicesAccessor.value()];
+            mesh_nodes[node.meshIndex.value()].push_back(
+                static_cast<uint32_t>(i)
+            );
+        }
+    }
 
-                bool uses_32_bit_indices = indices.componentType
-                    == fastgltf::ComponentType::UnsignedInt;
-                if (!uses_32_bit_indices) {
-                    assert(
-                        indices.componentType
-                        == fastgltf::ComponentType::UnsignedShort
-                    );
-                }
-                assert(indices.type == fastgltf::AccessorType::Scalar);
+    return mesh_nodes;
+}
 
-                auto& uvs = get_accessor("TEXCOORD_0");
-                assert(
-                    uvs.componentType == fastgltf::ComponentType::UnsignedShort
-                );
-                assert(uvs.type == fastgltf::AccessorType::Vec2);
-                auto uvs_buffer_size = uvs.count * sizeof(uint16_t) * 2;
-                auto uvs_buffer = create_buffer(uvs_buffer_size, "uvs");
-                copy_buffer_to_final(
-                    uvs,
-                    asset,
-                    staging_buffers,
-                    uvs_buffer,
-                    command_buffer,
-                    uvs_buffer_size
-                );
+// Gather all the primitives up front so that the CPU-side work for each one
+// can be done in parallel, while commands are recorded in order.
+std::vector<PrimitiveJob> gather_primitive_jobs(
+    const fastgltf::Asset& asset,
+    const std::filesystem::path& filepath,
+    const std::vector<std::vector<uint32_t>>& mesh_nodes
+) {
+    std::vector<PrimitiveJob> jobs;
 
-                auto& normals = get_accessor("NORMAL");
-                assert(normals.componentType == fastgltf::ComponentType::Byte);
-                assert(normals.type == fastgltf::AccessorType::Vec3);
-                auto normals_buffer_size = normals.count * sizeof(int8_t) * 3;
-                auto normals_buffer =
-                    create_buffer(normals_buffer_size, "normals");
-                {
-                    auto& normals_buffer_view =
-                        asset.bufferViews[normals.bufferViewIndex.value()];
-
-                    {
-                        copy_uint8_t4_to_uint8_3(
-                            device,
-                            command_buffer,
-                            normals_buffer,
-                            staging_buffers[normals_buffer_view.bufferIndex]
-                                .buffer,
-                            pipelines,
-                            normals.count,
-                            normals_buffer_view.byteOffset + normals.byteOffset
-                        );
-                    }
-                }
+    for (size_t i = 0; i < asset.meshes.size(); i++) {
+        if (mesh_nodes[i].empty()) {
+            continue;
+        }
 
-                auto material_index = primitive.materialIndex.value();
-                auto& material = asset.materials[material_index];
-
-                auto texture_scale = glm::vec2(1.0);
-                auto texture_offset = glm::vec2(0.0);
-                auto base_color_texture_index = UNUSED_TEXTURE_INDEX;
-                auto metallic_roughness_texture_index = UNUSED_TEXTURE_INDEX;
-                auto normal_texture_index = UNUSED_TEXTURE_INDEX;
-
-                if (material.pbrData.baseColorTexture) {
-                    auto& tex = material.pbrData.baseColorTexture.value();
-
-                    base_color_texture_index =
-                        image_indices[asset.textures[tex.textureIndex]
-                                          .imageIndex.value()];
-
-                    if (tex.transform != nullptr) {
-                        texture_scale = glm::vec2(
-                            (*tex.transform).uvScale[0],
-                            (*tex.transform).uvScale[1]
-                        );
-                        texture_offset = glm::vec2(
-                            (*tex.transform).uvOffset[0],
-                            (*tex.transform).uvOffset[1]
-                        );
-                    }
-                }
+        auto& mesh = asset.meshes[i];
 
-                if (material.pbrData.metallicRoughnessTexture) {
-                    auto& tex =
-                        material.pbrData.metallicRoughnessTexture.value();
-                    metallic_roughness_texture_index =
-                        image_indices[asset.textures[tex.textureIndex]
-                                          .imageIndex.value()];
-
-                    if (tex.transform != nullptr) {
-                        texture_scale = glm::vec2(
-                            (*tex.transform).uvScale[0],
-                            (*tex.transform).uvScale[1]
-                        );
-                        texture_offset = glm::vec2(
-                            (*tex.transform).uvOffset[0],
-                            (*tex.transform).uvOffset[1]
-                        );
-                    }
-                }
+        for (size_t j = 0; j < mesh.primitives.size(); j++) {
+            auto primitive_name = filepath.string() + " mesh "
+                + std::to_string(i) + " primitive " + std::to_string(j);
 
-                if (material.normalTexture) {
-                    auto& tex = material.normalTexture.value();
-                    normal_texture_index =
-                        image_indices[asset.textures[tex.textureIndex]
-                                          .imageIndex.value()];
-
-                    if (tex.transform != nullptr) {
-                        texture_scale = glm::vec2(
-                            (*tex.transform).uvScale[0],
-                            (*tex.transform).uvScale[1]
-                        );
-                        texture_offset = glm::vec2(
-                            (*tex.transform).uvOffset[0],
-                            (*tex.transform).uvOffset[1]
-                        );
-                    }
-                }
+            if (mesh.primitives[j].findAttribute("TEXCOORD_0")
+                == mesh.primitives[j].attributes.end()) {
+                dbg(primitive_name, "missing uvs. Skipping.");
+                continue;
+            }
 
-                if (uvs.normalized) {
-                    texture_scale /= float((1 << 16) - 1);
-                }
+            jobs.push_back(PrimitiveJob {
+                .primitive = mesh.primitives[j],
+                .nodes = mesh_nodes[i],
+                .name = primitive_name});
+        }
+    }
 
-                uint8_t flags = 0u;
-                if (uses_32_bit_indices) {
-                    flags |= MESH_INFO_FLAGS_32_BIT_INDICES;
-                }
-                if (material.alphaMode == fastgltf::AlphaMode::Mask) {
-                    flags |= MESH_INFO_FLAGS_ALPHA_CLIP;
-                }
+    return jobs;
+}
 
-                if (material.alphaCutoff != 0.5) {
-                    dbg(material.alphaCutoff);
-                    abort();
-                }
+GltfMesh load_gltf(
+    const std::filesystem::path& filepath,
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    uint32_t graphics_queue_family,
+    StagingRing& staging,
+    DescriptorSet& descriptor_set,
+    TextureStreamer* texture_streamer,
+    const std::shared_ptr<GeometryArena>& geometry_arena,
+    const Pipelines& pipelines,
+    std::stop_token stop_token,
+    const SceneReceiver& receiver
+) {
+    auto parent_path = filepath.parent_path();
+    auto asset = parse_gltf(filepath);
+    auto source_buffers = map_gltf_buffers(asset, parent_path);
 
-                // Assume that all alpha clipped geometry is double-sided
-                // and that all opaque geometry is single sided.
-                if ((material.alphaMode == fastgltf::AlphaMode::Mask)
-                    != material.doubleSided) {
-                    dbg((material.alphaMode == fastgltf::AlphaMode::Mask),
-                        material.doubleSided);
-                }
+    std::vector<std::filesystem::path> image_paths;
+    image_paths.reserve(asset.images.size());
 
-                if (material.pbrData.baseColorFactor[3] != 1.0) {
-                    dbg(material.pbrData.baseColorFactor);
-                }
+    for (auto& img : asset.images) {
+        if (auto* uri = std::get_if<fastgltf::sources::URI>(&img.data)) {
+            image_paths.push_back(parent_path / uri->uri.fspath());
+        }
+    }
 
-                std::vector<float> float_positions(positions.count * 3);
+    std::vector<ImageWithView> images;
+    auto image_indices = load_scene_images(
+        image_paths,
+        allocator,
+        device,
+        graphics_queue_family,
+        staging,
+        descriptor_set,
+        texture_streamer,
+        images
+    );
 
-                uint16_t* uint_positions = reinterpret_cast<uint16_t*>(
-                    source_buffers[positions_buffer_view.bufferIndex].data()
-                    + positions_buffer_view.byteOffset + positions.byteOffset
-                );
-                for (size_t i = 0; i < positions.count; i++) {
-                    assert(uint_positions[i * 4 + 3] == 0);
-                    float_positions[i * 3] = float(uint_positions[i * 4]);
-                    float_positions[i * 3 + 1] =
-                        float(uint_positions[i * 4 + 1]);
-                    float_positions[i * 3 + 2] =
-                        float(uint_positions[i * 4 + 2]);
-                }
+    receiver.on_nodes(gltf_scene_nodes(asset));
 
-                auto& indices_buffer_view =
-                    asset.bufferViews[indices.bufferViewIndex.value()];
+    auto mesh_nodes = collect_mesh_nodes(asset);
+    auto jobs = gather_primitive_jobs(asset, filepath, mesh_nodes);
 
-                std::optional<MeshletBuffers> opt_meshlet_buffers;
+    auto cache = FsCache(filepath);
 
-                auto meshlets_key = primitive_name + " meshlets";
-                auto indices_key = primitive_name + " indices";
-                auto micro_indices_key = primitive_name + " micro indices";
+    std::vector<GltfPrimitive> primitives;
+    primitives.reserve(jobs.size());
+    std::vector<GeometryAllocation> geometry_allocations;
 
-                auto opt_meshlets = FsCache::get(meshlets_key);
-                auto opt_indices = FsCache::get(indices_key);
-                auto opt_micro_indices = FsCache::get(micro_indices_key);
+    auto repacker = VertexRepacker(staging, pipelines);
 
-                if (opt_meshlets && opt_indices && opt_micro_indices) {
-                    opt_meshlet_buffers = upload_meshlet_buffers_from_cache(
-                        std::move(opt_meshlets.value()),
-                        std::move(opt_indices.value()),
-                        std::move(opt_micro_indices.value()),
-                        allocator,
-                        primitive_name,
-                        command_buffer,
-                        temp_buffers
-                    );
-                } else {
-                    auto meshlets = build_meshlets(
-                        source_buffers[indices_buffer_view.bufferIndex].data()
-                            + indices_buffer_view.byteOffset
-                            + indices.byteOffset,
-                        indices.count,
-                        float_positions.data(),
-                        positions.count,
-                        uses_32_bit_indices
-                    );
+    // Work through the primitives in batches, submitting after each one so
+    // that the first primitives can be rendered while the rest are still
+    // being built.
+    auto batch_size = (ThreadPool::global().workers.size() + 1) * 4;
 
-                    FsCache::insert(meshlets_key, meshlets.meshlets);
-                    FsCache::insert(micro_indices_key, meshlets.micro_indices);
-                    if (uses_32_bit_indices) {
-                        FsCache::insert(indices_key, meshlets.indices_32bit);
-                    } else {
-                        FsCache::insert(indices_key, meshlets.indices_16bit);
-                    }
-
-                    opt_meshlet_buffers = upload_meshlet_buffers(
-                        meshlets,
-                        uses_32_bit_indices,
-                        allocator,
-                        primitive_name,
-                        command_buffer,
-                        temp_buffers
-                    );
-                }
+    for (size_t batch_start = 0; batch_start < jobs.size();
+         batch_start += batch_size) {
+        if (stop_token.stop_requested()) {
+            break;
+        }
 
-                auto meshlet_buffers = std::move(opt_meshlet_buffers.value());
+        auto batch_end = std::min(batch_start + batch_size, jobs.size());
 
-                float bounding_sphere[4];
-                computeBoundingSphere(
-                    bounding_sphere,
-                    float_positions.data(),
-                    positions.count
-                );
+        std::vector<PrimitiveCpuData> cpu_data(batch_end - batch_start);
 
-                auto mesh_info = MeshInfo {
-                    .positions = device.getBufferAddress(
-                        {.buffer = position_buffer.buffer}
-                    ),
-                    .indices = device.getBufferAddress(
-                        {.buffer = meshlet_buffers.indices.buffer}
-                    ),
-                    .normals = device.getBufferAddress(
-                        {.buffer = normals_buffer.buffer}
-                    ),
-                    .uvs =
-                        device.getBufferAddress({.buffer = uvs_buffer.buffer}),
-                    .micro_indices = device.getBufferAddress(
-                        {.buffer = meshlet_buffers.micro_indices.buffer}
-                    ),
-                    .meshlets = device.getBufferAddress(
-                        {.buffer = meshlet_buffers.meshlets.buffer}
-                    ),
-                    .num_meshlets =
-                        static_cast<uint16_t>(meshlet_buffers.num_meshlets),
-                    .flags = flags,
-                    .bounding_sphere = glm::vec4(
-                        bounding_sphere[0],
-                        bounding_sphere[1],
-                        bounding_sphere[2],
-                        bounding_sphere[3]
-                    ),
-                    .texture_scale = texture_scale,
-                    .texture_offset = texture_offset,
-                    .base_color_texture_index = base_color_texture_index,
-                    .metallic_roughness_texture_index =
-                        metallic_roughness_texture_index,
-                    .normal_texture_index = normal_texture_index,
-                    .base_color_factor = glm::vec3(
-                        material.pbrData.baseColorFactor[0],
-                        material.pbrData.baseColorFactor[1],
-                        material.pbrData.baseColorFactor[2]
-                    )};
-
-                auto mesh_info_buffer = upload_via_staging_buffer(
-                    &mesh_info,
-                    sizeof(MeshInfo),
-                    allocator,
-                    vk::BufferUsageFlagBits::eStorageBuffer
-                        | vk::BufferUsageFlagBits::eShaderDeviceAddress,
-                    primitive_name + " mesh info buffer",
-                    command_buffer,
-                    temp_buffers
-                );
+        parallel_for(cpu_data.size(), [&](size_t i) {
+            cpu_data[i] = process_primitive(
+                asset,
+                jobs[batch_start + i],
+                source_buffers,
+                cache
+            );
+        });
+
+        std::vector<NodeInstance> instances;
+
+        for (size_t i = batch_start; i < batch_end; i++) {
+            auto primitive = upload_primitive(
+                asset,
+                jobs[i],
+                std::move(cpu_data[i - batch_start]),
+                source_buffers,
+                image_indices,
+                *geometry_arena,
+                geometry_allocations,
+                staging,
+                repacker
+            );
 
-                if (meshlet_buffers.num_meshlets >= (1 << 16)) {
-                    dbg(meshlet_buffers.num_meshlets);
-                    abort();
+            for (auto node : jobs[i].nodes) {
+                for (auto address : primitive.mesh_info_addresses) {
+                    instances.push_back(NodeInstance {
+                        .node = node,
+                        .mesh_info_address = address});
                 }
-
-                primitives.push_back(GltfPrimitive {
-                    .position = std::move(position_buffer),
-                    .indices = std::move(meshlet_buffers.indices),
-                    .uvs = std::move(uvs_buffer),
-                    .normals = std::move(normals_buffer),
-                    .mesh_info = std::move(mesh_info_buffer),
-                    .micro_indices = std::move(meshlet_buffers.micro_indices),
-                    .meshlets = std::move(meshlet_buffers.meshlets),
-                    .transform = transform,
-                    .num_meshlets = meshlet_buffers.num_meshlets});
             }
+
+            primitives.push_back(std::move(primitive));
         }
+
+        staging.on_complete([instances = std::move(instances), &receiver]() {
+            receiver.on_resident(instances);
+        });
+        staging.flush();
+        staging.poll();
     }
 
-    for (auto& staging_buffer : staging_buffers) {
-        temp_buffers.push_back(std::move(staging_buffer.buffer));
+    // A partial load would drop the entries of the primitives it didn't get
+    // to.
+    if (!stop_token.stop_requested()) {
+        cache.write();
     }
 
     return {
         .images = std::move(images),
         .image_indices = std::move(image_indices),
         .primitives = std::move(primitives),
-        .image_index_tracker = descriptor_set.tracker};
+        .geometry_allocations = std::move(geometry_allocations),
+        .image_index_tracker = descriptor_set.tracker,
+        .geometry_arena = geometry_arena};
 }
 
 GltfMesh::~GltfMesh() {
     for (auto index : image_indices) {
         image_index_tracker->free(index);
     }
+
+    for (auto& allocation : geometry_allocations) {
+        geometry_arena->free(allocation);
+    }
 }
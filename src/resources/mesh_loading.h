@@ -1,9 +1,15 @@
 #pragma once
 #include "../allocations/base.h"
+#include "../allocations/geometry_arena.h"
+#include "../allocations/staging.h"
 #include "../descriptor_set.h"
 #include "../pipelines.h"
+#include "../scene_graph.h"
 #include "../shared_cpu_gpu.h"
+#include "fs_cache.h"
+#include "mapped_file.h"
 #include "meshlets.h"
+#include "texture_streaming.h"
 
 struct BoundingBox {
     glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
@@ -20,33 +26,113 @@ struct BoundingBox {
 };
 
 struct GltfPrimitive {
-    AllocatedBuffer position;
-    AllocatedBuffer indices;
-    AllocatedBuffer uvs;
-    AllocatedBuffer normals;
-    AllocatedBuffer mesh_info;
-    AllocatedBuffer micro_indices;
-    AllocatedBuffer meshlets;
-    glm::mat4 transform;
+    // One per `MeshletPart`, each drawn as its own instance.
+    std::vector<uint64_t> mesh_info_addresses;
     uint32_t num_meshlets;
 };
 
 struct GltfMesh {
     std::vector<ImageWithView> images;
     std::vector<uint32_t> image_indices;
+    // Geometry is loaded once per gltf mesh primitive and shared between
+    // all the instances (one per node) that use it.
     std::vector<GltfPrimitive> primitives;
+    std::vector<GeometryAllocation> geometry_allocations;
     std::shared_ptr<IndexTracker> image_index_tracker;
+    std::shared_ptr<GeometryArena> geometry_arena;
 
     ~GltfMesh();
 };
 
+// How a scene is handed over while it loads. Both are called on the loading
+// thread.
+struct SceneReceiver {
+    // Called once, before any instances.
+    std::function<void(std::vector<SceneNode>)> on_nodes;
+    // Called with each batch of instances once the data they use has
+    // finished uploading. Node indices refer to the nodes given to
+    // `on_nodes`.
+    std::function<void(const std::vector<NodeInstance>&)> on_resident;
+};
+
 GltfMesh load_gltf(
     const std::filesystem::path& filepath,
     vma::Allocator allocator,
     const vk::raii::Device& device,
-    const vk::raii::CommandBuffer& command_buffer,
     uint32_t graphics_queue_family,
-    std::vector<AllocatedBuffer>& temp_buffers,
+    StagingRing& staging,
     DescriptorSet& descriptor_set,
-    const Pipelines& pipelines
+    TextureStreamer* texture_streamer,
+    const std::shared_ptr<GeometryArena>& geometry_arena,
+    const Pipelines& pipelines,
+    std::stop_token stop_token,
+    const SceneReceiver& receiver
+);
+
+// The pieces of `load_gltf` that don't touch Vulkan, shared with the
+// scene baker.
+
+struct PrimitiveJob {
+    const fastgltf::Primitive& primitive;
+    // All the nodes that use the primitive's mesh.
+    const std::vector<uint32_t>& nodes;
+    std::string name;
+};
+
+// Everything about a primitive that can be computed without touching Vulkan.
+struct PrimitiveCpuData {
+    Meshlets meshlets;
+};
+
+fastgltf::Asset parse_gltf(const std::filesystem::path& filepath);
+
+std::vector<MappedFile> map_gltf_buffers(
+    const fastgltf::Asset& asset,
+    const std::filesystem::path& parent_path
+);
+
+std::vector<SceneNode> gltf_scene_nodes(const fastgltf::Asset& asset);
+
+std::vector<std::vector<uint32_t>>
+collect_mesh_nodes(const fastgltf::Asset& asset);
+
+std::vector<PrimitiveJob> gather_primitive_jobs(
+    const fastgltf::Asset& asset,
+    const std::filesystem::path& filepath,
+    const std::vector<std::vector<uint32_t>>& mesh_nodes
+);
+
+const uint8_t* accessor_data(
+    const fastgltf::Asset& asset,
+    const fastgltf::Accessor& accessor,
+    const std::vector<MappedFile>& source_buffers
+);
+
+const fastgltf::Accessor& get_accessor(
+    const fastgltf::Asset& asset,
+    const fastgltf::Primitive& primitive,
+    const char* name,
+    const std::string& primitive_name
+);
+
+PrimitiveCpuData process_primitive(
+    const fastgltf::Asset& asset,
+    const PrimitiveJob& job,
+    const std::vector<MappedFile>& source_buffers,
+    FsCache& cache
 );
+
+// Build the material parts of a `MeshInfo`. The buffer addresses are left
+// for the caller to fill in, and the meshlet counts and bounds for
+// `split_mesh_info`.
+MeshInfo create_mesh_info(
+    const fastgltf::Asset& asset,
+    const fastgltf::Primitive& primitive,
+    const std::string& primitive_name,
+    const std::vector<uint32_t>& image_indices
+);
+
+// One `MeshInfo` per `MeshletPart`, pointing at the part's range of the
+// buffers that `mesh_info` has the addresses of.
+std::vector<MeshInfo>
+split_mesh_info(const MeshInfo& mesh_info, const Meshlets& meshlets);
@@ -1,75 +1,124 @@
 #include "meshlets.h"
 
-Meshlets build_meshlets(
-    uint8_t* indices,
+#include "../thread_pool.h"
+
+std::string MeshletConfig::cache_key() const {
+    std::stringstream stream;
+    stream << max_vertices << "v " << max_triangles << "t " << cone_weight
+           << "c" << (optimize_vertex_order ? " optimized" : "")
+           << (build_lods ? " lods" : "");
+    return stream.str();
+}
+
+MeshletConfig& MeshletConfig::global() {
+    static MeshletConfig config;
+    return config;
+}
+
+std::optional<MeshletConfig> parse_meshlet_config(const std::string& string) {
+    MeshletConfig config;
+    char first_comma;
+    char second_comma;
+
+    auto stream = std::stringstream(string);
+    stream >> config.max_vertices >> first_comma >> config.max_triangles
+        >> second_comma >> config.cone_weight;
+
+    if (stream.fail() || !stream.eof() || first_comma != ','
+        || second_comma != ',') {
+        return std::nullopt;
+    }
+
+    // meshoptimizer's limits, along with what fits in the packed counts.
+    if (config.max_vertices < 3 || config.max_vertices > MESHLET_COUNT_MASK
+        || config.max_triangles < 4 || config.max_triangles % 4 != 0
+        || config.max_triangles > MESHLET_COUNT_MASK
+        || config.cone_weight < 0.0f || config.cone_weight > 1.0f) {
+        return std::nullopt;
+    }
+
+    return config;
+}
+
+struct MeshletAabb {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// Meshlets in the layout that meshoptimizer builds them in, before they're
+// converted into `Meshlet`s.
+struct MeshletBuilder {
+    std::vector<meshopt_Meshlet> meshlets;
+    std::vector<meshopt_Bounds> bounds;
+    std::vector<MeshletAabb> aabbs;
+    std::vector<uint32_t> vertices;
+    std::vector<uint8_t> triangles;
+};
+
+// Build meshlets out of `indices` and append them to `builder`. The indices
+// can be local to a subset of the vertices, in which case `global_vertices`
+// maps them back.
+void append_meshlets(
+    MeshletBuilder& builder,
+    const uint32_t* indices,
     size_t indices_count,
-    float* positions,
+    const float* positions,
     size_t vertices_count,
-    bool uses_32_bit_indices
+    const MeshletConfig& config,
+    const uint32_t* global_vertices = nullptr
 ) {
-    auto max_vertices = MAX_MESHLET_UNIQUE_VERTICES;
-    auto max_triangles = MAX_MESHLET_TRIANGLES;
-    // Given that I want to render a lot of foliage
-    // which is double-sided and doesn't benefit from
-    // cone culling, we can turn this down.
-    auto cone_weight = 0.25f;
+    size_t max_vertices = config.max_vertices;
+    size_t max_triangles = config.max_triangles;
+
+    auto stride = sizeof(float) * 3;
 
     size_t max_meshlets =
         meshopt_buildMeshletsBound(indices_count, max_vertices, max_triangles);
     std::vector<meshopt_Meshlet> meshlets(max_meshlets);
-    std::vector<unsigned int> meshlet_indices_32bit(
-        max_meshlets * max_vertices
-    );
+    std::vector<unsigned int> meshlet_vertices(max_meshlets * max_vertices);
     std::vector<unsigned char> micro_indices(max_meshlets * max_triangles * 3);
 
-    size_t meshlet_count = 0;
-
-    auto stride = sizeof(float) * 3;
+    size_t meshlet_count = meshopt_buildMeshlets(
+        meshlets.data(),
+        meshlet_vertices.data(),
+        micro_indices.data(),
+        indices,
+        indices_count,
+        positions,
+        vertices_count,
+        stride,
+        max_vertices,
+        max_triangles,
+        config.cone_weight
+    );
 
-    if (uses_32_bit_indices) {
-        meshlet_count = meshopt_buildMeshlets(
-            meshlets.data(),
-            meshlet_indices_32bit.data(),
-            micro_indices.data(),
-            reinterpret_cast<uint32_t*>(indices),
-            indices_count,
-            positions,
-            vertices_count,
-            stride,
-            max_vertices,
-            max_triangles,
-            cone_weight
-        );
-    } else {
-        meshlet_count = meshopt_buildMeshlets(
-            meshlets.data(),
-            meshlet_indices_32bit.data(),
-            micro_indices.data(),
-            reinterpret_cast<uint16_t*>(indices),
-            indices_count,
-            positions,
-            vertices_count,
-            stride,
-            max_vertices,
-            max_triangles,
-            cone_weight
-        );
+    if (meshlet_count == 0) {
+        return;
     }
 
     const meshopt_Meshlet& last = meshlets[meshlet_count - 1];
 
-    meshlet_indices_32bit.resize(last.vertex_offset + last.vertex_count);
+    meshlet_vertices.resize(last.vertex_offset + last.vertex_count);
     micro_indices.resize(
         last.triangle_offset + ((last.triangle_count * 3 + 3) & ~3)
     );
     meshlets.resize(meshlet_count);
 
-    std::vector<meshopt_Bounds> meshlet_bounds(meshlet_count);
+    auto vertex_base = static_cast<uint32_t>(builder.vertices.size());
+    auto triangle_base = static_cast<uint32_t>(builder.triangles.size());
 
-    for (size_t i = 0; i < meshlet_count; i++) {
-        auto meshlet = meshlets[i];
-        meshlet_bounds[i] = meshopt_computeMeshletBounds(
-            &meshlet_indices_32bit[meshlet.vertex_offset],
+    for (auto meshlet : meshlets) {
+        if (config.optimize_vertex_order) {
+            meshopt_optimizeMeshlet(
+                &meshlet_vertices[meshlet.vertex_offset],
+                &micro_indices[meshlet.triangle_offset],
+                meshlet.triangle_count,
+                meshlet.vertex_count
+            );
+        }
+
+        auto bounds = meshopt_computeMeshletBounds(
+            &meshlet_vertices[meshlet.vertex_offset],
             &micro_indices[meshlet.triangle_offset],
             meshlet.triangle_count,
             positions,
@@ -78,63 +127,874 @@ Meshlets build_meshlets(
         );
 
         // This means that I've done something wrong.
-        if (meshlet_bounds[i].radius == 0) {
+        if (bounds.radius == 0) {
             dbg(meshlet.triangle_count,
                 meshlet.vertex_count,
                 meshlet.triangle_offset);
         }
+
+        auto aabb = MeshletAabb {
+            .min = glm::vec3(std::numeric_limits<float>::max()),
+            .max = glm::vec3(std::numeric_limits<float>::lowest())};
+
+        for (uint32_t i = 0; i < meshlet.vertex_count; i++) {
+            auto position = glm::make_vec3(
+                &positions[meshlet_vertices[meshlet.vertex_offset + i] * 3]
+            );
+            aabb.min = glm::min(aabb.min, position);
+            aabb.max = glm::max(aabb.max, position);
+        }
+
+        meshlet.vertex_offset += vertex_base;
+        meshlet.triangle_offset += triangle_base;
+        builder.meshlets.push_back(meshlet);
+        builder.bounds.push_back(bounds);
+        builder.aabbs.push_back(aabb);
     }
 
-    std::vector<Meshlet> final_meshlets(meshlet_count);
+    if (global_vertices) {
+        for (auto& vertex : meshlet_vertices) {
+            vertex = global_vertices[vertex];
+        }
+    }
 
-    for (size_t i = 0; i < meshlet_count; i++) {
-        auto meshlet = meshlets[i];
-        meshopt_Bounds bounds = meshlet_bounds[i];
-        final_meshlets[i] = Meshlet {
-            .cone_apex = glm::vec3(
-                bounds.cone_apex[0],
-                bounds.cone_apex[1],
-                bounds.cone_apex[2]
-            ),
-            .cone_axis = glm::vec3(
-                bounds.cone_axis[0],
-                bounds.cone_axis[1],
-                bounds.cone_axis[2]
+    builder.vertices.insert(
+        builder.vertices.end(),
+        meshlet_vertices.begin(),
+        meshlet_vertices.end()
+    );
+    builder.triangles.insert(
+        builder.triangles.end(),
+        micro_indices.begin(),
+        micro_indices.end()
+    );
+}
+
+// Append everything in `source` to `builder`, moving the offsets along.
+void append_builder(MeshletBuilder& builder, const MeshletBuilder& source) {
+    auto vertex_base = static_cast<uint32_t>(builder.vertices.size());
+    auto triangle_base = static_cast<uint32_t>(builder.triangles.size());
+
+    for (auto meshlet : source.meshlets) {
+        meshlet.vertex_offset += vertex_base;
+        meshlet.triangle_offset += triangle_base;
+        builder.meshlets.push_back(meshlet);
+    }
+
+    builder.bounds.insert(
+        builder.bounds.end(),
+        source.bounds.begin(),
+        source.bounds.end()
+    );
+    builder.aabbs.insert(
+        builder.aabbs.end(),
+        source.aabbs.begin(),
+        source.aabbs.end()
+    );
+    builder.vertices.insert(
+        builder.vertices.end(),
+        source.vertices.begin(),
+        source.vertices.end()
+    );
+    builder.triangles.insert(
+        builder.triangles.end(),
+        source.triangles.begin(),
+        source.triangles.end()
+    );
+}
+
+// Make `indices` index into a copy of just the vertices that they use,
+// written to `local_positions`. Returns the original index of each of those
+// vertices.
+std::vector<uint32_t> compact_vertices(
+    uint32_t* indices,
+    size_t indices_count,
+    const float* positions,
+    std::vector<float>& local_positions
+) {
+    std::vector<uint32_t> local_vertices(indices, indices + indices_count);
+    std::sort(local_vertices.begin(), local_vertices.end());
+    local_vertices.erase(
+        std::unique(local_vertices.begin(), local_vertices.end()),
+        local_vertices.end()
+    );
+
+    local_positions.resize(local_vertices.size() * 3);
+    for (size_t i = 0; i < local_vertices.size(); i++) {
+        std::memcpy(
+            &local_positions[i * 3],
+            &positions[local_vertices[i] * 3],
+            sizeof(float) * 3
+        );
+    }
+
+    for (size_t i = 0; i < indices_count; i++) {
+        indices[i] = static_cast<uint32_t>(
+            std::lower_bound(
+                local_vertices.begin(),
+                local_vertices.end(),
+                indices[i]
+            )
+            - local_vertices.begin()
+        );
+    }
+
+    return local_vertices;
+}
+
+// Spread the low 10 bits of `value` out to every third bit.
+uint32_t spread_bits(uint32_t value) {
+    value &= 0x3ff;
+    value = (value | value << 16) & 0x030000ff;
+    value = (value | value << 8) & 0x0300f00f;
+    value = (value | value << 4) & 0x030c30c3;
+    value = (value | value << 2) & 0x09249249;
+    return value;
+}
+
+// Sort the triangles along a Morton curve through their centers, so that any
+// contiguous range of them covers one compact part of the primitive.
+void sort_triangles_spatially(
+    std::vector<uint32_t>& indices,
+    const float* positions,
+    size_t vertices_count
+) {
+    ZoneScoped;
+
+    auto min = glm::vec3(std::numeric_limits<float>::max());
+    auto max = glm::vec3(std::numeric_limits<float>::lowest());
+
+    for (size_t i = 0; i < vertices_count; i++) {
+        auto position = glm::make_vec3(&positions[i * 3]);
+        min = glm::min(min, position);
+        max = glm::max(max, position);
+    }
+
+    auto scale = 1023.0f / glm::max(max - min, glm::vec3(1e-20f));
+
+    auto triangles_count = indices.size() / 3;
+    // The code in the upper bits and the triangle in the lower bits keeps the
+    // sort stable.
+    std::vector<uint64_t> keys(triangles_count);
+
+    for (size_t i = 0; i < triangles_count; i++) {
+        auto center = (glm::make_vec3(&positions[indices[i * 3] * 3])
+                       + glm::make_vec3(&positions[indices[i * 3 + 1] * 3])
+                       + glm::make_vec3(&positions[indices[i * 3 + 2] * 3]))
+            / 3.0f;
+        auto cell = glm::uvec3((center - min) * scale);
+        auto code = spread_bits(cell.x) | spread_bits(cell.y) << 1
+            | spread_bits(cell.z) << 2;
+        keys[i] = uint64_t(code) << 32 | i;
+    }
+
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<uint32_t> sorted(indices.size());
+
+    for (size_t i = 0; i < triangles_count; i++) {
+        auto triangle = keys[i] & 0xffffffff;
+        std::memcpy(
+            &sorted[i * 3],
+            &indices[triangle * 3],
+            sizeof(uint32_t) * 3
+        );
+    }
+
+    indices = std::move(sorted);
+}
+
+uint16_t pack_half_rounding_up(float value) {
+    auto half = glm::packHalf1x16(value);
+
+    if (glm::unpackHalf1x16(half) < value) {
+        half++;
+    }
+
+    return half;
+}
+
+uint32_t pack_offset_and_count(uint32_t offset, uint32_t count) {
+    if (offset >= MESHLET_MAX_OFFSET || count > MESHLET_COUNT_MASK) {
+        dbg(offset, count);
+        abort();
+    }
+
+    return offset << MESHLET_COUNT_BITS | count;
+}
+
+// Quantize a corner of a meshlet's box to a fraction of the mesh's box,
+// rounding in the direction that only grows the box.
+uint32_t pack_aabb_corner(
+    glm::vec3 corner,
+    const MeshBounds& mesh_bounds,
+    bool round_up
+) {
+    auto size = mesh_bounds.aabb_max - mesh_bounds.aabb_min;
+    auto fraction = (corner - mesh_bounds.aabb_min)
+        / glm::max(size, glm::vec3(std::numeric_limits<float>::min()))
+        * float(MESHLET_AABB_MASK);
+    auto rounded = round_up ? glm::ceil(fraction) : glm::floor(fraction);
+    auto quantized =
+        glm::uvec3(glm::clamp(rounded, 0.0f, float(MESHLET_AABB_MASK)));
+
+    return quantized.x | quantized.y << MESHLET_AABB_BITS
+        | quantized.z << (MESHLET_AABB_BITS * 2);
+}
+
+glm::vec3 unpack_aabb_corner(uint32_t packed, const MeshBounds& mesh_bounds) {
+    auto quantized = glm::uvec3(
+        packed & MESHLET_AABB_MASK,
+        packed >> MESHLET_AABB_BITS & MESHLET_AABB_MASK,
+        packed >> (MESHLET_AABB_BITS * 2) & MESHLET_AABB_MASK
+    );
+    return mesh_bounds.aabb_min
+        + glm::vec3(quantized) * (mesh_bounds.aabb_max - mesh_bounds.aabb_min)
+        / float(MESHLET_AABB_MASK);
+}
+
+// The center relative to the mesh's bounding sphere and the radius, as halfs.
+glm::uvec2 pack_bounding_sphere(
+    glm::vec3 center,
+    float radius,
+    const MeshBounds& mesh_bounds
+) {
+    auto relative_center = center - glm::vec3(mesh_bounds.bounding_sphere);
+
+    auto packed_xy = glm::packHalf2x16(glm::vec2(relative_center));
+    auto unpacked_xy = glm::unpackHalf2x16(packed_xy);
+    auto packed_z = glm::packHalf1x16(relative_center.z);
+    auto unpacked_center =
+        glm::vec3(unpacked_xy, glm::unpackHalf1x16(packed_z));
+
+    // Grow the sphere so that it still contains the meshlet from the rounded
+    // center.
+    radius += glm::distance(unpacked_center, relative_center);
+
+    return glm::uvec2(
+        packed_xy,
+        uint32_t(packed_z) | uint32_t(pack_half_rounding_up(radius)) << 16
+    );
+}
+
+glm::uvec2 pack_aabb(const MeshletAabb& aabb, const MeshBounds& mesh_bounds) {
+    return glm::uvec2(
+        pack_aabb_corner(aabb.min, mesh_bounds, false),
+        pack_aabb_corner(aabb.max, mesh_bounds, true)
+    );
+}
+
+Meshlet pack_meshlet(
+    const meshopt_Meshlet& meshlet,
+    const meshopt_Bounds& bounds,
+    const MeshletAabb& aabb,
+    const MeshBounds& mesh_bounds
+) {
+    auto center = glm::vec3(bounds.center[0], bounds.center[1], bounds.center[2]
+    );
+
+    assert(meshlet.triangle_offset % MESHLET_TRIANGLE_OFFSET_UNIT == 0);
+
+    return Meshlet {
+        .bounding_sphere =
+            pack_bounding_sphere(center, bounds.radius, mesh_bounds),
+        .aabb = pack_aabb(aabb, mesh_bounds),
+        .cone_axis = glm::i8vec3(
+            bounds.cone_axis_s8[0],
+            bounds.cone_axis_s8[1],
+            bounds.cone_axis_s8[2]
+        ),
+        .cone_cutoff = bounds.cone_cutoff_s8,
+        .triangle_offset_and_count = pack_offset_and_count(
+            meshlet.triangle_offset / MESHLET_TRIANGLE_OFFSET_UNIT,
+            meshlet.triangle_count
+        ),
+        .index_offset_and_count =
+            pack_offset_and_count(meshlet.vertex_offset, meshlet.vertex_count)};
+}
+
+uint32_t meshlet_triangle_offset(const Meshlet& meshlet) {
+    return (meshlet.triangle_offset_and_count >> MESHLET_COUNT_BITS)
+        * MESHLET_TRIANGLE_OFFSET_UNIT;
+}
+
+uint32_t meshlet_triangle_count(const Meshlet& meshlet) {
+    return meshlet.triangle_offset_and_count & MESHLET_COUNT_MASK;
+}
+
+uint32_t meshlet_index_offset(const Meshlet& meshlet) {
+    return meshlet.index_offset_and_count >> MESHLET_COUNT_BITS;
+}
+
+glm::vec4 meshlet_bounding_sphere(
+    const Meshlet& meshlet,
+    glm::vec4 mesh_bounding_sphere
+) {
+    auto relative = glm::vec4(
+        glm::unpackHalf2x16(meshlet.bounding_sphere.x),
+        glm::unpackHalf2x16(meshlet.bounding_sphere.y)
+    );
+    return glm::vec4(
+        glm::vec3(mesh_bounding_sphere) + glm::vec3(relative),
+        relative.w
+    );
+}
+
+glm::vec3 meshlet_cone_axis(const Meshlet& meshlet) {
+    return glm::vec3(meshlet.cone_axis) / 127.0f;
+}
+
+float meshlet_cone_cutoff(const Meshlet& meshlet) {
+    return float(meshlet.cone_cutoff) / 127.0f;
+}
+
+void meshlet_aabb(
+    const Meshlet& meshlet,
+    const MeshBounds& mesh_bounds,
+    glm::vec3& aabb_min,
+    glm::vec3& aabb_max
+) {
+    aabb_min = unpack_aabb_corner(meshlet.aabb.x, mesh_bounds);
+    aabb_max = unpack_aabb_corner(meshlet.aabb.y, mesh_bounds);
+}
+
+// A sphere that contains all of `spheres`.
+glm::vec4 merge_spheres(const std::vector<glm::vec4>& spheres) {
+    auto center = glm::vec3(0.0);
+    for (auto& sphere : spheres) {
+        center += glm::vec3(sphere) / float(spheres.size());
+    }
+
+    float radius = 0.0f;
+    for (auto& sphere : spheres) {
+        radius =
+            std::max(radius, glm::distance(center, glm::vec3(sphere)) + sphere.w);
+    }
+
+    return glm::vec4(center, radius);
+}
+
+// Simplify the meshlets in `builder` level by level if `config.build_lods` is
+// set. Otherwise every meshlet is its own root.
+std::vector<MeshletLod> build_meshlet_lods(
+    MeshletBuilder& builder,
+    const float* positions,
+    const MeshletConfig& config
+) {
+    ZoneScoped;
+
+    std::vector<MeshletLod> lods;
+    std::vector<size_t> level;
+
+    for (size_t i = 0; i < builder.meshlets.size(); i++) {
+        auto& bounds = builder.bounds[i];
+        auto sphere = glm::vec4(
+            bounds.center[0],
+            bounds.center[1],
+            bounds.center[2],
+            bounds.radius
+        );
+        lods.push_back(MeshletLod {
+            .bounding_sphere = sphere,
+            .parent_bounding_sphere = sphere,
+            .error = 0.0f,
+            .parent_error = std::numeric_limits<float>::max()});
+        level.push_back(i);
+    }
+
+    // A group's simplified meshlets, or none if it's left as a root.
+    struct SimplifiedGroup {
+        MeshletBuilder builder;
+        glm::vec4 bounding_sphere;
+        float error;
+    };
+
+    while (config.build_lods && level.size() > 1) {
+        std::vector<size_t> next_level;
+
+        // meshoptimizer builds meshlets in a spatially coherent order, so
+        // meshlets that are next to each other in the list are usually next
+        // to each other in the mesh.
+        auto groups_count = (level.size() + MESHLET_LOD_GROUP_SIZE - 1)
+            / MESHLET_LOD_GROUP_SIZE;
+        std::vector<SimplifiedGroup> groups(groups_count);
+
+        // Groups only read the current level, so they can all be simplified
+        // at once and then appended in order.
+        parallel_for(groups_count, [&](size_t group) {
+            auto group_start = group * MESHLET_LOD_GROUP_SIZE;
+            auto group_end =
+                std::min(group_start + MESHLET_LOD_GROUP_SIZE, level.size());
+
+            std::vector<uint32_t> group_indices;
+            std::vector<glm::vec4> spheres;
+            float child_error = 0.0f;
+
+            for (size_t i = group_start; i < group_end; i++) {
+                auto& meshlet = builder.meshlets[level[i]];
+                auto* vertices = &builder.vertices[meshlet.vertex_offset];
+                auto* triangles = &builder.triangles[meshlet.triangle_offset];
+
+                for (uint32_t j = 0; j < meshlet.triangle_count * 3; j++) {
+                    group_indices.push_back(vertices[triangles[j]]);
+                }
+                spheres.push_back(lods[level[i]].bounding_sphere);
+                child_error = std::max(child_error, lods[level[i]].error);
+            }
+
+            // Work on just the group's vertices, so that simplifying a group
+            // doesn't cost as much as the whole primitive.
+            std::vector<float> local_positions;
+            auto group_vertices = compact_vertices(
+                group_indices.data(),
+                group_indices.size(),
+                positions,
+                local_positions
+            );
+
+            // The edges shared with other groups are on the border of the
+            // group, so locking the border keeps the levels free of cracks.
+            auto target_count = (group_indices.size() / 2) / 3 * 3;
+            float relative_error = 0.0f;
+            std::vector<uint32_t> simplified(group_indices.size());
+            simplified.resize(meshopt_simplify(
+                simplified.data(),
+                group_indices.data(),
+                group_indices.size(),
+                local_positions.data(),
+                group_vertices.size(),
+                sizeof(float) * 3,
+                target_count,
+                std::numeric_limits<float>::max(),
+                meshopt_SimplifyLockBorder,
+                &relative_error
+            ));
+
+            // Leave groups that barely simplify as roots.
+            if (simplified.empty()
+                || simplified.size() > group_indices.size() * 85 / 100) {
+                return;
+            }
+
+            // Errors have to grow with every level, so that a parent is
+            // never picked over a child that would already have been enough.
+            groups[group].error = child_error
+                + relative_error
+                    * meshopt_simplifyScale(
+                        local_positions.data(),
+                        group_vertices.size(),
+                        sizeof(float) * 3
+                    );
+            groups[group].bounding_sphere = merge_spheres(spheres);
+
+            append_meshlets(
+                groups[group].builder,
+                simplified.data(),
+                simplified.size(),
+                local_positions.data(),
+                group_vertices.size(),
+                config,
+                group_vertices.data()
+            );
+        });
+
+        for (size_t group = 0; group < groups_count; group++) {
+            auto& simplified = groups[group];
+
+            if (simplified.builder.meshlets.empty()) {
+                continue;
+            }
+
+            auto group_start = group * MESHLET_LOD_GROUP_SIZE;
+            auto group_end =
+                std::min(group_start + MESHLET_LOD_GROUP_SIZE, level.size());
+
+            for (size_t i = group_start; i < group_end; i++) {
+                lods[level[i]].parent_bounding_sphere =
+                    simplified.bounding_sphere;
+                lods[level[i]].parent_error = simplified.error;
+            }
+
+            auto first_new = builder.meshlets.size();
+
+            append_builder(builder, simplified.builder);
+
+            for (auto i = first_new; i < builder.meshlets.size(); i++) {
+                lods.push_back(MeshletLod {
+                    .bounding_sphere = simplified.bounding_sphere,
+                    .parent_bounding_sphere = simplified.bounding_sphere,
+                    .error = simplified.error,
+                    .parent_error = std::numeric_limits<float>::max()});
+                next_level.push_back(i);
+            }
+        }
+
+        if (next_level.size() >= level.size()) {
+            break;
+        }
+
+        level = std::move(next_level);
+    }
+
+    return lods;
+}
+
+// Bounds that contain the meshlets from `first` up to `last`.
+MeshBounds
+meshlet_range_bounds(const MeshletBuilder& builder, size_t first, size_t last) {
+    std::vector<glm::vec4> spheres;
+    auto aabb = builder.aabbs[first];
+
+    for (auto i = first; i < last; i++) {
+        auto& bounds = builder.bounds[i];
+        spheres.push_back(glm::vec4(
+            bounds.center[0],
+            bounds.center[1],
+            bounds.center[2],
+            bounds.radius
+        ));
+        aabb.min = glm::min(aabb.min, builder.aabbs[i].min);
+        aabb.max = glm::max(aabb.max, builder.aabbs[i].max);
+    }
+
+    return MeshBounds {
+        .bounding_sphere = merge_spheres(spheres),
+        .aabb_min = aabb.min,
+        .aabb_max = aabb.max};
+}
+
+// Bound every `MESHLET_GROUP_SIZE` consecutive meshlets of a part. The chunks
+// are sorted spatially and meshoptimizer builds meshlets by walking across
+// the mesh, so consecutive meshlets are mostly neighbours.
+void append_meshlet_groups(
+    std::vector<MeshletGroup>& groups,
+    const MeshletBuilder& builder,
+    const std::vector<MeshletLod>& lods,
+    const MeshletPart& part
+) {
+    auto part_end = size_t(part.first_meshlet) + part.num_meshlets;
+
+    for (size_t first = part.first_meshlet; first < part_end;
+         first += MESHLET_GROUP_SIZE) {
+        auto last = std::min(first + MESHLET_GROUP_SIZE, part_end);
+        auto bounds = meshlet_range_bounds(builder, first, last);
+
+        std::vector<glm::vec4> lod_spheres;
+        std::vector<glm::vec4> lod_parent_spheres;
+        float lod_min_error = std::numeric_limits<float>::max();
+        float lod_max_parent_error = 0.0f;
+
+        for (auto i = first; i < last; i++) {
+            lod_spheres.push_back(lods[i].bounding_sphere);
+            lod_parent_spheres.push_back(lods[i].parent_bounding_sphere);
+            lod_min_error = std::min(lod_min_error, lods[i].error);
+            lod_max_parent_error =
+                std::max(lod_max_parent_error, lods[i].parent_error);
+        }
+
+        groups.push_back(MeshletGroup {
+            .bounding_sphere = pack_bounding_sphere(
+                glm::vec3(bounds.bounding_sphere),
+                bounds.bounding_sphere.w,
+                part.bounds
             ),
-            .cone_cutoff = bounds.cone_cutoff,
-            .bounding_sphere = glm::vec4(
-                bounds.center[0],
-                bounds.center[1],
-                bounds.center[2],
-                bounds.radius
+            .aabb = pack_aabb(
+                MeshletAabb {.min = bounds.aabb_min, .max = bounds.aabb_max},
+                part.bounds
             ),
-            .triangle_offset = meshlet.triangle_offset,
-            .index_offset = meshlet.vertex_offset,
-            .triangle_count = static_cast<uint8_t>(meshlet.triangle_count),
-            .index_count = static_cast<uint8_t>(meshlet.vertex_count)};
+            .lod_bounding_sphere = merge_spheres(lod_spheres),
+            .lod_parent_bounding_sphere = merge_spheres(lod_parent_spheres),
+            .lod_min_error = lod_min_error,
+            .lod_max_parent_error = lod_max_parent_error});
+    }
+}
+
+// Split the meshlets into `MESHLET_PART_SIZE` ranges. A primitive that fits
+// in one part keeps `mesh_bounds`, otherwise each part is bounded by its own
+// meshlets.
+std::vector<MeshletPart> split_meshlet_parts(
+    const MeshletBuilder& builder,
+    const MeshBounds& mesh_bounds,
+    bool uses_32_bit_indices
+) {
+    // How many indices make up 16 bytes.
+    uint32_t index_alignment = uses_32_bit_indices ? 4 : 8;
+
+    auto meshlet_count = builder.meshlets.size();
+    auto parts_count = std::max(
+        size_t(1),
+        (meshlet_count + MESHLET_PART_SIZE - 1) / MESHLET_PART_SIZE
+    );
+
+    std::vector<MeshletPart> parts(parts_count);
+
+    for (size_t i = 0; i < parts_count; i++) {
+        auto first = i * MESHLET_PART_SIZE;
+        auto last = std::min(first + MESHLET_PART_SIZE, meshlet_count);
+
+        parts[i] = MeshletPart {
+            .bounds = parts_count == 1
+                ? mesh_bounds
+                : meshlet_range_bounds(builder, first, last),
+            .first_meshlet = static_cast<uint32_t>(first),
+            .num_meshlets = static_cast<uint32_t>(last - first)};
+
+        if (first < last) {
+            // Rounded down so that the part's indices stay 16 byte aligned
+            // for either index size.
+            auto& meshlet = builder.meshlets[first];
+            parts[i].index_offset =
+                meshlet.vertex_offset / index_alignment * index_alignment;
+            parts[i].micro_index_offset = meshlet.triangle_offset;
+        }
+    }
+
+    return parts;
+}
+
+Meshlets build_meshlets(
+    const uint8_t* indices,
+    size_t indices_count,
+    const float* positions,
+    size_t vertices_count,
+    bool uses_32_bit_indices,
+    const MeshBounds& mesh_bounds,
+    const MeshletConfig& config
+) {
+    auto stride = sizeof(float) * 3;
+
+    std::vector<uint32_t> indices_32bit(indices_count);
+    for (size_t i = 0; i < indices_count; i++) {
+        indices_32bit[i] = uses_32_bit_indices
+            ? reinterpret_cast<const uint32_t*>(indices)[i]
+            : reinterpret_cast<const uint16_t*>(indices)[i];
+    }
+
+    auto triangles_count = indices_count / 3;
+    auto chunks_count = (triangles_count + MESHLET_CHUNK_TRIANGLES - 1)
+        / MESHLET_CHUNK_TRIANGLES;
+
+    if (chunks_count > 1) {
+        sort_triangles_spatially(indices_32bit, positions, vertices_count);
+    }
+
+    // Chunks only touch their own range of the indices, and each only
+    // allocates meshoptimizer's worst case for its own triangles.
+    std::vector<MeshletBuilder> chunks(chunks_count);
+
+    parallel_for(chunks_count, [&](size_t i) {
+        ZoneScopedN("meshlet chunk");
+
+        auto* chunk_indices = &indices_32bit[i * MESHLET_CHUNK_TRIANGLES * 3];
+        auto chunk_indices_count = std::min(
+            MESHLET_CHUNK_TRIANGLES * 3,
+            indices_count - i * MESHLET_CHUNK_TRIANGLES * 3
+        );
+
+        auto* chunk_positions = positions;
+        auto chunk_vertices_count = vertices_count;
+        std::vector<float> local_positions;
+        std::vector<uint32_t> chunk_vertices;
+
+        if (chunks_count > 1) {
+            chunk_vertices = compact_vertices(
+                chunk_indices,
+                chunk_indices_count,
+                positions,
+                local_positions
+            );
+            chunk_positions = local_positions.data();
+            chunk_vertices_count = chunk_vertices.size();
+        }
+
+        if (config.optimize_vertex_order) {
+            meshopt_optimizeVertexCache(
+                chunk_indices,
+                chunk_indices,
+                chunk_indices_count,
+                chunk_vertices_count
+            );
+        }
+
+        append_meshlets(
+            chunks[i],
+            chunk_indices,
+            chunk_indices_count,
+            chunk_positions,
+            chunk_vertices_count,
+            config,
+            chunk_vertices.empty() ? nullptr : chunk_vertices.data()
+        );
+    });
+
+    MeshletBuilder builder;
+
+    for (auto& chunk : chunks) {
+        append_builder(builder, chunk);
+    }
+
+    chunks.clear();
+
+    std::vector<uint32_t> vertex_remap;
+    std::vector<float> remapped_positions;
+
+    if (config.optimize_vertex_order) {
+        ZoneScopedN("optimize vertex order");
+
+        // Put the vertices in the order that the meshlets fetch them in.
+        vertex_remap.resize(vertices_count);
+        auto next_vertex = meshopt_optimizeVertexFetchRemap(
+            vertex_remap.data(),
+            builder.vertices.data(),
+            builder.vertices.size(),
+            vertices_count
+        );
+
+        // Unreferenced vertices are left out of the remap. Put them at the
+        // end so that the vertex count stays the same.
+        for (auto& index : vertex_remap) {
+            if (index == ~0u) {
+                index = static_cast<uint32_t>(next_vertex);
+                next_vertex++;
+            }
+        }
+
+        for (auto& vertex : builder.vertices) {
+            vertex = vertex_remap[vertex];
+        }
+
+        remapped_positions.resize(vertices_count * 3);
+        meshopt_remapVertexBuffer(
+            remapped_positions.data(),
+            positions,
+            vertices_count,
+            stride,
+            vertex_remap.data()
+        );
+
+        positions = remapped_positions.data();
+    }
+
+    auto lods = build_meshlet_lods(builder, positions, config);
+    auto parts =
+        split_meshlet_parts(builder, mesh_bounds, uses_32_bit_indices);
+
+    std::vector<Meshlet> final_meshlets(builder.meshlets.size());
+    std::vector<MeshletGroup> groups;
+
+    for (auto& part : parts) {
+        for (auto i = part.first_meshlet;
+             i < part.first_meshlet + part.num_meshlets;
+             i++) {
+            // Meshlets are appended along with their indices, so the offsets
+            // never go backwards.
+            auto meshlet = builder.meshlets[i];
+            assert(meshlet.vertex_offset >= part.index_offset);
+            assert(meshlet.triangle_offset >= part.micro_index_offset);
+            meshlet.vertex_offset -= part.index_offset;
+            meshlet.triangle_offset -= part.micro_index_offset;
+
+            final_meshlets[i] = pack_meshlet(
+                meshlet,
+                builder.bounds[i],
+                builder.aabbs[i],
+                part.bounds
+            );
+        }
+
+        append_meshlet_groups(groups, builder, lods, part);
     }
 
     if (uses_32_bit_indices) {
         return {
             .meshlets = final_meshlets,
-            .micro_indices = micro_indices,
-            .indices_32bit = meshlet_indices_32bit,
-            .indices_16bit = {}};
+            .micro_indices = std::move(builder.triangles),
+            .indices_32bit = std::move(builder.vertices),
+            .indices_16bit = {},
+            .vertex_remap = std::move(vertex_remap),
+            .lods = std::move(lods),
+            .groups = std::move(groups),
+            .parts = std::move(parts)};
     } else {
         // No need to use 32-bit indices.
-        std::vector<uint16_t> meshlet_indices_16bit(meshlet_indices_32bit.size()
-        );
+        std::vector<uint16_t> meshlet_indices_16bit(builder.vertices.size());
 
-        for (size_t i = 0; i < meshlet_indices_32bit.size(); i++) {
-            auto index = meshlet_indices_32bit[i];
+        for (size_t i = 0; i < builder.vertices.size(); i++) {
+            auto index = builder.vertices[i];
             assert(index < (1 << 16));
             meshlet_indices_16bit[i] = index;
         }
 
         return {
             .meshlets = final_meshlets,
-            .micro_indices = micro_indices,
+            .micro_indices = std::move(builder.triangles),
             .indices_32bit = {},
-            .indices_16bit = meshlet_indices_16bit};
+            .indices_16bit = meshlet_indices_16bit,
+            .vertex_remap = std::move(vertex_remap),
+            .lods = std::move(lods),
+            .groups = std::move(groups),
+            .parts = std::move(parts)};
     }
 }
+
+void remap_vertices(
+    void* destination,
+    const void* source,
+    size_t vertices_count,
+    size_t stride,
+    const std::vector<uint32_t>& vertex_remap
+) {
+    if (vertex_remap.empty()) {
+        std::memcpy(destination, source, vertices_count * stride);
+        return;
+    }
+
+    assert(vertex_remap.size() == vertices_count);
+
+    meshopt_remapVertexBuffer(
+        destination,
+        source,
+        vertices_count,
+        stride,
+        vertex_remap.data()
+    );
+}
+
+meshopt_VertexFetchStatistics meshlet_vertex_fetch_statistics(
+    const Meshlets& meshlets,
+    size_t vertices_count,
+    size_t stride
+) {
+    // Expand the micro indices into the vertex indices that the shaders end
+    // up loading.
+    std::vector<uint32_t> fetched_indices;
+
+    for (auto& part : meshlets.parts) {
+        for (auto j = part.first_meshlet;
+             j < part.first_meshlet + part.num_meshlets;
+             j++) {
+            auto& meshlet = meshlets.meshlets[j];
+            auto triangle_offset =
+                part.micro_index_offset + meshlet_triangle_offset(meshlet);
+            auto index_offset =
+                part.index_offset + meshlet_index_offset(meshlet);
+
+            for (uint32_t i = 0; i < meshlet_triangle_count(meshlet) * 3; i++) {
+                auto index = index_offset
+                    + meshlets.micro_indices[triangle_offset + i];
+                fetched_indices.push_back(
+                    meshlets.indices_32bit.empty()
+                        ? meshlets.indices_16bit[index]
+                        : meshlets.indices_32bit[index]
+                );
+            }
+        }
+    }
+
+    return meshopt_analyzeVertexFetch(
+        fetched_indices.data(),
+        fetched_indices.size(),
+        vertices_count,
+        stride
+    );
+}
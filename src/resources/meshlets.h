@@ -1,4 +1,25 @@
 #include "../shared_cpu_gpu.h"
+#include "position_kernels.h"
+
+// `MeshInfo::num_meshlets` and `MeshletReference::meshlet_index` are 16 bits,
+// so primitives with more meshlets than this are split into parts that each
+// get their own `MeshInfo`, pointing into the same buffers. Whole groups fit in
+// a part.
+const static uint32_t MESHLET_PART_SIZE =
+    ((1 << 16) - 1) / MESHLET_GROUP_SIZE * MESHLET_GROUP_SIZE;
+
+// A range of meshlets that gets its own `MeshInfo`. The meshlets' bounds are
+// relative to the part's bounds and their offsets are relative to the part's
+// offsets, so the part's `MeshInfo` points at its own range of the meshlets,
+// groups, LODs, indices and micro indices.
+struct MeshletPart {
+    MeshBounds bounds;
+    uint32_t first_meshlet;
+    uint32_t num_meshlets;
+    uint32_t index_offset = 0;
+    // In bytes.
+    uint32_t micro_index_offset = 0;
+};
 
 struct Meshlets {
     std::vector<Meshlet> meshlets;
@@ -9,12 +30,108 @@ struct Meshlets {
     // This is the new index buffer.
     std::vector<uint32_t> indices_32bit;
     std::vector<uint16_t> indices_16bit;
+
+    // Where each of the primitive's vertices has been moved to. Empty if the
+    // vertices keep their original order.
+    std::vector<uint32_t> vertex_remap;
+
+    // One per meshlet.
+    std::vector<MeshletLod> lods;
+
+    // One per `MESHLET_GROUP_SIZE` meshlets of each part.
+    std::vector<MeshletGroup> groups;
+
+    std::vector<MeshletPart> parts;
+};
+
+// How meshlets are built. The shaders read the counts out of each meshlet, so
+// only the CPU side needs to know about any of this.
+struct MeshletConfig {
+    // meshoptimizer needs the triangle count to be a multiple of 4, and both
+    // counts have to fit in `MESHLET_COUNT_BITS`.
+    uint32_t max_vertices = MAX_MESHLET_UNIQUE_VERTICES;
+    uint32_t max_triangles = MAX_MESHLET_TRIANGLES;
+    // Given that I want to render a lot of foliage
+    // which is double-sided and doesn't benefit from
+    // cone culling, we can turn this down.
+    float cone_weight = 0.25f;
+    // Reorder the triangles for the vertex cache before building meshlets,
+    // the triangles within each meshlet afterwards and the vertices for the
+    // order the meshlets fetch them in. The vertex streams then need to go
+    // through `remap_vertices`.
+    bool optimize_vertex_order = true;
+    // After building the full detail meshlets, keep grouping neighbouring
+    // meshlets, simplifying each group to half its triangles and building new
+    // meshlets out of the result, until there's nothing left to simplify. The
+    // simplified meshlets are appended after the full detail ones.
+    bool build_lods = true;
+
+    // Meshlets built with different configs can't share cache entries.
+    std::string cache_key() const;
+
+    // The config that scenes are loaded and baked with, which can be changed
+    // with `--meshlet-config` before anything is loaded.
+    static MeshletConfig& global();
 };
 
+// Parse `<max vertices>,<max triangles>,<cone weight>`. Returns nothing if
+// it's malformed or out of range.
+std::optional<MeshletConfig> parse_meshlet_config(const std::string& string);
+
+// Primitives with more triangles than this are sorted spatially and split
+// into chunks of this many triangles, which are meshletized in parallel.
+const static size_t MESHLET_CHUNK_TRIANGLES = 1 << 16;
+
+// How many meshlets are simplified together.
+const static size_t MESHLET_LOD_GROUP_SIZE = 4;
+
+// Bump whenever `Meshlet`, `MeshletLod`, `MeshletGroup` or `MeshletPart` or
+// how they're built changes, so that stale cache entries aren't used.
+const static uint32_t MESHLET_CACHE_VERSION = 9;
+
+// Meshlet bounding spheres and boxes are stored relative to their part's
+// bounds, which are `mesh_bounds` for primitives that fit in one part.
 Meshlets build_meshlets(
-    uint8_t* indices,
+    const uint8_t* indices,
     size_t indices_count,
-    float* positions,
+    const float* positions,
+    size_t vertices_count,
+    bool uses_32_bit_indices,
+    const MeshBounds& mesh_bounds,
+    const MeshletConfig& config = MeshletConfig::global()
+);
+
+// The CPU side of `common/meshlets.glsl`.
+uint32_t meshlet_triangle_offset(const Meshlet& meshlet);
+uint32_t meshlet_triangle_count(const Meshlet& meshlet);
+uint32_t meshlet_index_offset(const Meshlet& meshlet);
+glm::vec4 meshlet_bounding_sphere(
+    const Meshlet& meshlet,
+    glm::vec4 mesh_bounding_sphere
+);
+glm::vec3 meshlet_cone_axis(const Meshlet& meshlet);
+float meshlet_cone_cutoff(const Meshlet& meshlet);
+void meshlet_aabb(
+    const Meshlet& meshlet,
+    const MeshBounds& mesh_bounds,
+    glm::vec3& aabb_min,
+    glm::vec3& aabb_max
+);
+
+// Copy a vertex stream into the order given by `Meshlets::vertex_remap`.
+// `destination` and `source` can't overlap.
+void remap_vertices(
+    void* destination,
+    const void* source,
+    size_t vertices_count,
+    size_t stride,
+    const std::vector<uint32_t>& vertex_remap
+);
+
+// The vertex fetches made by rendering the meshlets in order, per byte of
+// vertex stream.
+meshopt_VertexFetchStatistics meshlet_vertex_fetch_statistics(
+    const Meshlets& meshlets,
     size_t vertices_count,
-    bool uses_32_bit_indices
+    size_t stride
 );
@@ -0,0 +1,459 @@
+#include "position_kernels.h"
+
+// Each instruction set gets its own target attribute, so that the rest of
+// the program can still run on CPUs without them.
+#if defined(__SSE2__) && defined(__GNUC__)
+#define X86_KERNELS 1
+#define TARGET(target_name) __attribute__((target(target_name)))
+#endif
+
+KernelLevel detected_kernel_level() {
+#if defined(X86_KERNELS)
+    static auto level = __builtin_cpu_supports("avx2") ? KernelLevel::Avx2
+        : __builtin_cpu_supports("sse4.1")             ? KernelLevel::Sse41
+                                                       : KernelLevel::Scalar;
+    return level;
+#else
+    return KernelLevel::Scalar;
+#endif
+}
+
+const char* kernel_level_name(KernelLevel level) {
+    switch (level) {
+        case KernelLevel::Scalar:
+            return "scalar";
+        case KernelLevel::Sse41:
+            return "sse4.1";
+        case KernelLevel::Avx2:
+            return "avx2";
+    }
+
+    return "unknown";
+}
+
+void dequantize_positions_scalar(
+    const uint16_t* padded,
+    float* positions,
+    size_t begin,
+    size_t count
+) {
+    for (size_t i = begin; i < count; i++) {
+        positions[i * 3] = float(padded[i * 4]);
+        positions[i * 3 + 1] = float(padded[i * 4 + 1]);
+        positions[i * 3 + 2] = float(padded[i * 4 + 2]);
+    }
+}
+
+struct Sphere {
+    float center[3];
+    float radius;
+};
+
+// The indices of the first points with the smallest and largest value along
+// each axis.
+struct Extremes {
+    size_t min[3] = {0, 0, 0};
+    size_t max[3] = {0, 0, 0};
+};
+
+void find_extremes_scalar(
+    const uint16_t* padded,
+    size_t begin,
+    size_t count,
+    Extremes& extremes
+) {
+    for (size_t i = begin; i < count; i++) {
+        for (size_t axis = 0; axis < 3; axis++) {
+            auto value = padded[i * 4 + axis];
+
+            if (value < padded[extremes.min[axis] * 4 + axis]) {
+                extremes.min[axis] = i;
+            }
+            if (value > padded[extremes.max[axis] * 4 + axis]) {
+                extremes.max[axis] = i;
+            }
+        }
+    }
+}
+
+// Use the longest of the axis-aligned extreme pairs as the initial diameter.
+Sphere initial_sphere(const uint16_t* padded, const Extremes& extremes) {
+    float max_distance_2 = 0;
+    size_t max_axis = 0;
+
+    for (size_t axis = 0; axis < 3; axis++) {
+        auto p1 = &padded[extremes.min[axis] * 4];
+        auto p2 = &padded[extremes.max[axis] * 4];
+
+        float dx = float(p2[0]) - float(p1[0]);
+        float dy = float(p2[1]) - float(p1[1]);
+        float dz = float(p2[2]) - float(p1[2]);
+        float distance_2 = dx * dx + dy * dy + dz * dz;
+
+        if (distance_2 > max_distance_2) {
+            max_distance_2 = distance_2;
+            max_axis = axis;
+        }
+    }
+
+    auto p1 = &padded[extremes.min[max_axis] * 4];
+    auto p2 = &padded[extremes.max[max_axis] * 4];
+
+    return Sphere {
+        .center =
+            {(float(p1[0]) + float(p2[0])) / 2,
+             (float(p1[1]) + float(p2[1])) / 2,
+             (float(p1[2]) + float(p2[2])) / 2},
+        .radius = sqrtf(max_distance_2) / 2};
+}
+
+// Iteratively grow the sphere until all the points fit.
+void grow_sphere_scalar(
+    const uint16_t* padded,
+    size_t begin,
+    size_t count,
+    Sphere& sphere
+) {
+    for (size_t i = begin; i < count; i++) {
+        float p[3] = {
+            float(padded[i * 4]),
+            float(padded[i * 4 + 1]),
+            float(padded[i * 4 + 2])};
+
+        float dx = p[0] - sphere.center[0];
+        float dy = p[1] - sphere.center[1];
+        float dz = p[2] - sphere.center[2];
+        float distance_2 = dx * dx + dy * dy + dz * dz;
+
+        if (distance_2 > sphere.radius * sphere.radius) {
+            float distance = sqrtf(distance_2);
+            assert(distance > 0);
+
+            float k = 0.5f + (sphere.radius / distance) / 2;
+
+            sphere.center[0] = sphere.center[0] * k + p[0] * (1 - k);
+            sphere.center[1] = sphere.center[1] * k + p[1] * (1 - k);
+            sphere.center[2] = sphere.center[2] * k + p[2] * (1 - k);
+            sphere.radius = (sphere.radius + distance) / 2;
+        }
+    }
+}
+
+#if defined(X86_KERNELS)
+
+TARGET("sse4.1")
+void dequantize_positions_sse41(
+    const uint16_t* padded,
+    float* positions,
+    size_t count
+) {
+    size_t i = 0;
+
+    // Each store writes 4 floats but only advances by 3, so stop while
+    // there's still room for the overhang.
+    for (; i + 2 <= count; i++) {
+        auto values = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(padded + i * 4))
+        ));
+        _mm_storeu_ps(positions + i * 3, values);
+    }
+
+    dequantize_positions_scalar(padded, positions, i, count);
+}
+
+TARGET("avx2")
+void dequantize_positions_avx2(
+    const uint16_t* padded,
+    float* positions,
+    size_t count
+) {
+    size_t i = 0;
+
+    // Move the second point down next to the first.
+    const auto pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+    // Same overhang as above, but with 8 floats written for every 6.
+    for (; i + 3 <= count; i += 2) {
+        auto values = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(padded + i * 4))
+        ));
+        _mm256_storeu_ps(
+            positions + i * 3,
+            _mm256_permutevar8x32_ps(values, pack)
+        );
+    }
+
+    dequantize_positions_scalar(padded, positions, i, count);
+}
+
+// Track the extremes per lane, keeping the first index on ties so that the
+// result matches the scalar code.
+TARGET("sse4.1")
+void find_extremes_sse41(
+    const uint16_t* padded,
+    size_t count,
+    Extremes& extremes
+) {
+    auto min_values = _mm_set1_epi32(std::numeric_limits<int32_t>::max());
+    auto max_values = _mm_set1_epi32(-1);
+    auto min_indices = _mm_setzero_si128();
+    auto max_indices = _mm_setzero_si128();
+    auto indices = _mm_setzero_si128();
+    const auto one = _mm_set1_epi32(1);
+
+    for (size_t i = 0; i < count; i++) {
+        auto values = _mm_cvtepu16_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(padded + i * 4))
+        );
+
+        auto less = _mm_cmpgt_epi32(min_values, values);
+        min_values = _mm_blendv_epi8(min_values, values, less);
+        min_indices = _mm_blendv_epi8(min_indices, indices, less);
+
+        auto greater = _mm_cmpgt_epi32(values, max_values);
+        max_values = _mm_blendv_epi8(max_values, values, greater);
+        max_indices = _mm_blendv_epi8(max_indices, indices, greater);
+
+        indices = _mm_add_epi32(indices, one);
+    }
+
+    alignas(16) int32_t min_index_lanes[4];
+    alignas(16) int32_t max_index_lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(min_index_lanes), min_indices);
+    _mm_store_si128(reinterpret_cast<__m128i*>(max_index_lanes), max_indices);
+
+    for (size_t axis = 0; axis < 3; axis++) {
+        extremes.min[axis] = size_t(min_index_lanes[axis]);
+        extremes.max[axis] = size_t(max_index_lanes[axis]);
+    }
+}
+
+// Two points per register, one in each 128 bit half.
+TARGET("avx2")
+size_t find_extremes_avx2(
+    const uint16_t* padded,
+    size_t count,
+    Extremes& extremes
+) {
+    auto min_values = _mm256_set1_epi32(std::numeric_limits<int32_t>::max());
+    auto max_values = _mm256_set1_epi32(-1);
+    auto min_indices = _mm256_setzero_si256();
+    auto max_indices = _mm256_setzero_si256();
+    auto indices = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+    const auto two = _mm256_set1_epi32(2);
+
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        auto values = _mm256_cvtepu16_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(padded + i * 4))
+        );
+
+        auto less = _mm256_cmpgt_epi32(min_values, values);
+        min_values = _mm256_blendv_epi8(min_values, values, less);
+        min_indices = _mm256_blendv_epi8(min_indices, indices, less);
+
+        auto greater = _mm256_cmpgt_epi32(values, max_values);
+        max_values = _mm256_blendv_epi8(max_values, values, greater);
+        max_indices = _mm256_blendv_epi8(max_indices, indices, greater);
+
+        indices = _mm256_add_epi32(indices, two);
+    }
+
+    alignas(32) int32_t min_value_lanes[8];
+    alignas(32) int32_t max_value_lanes[8];
+    alignas(32) int32_t min_index_lanes[8];
+    alignas(32) int32_t max_index_lanes[8];
+    _mm256_store_si256(
+        reinterpret_cast<__m256i*>(min_value_lanes),
+        min_values
+    );
+    _mm256_store_si256(
+        reinterpret_cast<__m256i*>(max_value_lanes),
+        max_values
+    );
+    _mm256_store_si256(
+        reinterpret_cast<__m256i*>(min_index_lanes),
+        min_indices
+    );
+    _mm256_store_si256(
+        reinterpret_cast<__m256i*>(max_index_lanes),
+        max_indices
+    );
+
+    // Merge the even and odd points.
+    for (size_t axis = 0; axis < 3; axis++) {
+        auto odd = axis + 4;
+
+        auto take_odd_min = min_value_lanes[odd] < min_value_lanes[axis]
+            || (min_value_lanes[odd] == min_value_lanes[axis]
+                && min_index_lanes[odd] < min_index_lanes[axis]);
+        extremes.min[axis] =
+            size_t(min_index_lanes[take_odd_min ? odd : axis]);
+
+        auto take_odd_max = max_value_lanes[odd] > max_value_lanes[axis]
+            || (max_value_lanes[odd] == max_value_lanes[axis]
+                && max_index_lanes[odd] < max_index_lanes[axis]);
+        extremes.max[axis] =
+            size_t(max_index_lanes[take_odd_max ? odd : axis]);
+    }
+
+    return i;
+}
+
+// Check whether any point is outside of the sphere with SIMD, and only fall
+// back to the scalar code for the points that might grow it. The distances
+// are summed in the same order as the scalar code, so the decisions match.
+TARGET("sse4.1")
+void grow_sphere_sse41(const uint16_t* padded, size_t count, Sphere& sphere) {
+    const auto xyz = _mm_setr_epi32(-1, -1, -1, 0);
+
+    for (size_t i = 0; i < count; i++) {
+        auto values = _mm_cvtepi32_ps(_mm_and_si128(
+            _mm_cvtepu16_epi32(_mm_loadl_epi64(
+                reinterpret_cast<const __m128i*>(padded + i * 4)
+            )),
+            xyz
+        ));
+        auto center = _mm_setr_ps(
+            sphere.center[0],
+            sphere.center[1],
+            sphere.center[2],
+            0.0f
+        );
+        auto offset = _mm_sub_ps(values, center);
+        auto squared = _mm_mul_ps(offset, offset);
+        auto sums = _mm_hadd_ps(squared, squared);
+        sums = _mm_hadd_ps(sums, sums);
+
+        if (_mm_cvtss_f32(sums) > sphere.radius * sphere.radius) {
+            grow_sphere_scalar(padded, i, i + 1, sphere);
+        }
+    }
+}
+
+TARGET("avx2")
+size_t grow_sphere_avx2(const uint16_t* padded, size_t count, Sphere& sphere) {
+    const auto xyz = _mm256_setr_epi32(-1, -1, -1, 0, -1, -1, -1, 0);
+
+    auto center = _mm256_setr_ps(
+        sphere.center[0],
+        sphere.center[1],
+        sphere.center[2],
+        0.0f,
+        sphere.center[0],
+        sphere.center[1],
+        sphere.center[2],
+        0.0f
+    );
+    auto radius_2 = _mm256_set1_ps(sphere.radius * sphere.radius);
+
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        auto values = _mm256_cvtepi32_ps(_mm256_and_si256(
+            _mm256_cvtepu16_epi32(_mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(padded + i * 4)
+            )),
+            xyz
+        ));
+        auto offset = _mm256_sub_ps(values, center);
+        auto squared = _mm256_mul_ps(offset, offset);
+        auto sums = _mm256_hadd_ps(squared, squared);
+        sums = _mm256_hadd_ps(sums, sums);
+
+        auto outside = _mm256_cmp_ps(sums, radius_2, _CMP_GT_OQ);
+
+        if (!_mm256_testz_ps(outside, outside)) {
+            grow_sphere_scalar(padded, i, i + 2, sphere);
+
+            center = _mm256_setr_ps(
+                sphere.center[0],
+                sphere.center[1],
+                sphere.center[2],
+                0.0f,
+                sphere.center[0],
+                sphere.center[1],
+                sphere.center[2],
+                0.0f
+            );
+            radius_2 = _mm256_set1_ps(sphere.radius * sphere.radius);
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+void dequantize_positions(
+    const uint16_t* padded,
+    float* positions,
+    size_t count,
+    KernelLevel level
+) {
+    switch (level) {
+#if defined(X86_KERNELS)
+        case KernelLevel::Avx2:
+            dequantize_positions_avx2(padded, positions, count);
+            return;
+        case KernelLevel::Sse41:
+            dequantize_positions_sse41(padded, positions, count);
+            return;
+#endif
+        default:
+            dequantize_positions_scalar(padded, positions, 0, count);
+    }
+}
+
+glm::vec4
+compute_bounding_sphere(const uint16_t* padded, size_t count, KernelLevel level) {
+    return compute_mesh_bounds(padded, count, level).bounding_sphere;
+}
+
+MeshBounds
+compute_mesh_bounds(const uint16_t* padded, size_t count, KernelLevel level) {
+    assert(count > 0);
+    // Indices are tracked in 32 bit lanes.
+    assert(count <= size_t(std::numeric_limits<int32_t>::max()));
+
+    Extremes extremes;
+    Sphere sphere;
+
+    switch (level) {
+#if defined(X86_KERNELS)
+        case KernelLevel::Avx2: {
+            auto end = find_extremes_avx2(padded, count, extremes);
+            find_extremes_scalar(padded, end, count, extremes);
+            sphere = initial_sphere(padded, extremes);
+            end = grow_sphere_avx2(padded, count, sphere);
+            grow_sphere_scalar(padded, end, count, sphere);
+            break;
+        }
+        case KernelLevel::Sse41:
+            find_extremes_sse41(padded, count, extremes);
+            sphere = initial_sphere(padded, extremes);
+            grow_sphere_sse41(padded, count, sphere);
+            break;
+#endif
+        default:
+            find_extremes_scalar(padded, 0, count, extremes);
+            sphere = initial_sphere(padded, extremes);
+            grow_sphere_scalar(padded, 0, count, sphere);
+    }
+
+    MeshBounds bounds = {
+        .bounding_sphere = glm::vec4(
+            sphere.center[0],
+            sphere.center[1],
+            sphere.center[2],
+            sphere.radius
+        )};
+
+    for (size_t axis = 0; axis < 3; axis++) {
+        bounds.aabb_min[axis] = float(padded[extremes.min[axis] * 4 + axis]);
+        bounds.aabb_max[axis] = float(padded[extremes.max[axis] * 4 + axis]);
+    }
+
+    return bounds;
+}
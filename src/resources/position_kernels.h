@@ -0,0 +1,43 @@
+#pragma once
+
+// Vectorized versions of the per-vertex work done while processing a
+// primitive. They work straight on the gltf's padded `uint16_t x4` quantized
+// positions, and each instruction set produces exactly the same output as the
+// scalar code.
+
+enum class KernelLevel { Scalar, Sse41, Avx2 };
+
+// The best level supported by the CPU we're running on.
+KernelLevel detected_kernel_level();
+
+const char* kernel_level_name(KernelLevel level);
+
+// Convert to `float x3`, as used by meshoptimizer.
+void dequantize_positions(
+    const uint16_t* padded,
+    float* positions,
+    size_t count,
+    KernelLevel level = detected_kernel_level()
+);
+
+// The same sphere as `computeBoundingSphere` on the dequantized positions.
+glm::vec4 compute_bounding_sphere(
+    const uint16_t* padded,
+    size_t count,
+    KernelLevel level = detected_kernel_level()
+);
+
+// A primitive's bounds, in the space of its quantized positions.
+struct MeshBounds {
+    glm::vec4 bounding_sphere;
+    glm::vec3 aabb_min;
+    glm::vec3 aabb_max;
+};
+
+// `compute_bounding_sphere` along with the box, which comes for free out of
+// the extreme points that the sphere starts from.
+MeshBounds compute_mesh_bounds(
+    const uint16_t* padded,
+    size_t count,
+    KernelLevel level = detected_kernel_level()
+);
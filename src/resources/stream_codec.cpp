@@ -0,0 +1,151 @@
+#include "stream_codec.h"
+
+size_t stream_element_size(size_t stride, bool index_sequence) {
+    if (index_sequence) {
+        assert(stride == 2 || stride == 4);
+        return stride;
+    }
+
+    return std::lcm(stride, size_t(4));
+}
+
+size_t stream_padded_size(size_t num_bytes, size_t element_size) {
+    return (num_bytes + element_size - 1) / element_size * element_size;
+}
+
+EncodedStream encode_stream(
+    const void* data,
+    size_t num_bytes,
+    size_t stride,
+    bool index_sequence
+) {
+    auto element_size = stream_element_size(stride, index_sequence);
+    assert(num_bytes % element_size == 0);
+    auto count = num_bytes / element_size;
+
+    EncodedStream encoded = {
+        .codec = StreamCodec::Raw,
+        .count = static_cast<uint32_t>(count),
+        .element_size = static_cast<uint32_t>(element_size),
+        .bytes = {}};
+
+    if (count == 0) {
+        return encoded;
+    }
+
+    if (index_sequence) {
+        auto max_index = 0u;
+        for (size_t i = 0; i < count; i++) {
+            max_index = std::max(
+                max_index,
+                element_size == 2
+                    ? uint32_t(static_cast<const uint16_t*>(data)[i])
+                    : static_cast<const uint32_t*>(data)[i]
+            );
+        }
+
+        encoded.bytes.resize(
+            meshopt_encodeIndexSequenceBound(count, size_t(max_index) + 1)
+        );
+        if (element_size == 2) {
+            encoded.bytes.resize(meshopt_encodeIndexSequence(
+                encoded.bytes.data(),
+                encoded.bytes.size(),
+                static_cast<const uint16_t*>(data),
+                count
+            ));
+        } else {
+            encoded.bytes.resize(meshopt_encodeIndexSequence(
+                encoded.bytes.data(),
+                encoded.bytes.size(),
+                static_cast<const uint32_t*>(data),
+                count
+            ));
+        }
+        encoded.codec = StreamCodec::IndexSequence;
+    } else if (element_size <= 256) {
+        encoded.bytes.resize(meshopt_encodeVertexBufferBound(count, element_size)
+        );
+        encoded.bytes.resize(meshopt_encodeVertexBuffer(
+            encoded.bytes.data(),
+            encoded.bytes.size(),
+            data,
+            count,
+            element_size
+        ));
+        encoded.codec = StreamCodec::Vertex;
+    }
+
+    // Keep the data as-is if encoding didn't help.
+    if (encoded.codec == StreamCodec::Raw || encoded.bytes.empty()
+        || encoded.bytes.size() >= num_bytes) {
+        encoded.codec = StreamCodec::Raw;
+        encoded.bytes.assign(
+            static_cast<const uint8_t*>(data),
+            static_cast<const uint8_t*>(data) + num_bytes
+        );
+    }
+
+    return encoded;
+}
+
+bool decode_stream(
+    void* destination,
+    StreamCodec codec,
+    size_t count,
+    size_t element_size,
+    const uint8_t* encoded,
+    size_t encoded_size
+) {
+    int result = 0;
+
+    switch (codec) {
+        case StreamCodec::Raw:
+            if (encoded_size != count * element_size) {
+                dbg(encoded_size, count, element_size, "is the wrong size");
+                return false;
+            }
+            if (encoded_size > 0) {
+                std::memcpy(destination, encoded, encoded_size);
+            }
+            break;
+        case StreamCodec::Vertex:
+            // meshoptimizer asserts on these instead of failing.
+            if (element_size == 0 || element_size % 4 != 0
+                || element_size > 256) {
+                dbg(element_size, "is not a vertex element size");
+                return false;
+            }
+            result = meshopt_decodeVertexBuffer(
+                destination,
+                count,
+                element_size,
+                encoded,
+                encoded_size
+            );
+            break;
+        case StreamCodec::IndexSequence:
+            if (element_size != 2 && element_size != 4) {
+                dbg(element_size, "is not an index size");
+                return false;
+            }
+            result = meshopt_decodeIndexSequence(
+                destination,
+                count,
+                element_size,
+                encoded,
+                encoded_size
+            );
+            break;
+        default:
+            dbg(static_cast<uint32_t>(codec), "is not a stream codec");
+            return false;
+    }
+
+    if (result != 0) {
+        dbg(static_cast<uint32_t>(codec), result, "failed to decode");
+        return false;
+    }
+
+    return true;
+}
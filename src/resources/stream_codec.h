@@ -0,0 +1,50 @@
+#pragma once
+
+// Compression for the geometry streams that get written to disk, using
+// meshoptimizer's codecs. Data is split into elements of `element_size`
+// bytes, which has to be a multiple of 4 for the vertex codec, so streams of
+// other strides are grouped into larger elements (e.g. two 6 byte positions
+// per 12 byte element) and need their decoded size rounded up to a whole
+// number of elements.
+
+enum class StreamCodec : uint32_t {
+    Raw = 0,
+    // `meshopt_encodeVertexBuffer`, for any fixed size elements.
+    Vertex = 1,
+    // `meshopt_encodeIndexSequence`, for 16 or 32-bit index lists.
+    IndexSequence = 2,
+};
+
+struct EncodedStream {
+    StreamCodec codec;
+    // Elements of `element_size` bytes that the stream decodes to.
+    uint32_t count;
+    uint32_t element_size;
+    std::vector<uint8_t> bytes;
+};
+
+// The element size used for data with a stride of `stride` bytes.
+size_t stream_element_size(size_t stride, bool index_sequence);
+
+// Round `num_bytes` up to a whole number of elements.
+size_t stream_padded_size(size_t num_bytes, size_t element_size);
+
+// `num_bytes` must be a whole number of elements, see `stream_padded_size`.
+EncodedStream encode_stream(
+    const void* data,
+    size_t num_bytes,
+    size_t stride,
+    bool index_sequence
+);
+
+// Writes `count * element_size` bytes. Returns false if `encoded` is corrupt,
+// doesn't decode to that size or `element_size` doesn't suit `codec`, in
+// which case `destination` may have been partially written.
+bool decode_stream(
+    void* destination,
+    StreamCodec codec,
+    size_t count,
+    size_t element_size,
+    const uint8_t* encoded,
+    size_t encoded_size
+);
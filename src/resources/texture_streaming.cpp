@@ -0,0 +1,357 @@
+#include "texture_streaming.h"
+
+uint32_t streaming_initial_level(const ImageSource& source) {
+    uint32_t level = 0;
+
+    while (level + 1 < source.levels.size()) {
+        auto extent = source.levels[level].extent;
+
+        if (std::max(extent.width, extent.height)
+            <= TEXTURE_STREAMING_INITIAL_EXTENT) {
+            break;
+        }
+
+        level++;
+    }
+
+    return level;
+}
+
+vk::DeviceSize
+streaming_resident_size(const ImageSource& source, uint32_t first_level) {
+    vk::DeviceSize size = 0;
+
+    for (uint32_t i = first_level; i < source.levels.size(); i++) {
+        size += source.levels[i].uncompressed_size;
+    }
+
+    return size;
+}
+
+// `detail` is how many levels below a 1x1 texel texture a pixel's footprint
+// is, so the level with about a texel per pixel is that many levels above
+// the coarsest full-size one. Non-square textures go by their largest side,
+// which errs on the side of a finer level.
+uint32_t feedback_level(
+    const ImageSource& source,
+    uint32_t detail,
+    uint32_t initial_level
+) {
+    auto extent = source.create_info.extent;
+    auto largest_side = std::max(extent.width, extent.height);
+    auto largest_level = static_cast<int32_t>(std::bit_width(largest_side)) - 1;
+
+    return static_cast<uint32_t>(std::clamp(
+        largest_level - static_cast<int32_t>(detail),
+        0,
+        static_cast<int32_t>(initial_level)
+    ));
+}
+
+TextureStreamer::TextureStreamer(
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    const vk::raii::Queue& queue,
+    std::mutex* queue_mutex,
+    uint32_t queue_family,
+    vk::DeviceSize staging_budget,
+    vk::DeviceSize budget_,
+    PersistentlyMappedBuffer* feedback_
+) :
+    budget(budget_),
+    feedback(feedback_),
+    textures(MAX_BINDLESS_TEXTURES) {
+    thread = std::jthread([=,
+                           this,
+                           &device,
+                           &queue](std::stop_token stop_token) {
+        ZoneScopedN("texture streaming");
+
+        auto staging = StagingRing(
+            device,
+            allocator,
+            queue,
+            queue_family,
+            staging_budget,
+            4,
+            queue_mutex
+        );
+
+        std::mutex wait_mutex;
+        std::condition_variable_any condition;
+
+        while (true) {
+            {
+                std::unique_lock lock(wait_mutex);
+                // Only woken up early by a stop request.
+                condition.wait_for(
+                    lock,
+                    stop_token,
+                    TEXTURE_STREAMING_INTERVAL,
+                    [] { return false; }
+                );
+            }
+
+            if (stop_token.stop_requested()) {
+                break;
+            }
+
+            update(allocator, device, queue_family, staging);
+        }
+    });
+}
+
+void TextureStreamer::add(
+    uint32_t index,
+    ImageSource source,
+    ImageWithView image
+) {
+    auto initial_level = streaming_initial_level(source);
+
+    // Nothing happens to a texture until it shows up in the feedback, which
+    // is only after the instances that use it (and so `image`) have finished
+    // uploading.
+    std::unique_lock lock(mutex);
+    textures[index] = std::make_unique<Texture>(Texture {
+        .source = std::move(source),
+        .image = std::move(image),
+        .resident_level = initial_level,
+        .initial_level = initial_level,
+        .wanted_level = initial_level,
+        .wanted_time = {}});
+}
+
+bool TextureStreamer::has_swaps() {
+    std::unique_lock lock(mutex);
+    return !swaps.empty();
+}
+
+void TextureStreamer::apply_swaps(
+    DescriptorSet& descriptor_set,
+    vk::Device device
+) {
+    ZoneScoped;
+
+    std::unique_lock lock(mutex);
+
+    for (auto& swap : swaps) {
+        auto& texture = *textures[swap.index];
+
+        descriptor_set.replace_image(swap.index, swap.image, device);
+        // This destroys the old image.
+        texture.image = std::move(swap.image);
+        texture.resident_level = swap.level;
+        texture.swapping = false;
+    }
+
+    swaps.clear();
+}
+
+void TextureStreamer::stop() {
+    thread.request_stop();
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void TextureStreamer::update(
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    uint32_t queue_family,
+    StagingRing& staging
+) {
+    ZoneScoped;
+
+    // The copy back isn't synchronized with this, but a torn read only
+    // mixes up two frames' worth of feedback.
+    std::array<uint32_t, MAX_BINDLESS_TEXTURES> detail;
+    feedback->invalidate();
+    std::memcpy(detail.data(), feedback->mapped_ptr, sizeof detail);
+
+    auto now = std::chrono::steady_clock::now();
+
+    struct Job {
+        uint32_t index;
+        uint32_t level;
+        const ImageSource& source;
+    };
+
+    std::vector<Job> jobs;
+
+    {
+        std::unique_lock lock(mutex);
+
+        std::vector<uint32_t> targets(textures.size());
+        vk::DeviceSize total_size = 0;
+
+        for (uint32_t i = 0; i < textures.size(); i++) {
+            auto& texture = textures[i];
+
+            if (!texture) {
+                continue;
+            }
+
+            if (detail[i] > 0) {
+                auto level = feedback_level(
+                    texture->source,
+                    detail[i],
+                    texture->initial_level
+                );
+
+                if (level <= texture->wanted_level
+                    || now - texture->wanted_time
+                        > TEXTURE_STREAMING_HOLD_TIME) {
+                    texture->wanted_level = level;
+                    texture->wanted_time = now;
+                }
+            } else if (now - texture->wanted_time
+                       > TEXTURE_STREAMING_HOLD_TIME) {
+                texture->wanted_level = texture->initial_level;
+            }
+
+            targets[i] = texture->wanted_level;
+            total_size += streaming_resident_size(texture->source, targets[i]);
+        }
+
+        // Drop the largest level out of all the targets until they fit.
+        while (total_size > budget) {
+            std::optional<uint32_t> largest;
+            vk::DeviceSize largest_size = 0;
+
+            for (uint32_t i = 0; i < textures.size(); i++) {
+                if (!textures[i] || targets[i] >= textures[i]->initial_level) {
+                    continue;
+                }
+
+                auto size =
+                    textures[i]->source.levels[targets[i]].uncompressed_size;
+
+                if (size > largest_size) {
+                    largest = i;
+                    largest_size = size;
+                }
+            }
+
+            // The initial levels don't fit by themselves.
+            if (!largest) {
+                break;
+            }
+
+            targets[largest.value()] += 1;
+            total_size -= largest_size;
+        }
+
+        // Evictions go first as they free up memory. The old and new images
+        // both exist until the swap, so only upload about a staging ring's
+        // worth at a time to keep that overlap small.
+        auto upload_limit = staging.chunk_size * staging.chunks.size();
+        vk::DeviceSize upload_size = 0;
+
+        for (auto evicting : {true, false}) {
+            for (uint32_t i = 0; i < textures.size(); i++) {
+                auto& texture = textures[i];
+
+                if (!texture || texture->swapping
+                    || targets[i] == texture->resident_level
+                    || (targets[i] > texture->resident_level) != evicting) {
+                    continue;
+                }
+
+                auto size =
+                    streaming_resident_size(texture->source, targets[i]);
+
+                if (!jobs.empty() && upload_size + size > upload_limit) {
+                    break;
+                }
+
+                texture->swapping = true;
+                jobs.push_back(Job {
+                    .index = i,
+                    .level = targets[i],
+                    .source = texture->source});
+                upload_size += size;
+            }
+        }
+    }
+
+    if (jobs.empty()) {
+        return;
+    }
+
+    std::vector<ImageUpload> uploads;
+    uploads.reserve(jobs.size());
+
+    for (auto& job : jobs) {
+        uploads.push_back(
+            ImageUpload {.source = job.source, .first_level = job.level}
+        );
+    }
+
+    auto images =
+        upload_images(uploads, allocator, device, queue_family, staging);
+
+    staging.finish();
+
+    std::unique_lock lock(mutex);
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        swaps.push_back(Swap {
+            .index = jobs[i].index,
+            .level = jobs[i].level,
+            .image = std::move(images[i])});
+    }
+}
+
+std::vector<uint32_t> load_scene_images(
+    const std::vector<std::filesystem::path>& filepaths,
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    uint32_t graphics_queue_family,
+    StagingRing& staging,
+    DescriptorSet& descriptor_set,
+    TextureStreamer* streamer,
+    std::vector<ImageWithView>& images
+) {
+    std::vector<ImageSource> sources;
+    sources.reserve(filepaths.size());
+
+    for (auto& filepath : filepaths) {
+        sources.push_back(parse_image(filepath));
+    }
+
+    std::vector<ImageUpload> uploads;
+    uploads.reserve(sources.size());
+
+    for (auto& source : sources) {
+        uploads.push_back(ImageUpload {
+            .source = source,
+            .first_level = streamer ? streaming_initial_level(source) : 0});
+    }
+
+    auto loaded = upload_images(
+        uploads,
+        allocator,
+        device,
+        graphics_queue_family,
+        staging
+    );
+
+    // Written in order, so that the slots don't depend on which images
+    // finished loading first.
+    std::vector<uint32_t> indices;
+    indices.reserve(loaded.size());
+
+    for (size_t i = 0; i < loaded.size(); i++) {
+        auto index = descriptor_set.write_image(loaded[i], *device);
+        indices.push_back(index);
+
+        if (streamer) {
+            streamer->add(index, std::move(sources[i]), std::move(loaded[i]));
+        } else {
+            images.push_back(std::move(loaded[i]));
+        }
+    }
+
+    return indices;
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "../descriptor_set.h"
+#include "image_loading.h"
+
+// Textures start out with only the levels that are at most this many texels
+// on their largest side. Finer levels are streamed in once something on
+// screen needs them.
+const static uint32_t TEXTURE_STREAMING_INITIAL_EXTENT = 128;
+
+// How long a texture keeps a level after it was last asked for, so that
+// turning the camera around doesn't immediately evict everything behind it.
+const static std::chrono::milliseconds TEXTURE_STREAMING_HOLD_TIME =
+    std::chrono::seconds(5);
+
+// How often the feedback is looked at.
+const static std::chrono::milliseconds TEXTURE_STREAMING_INTERVAL =
+    std::chrono::milliseconds(100);
+
+// The level of `source` that always stays resident.
+uint32_t streaming_initial_level(const ImageSource& source);
+
+// Bytes used by the levels of `source` from `first_level` down.
+vk::DeviceSize
+streaming_resident_size(const ImageSource& source, uint32_t first_level);
+
+// Keeps the scene textures at the levels that rendering asks for, within a
+// memory budget.
+//
+// `render_geometry` writes the texel density that each pixel's texture
+// footprint needs into `MiscStorage::texture_feedback`, which is copied back
+// at the end of every frame. The streamer thread turns that into a target
+// level per texture, coarsens the largest targets until they fit into
+// `budget`, and re-uploads every texture whose target has changed as a new
+// image that only holds the levels from the target down. Descriptors can't be
+// replaced while a frame that samples them is in flight, so the new images
+// are handed to the render loop, which swaps them in with `apply_swaps`.
+struct TextureStreamer {
+    struct Texture {
+        ImageSource source;
+        // Only holds the levels from `resident_level` down.
+        ImageWithView image;
+        uint32_t resident_level;
+        uint32_t initial_level;
+        // The finest level asked for within the last
+        // `TEXTURE_STREAMING_HOLD_TIME`.
+        uint32_t wanted_level;
+        std::chrono::steady_clock::time_point wanted_time;
+        // Set while a new image is being uploaded or waiting to be swapped
+        // in.
+        bool swapping = false;
+    };
+
+    struct Swap {
+        uint32_t index;
+        uint32_t level;
+        ImageWithView image;
+    };
+
+    vk::DeviceSize budget;
+    // Holds `MiscStorage::texture_feedback`, indexed by bindless texture
+    // index.
+    PersistentlyMappedBuffer* feedback;
+
+    std::mutex mutex;
+    // Indexed by bindless texture index. Entries are never removed, so the
+    // sources can be read without holding `mutex`.
+    std::vector<std::unique_ptr<Texture>> textures;
+    std::vector<Swap> swaps;
+    std::jthread thread;
+
+    TextureStreamer(
+        vma::Allocator allocator,
+        const vk::raii::Device& device,
+        const vk::raii::Queue& queue,
+        // Only needs to be set if `queue` is also used by another thread.
+        std::mutex* queue_mutex,
+        uint32_t queue_family,
+        vk::DeviceSize staging_budget,
+        vk::DeviceSize budget_,
+        PersistentlyMappedBuffer* feedback_
+    );
+
+    // Start streaming a texture that has been uploaded from `initial_level`
+    // down. Called on the loading thread.
+    void add(uint32_t index, ImageSource source, ImageWithView image);
+
+    bool has_swaps();
+
+    // Replace the descriptors of the textures that have finished uploading.
+    // Only call this when no frames that sample the scene textures are in
+    // flight.
+    void apply_swaps(DescriptorSet& descriptor_set, vk::Device device);
+
+    // Stop streaming and wait for the thread to exit.
+    void stop();
+
+  private:
+    // Read the feedback, pick the new target levels and upload the textures
+    // that need to change.
+    void update(
+        vma::Allocator allocator,
+        const vk::raii::Device& device,
+        uint32_t queue_family,
+        StagingRing& staging
+    );
+};
+
+// Load a scene's textures and write them into the bindless descriptor array,
+// returning their indices. With a `streamer` only the levels from
+// `streaming_initial_level` down are loaded and the streamer takes the
+// images, otherwise they're loaded in full and appended to `images`.
+std::vector<uint32_t> load_scene_images(
+    const std::vector<std::filesystem::path>& filepaths,
+    vma::Allocator allocator,
+    const vk::raii::Device& device,
+    uint32_t graphics_queue_family,
+    StagingRing& staging,
+    DescriptorSet& descriptor_set,
+    TextureStreamer* streamer,
+    std::vector<ImageWithView>& images
+);
@@ -0,0 +1,169 @@
+#include "vertex_repacking.h"
+
+// Large streams are split up so that the work is spread over workgroups.
+const uint32_t MAX_VERTICES_PER_JOB = 64 * 32;
+
+VertexRepacker::VertexRepacker(
+    StagingRing& staging_,
+    const Pipelines& pipelines_
+) :
+    staging(staging_),
+    pipelines(pipelines_) {
+    assert(!staging.before_submit);
+    staging.before_submit = [this]() { record(); };
+}
+
+VertexRepacker::~VertexRepacker() {
+    // Anything still pending would read from staging memory that's about to
+    // be reused.
+    assert(position_jobs.empty() && normal_jobs.empty());
+    staging.before_submit = nullptr;
+}
+
+void add_jobs(
+    std::vector<CopyQuantizedJob>& jobs,
+    uint64_t dst,
+    uint64_t src,
+    uint32_t count,
+    uint32_t dst_stride,
+    uint32_t src_stride
+) {
+    for (uint32_t offset = 0; offset < count; offset += MAX_VERTICES_PER_JOB) {
+        jobs.push_back(CopyQuantizedJob {
+            .dst = dst + uint64_t(offset) * dst_stride,
+            .src = src + uint64_t(offset) * src_stride,
+            .count = std::min(count - offset, MAX_VERTICES_PER_JOB),
+            .padding = 0});
+    }
+}
+
+void VertexRepacker::add_positions(uint64_t dst, uint64_t src, uint32_t count) {
+    add_jobs(
+        position_jobs,
+        dst,
+        src,
+        count,
+        sizeof(uint16_t) * 3,
+        sizeof(uint16_t) * 4
+    );
+}
+
+void VertexRepacker::add_normals(uint64_t dst, uint64_t src, uint32_t count) {
+    add_jobs(
+        normal_jobs,
+        dst,
+        src,
+        count,
+        sizeof(int8_t) * 3,
+        sizeof(int8_t) * 4
+    );
+}
+
+void dispatch_jobs(
+    StagingRing& staging,
+    const Pipelines& pipelines,
+    const vk::raii::Pipeline& pipeline,
+    std::vector<CopyQuantizedJob>& jobs
+) {
+    if (jobs.empty()) {
+        return;
+    }
+
+    auto table_size = jobs.size() * sizeof(CopyQuantizedJob);
+
+    // This is called from inside `flush`, so it can't flush again.
+    auto opt_table = staging.try_allocate(table_size);
+    auto table = opt_table ? opt_table.value()
+                           : staging.allocate_dedicated(table_size);
+    std::memcpy(table.mapped_ptr, jobs.data(), table_size);
+
+    auto& command_buffer = staging.command_buffer();
+
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline);
+    command_buffer.pushConstants<CopyQuantizedPositionsConstant>(
+        *pipelines.copy_pipeline_layout,
+        vk::ShaderStageFlagBits::eCompute,
+        0,
+        {{.jobs = table.address}}
+    );
+    command_buffer.dispatch(static_cast<uint32_t>(jobs.size()), 1, 1);
+
+    jobs.clear();
+}
+
+void VertexRepacker::record() {
+    dispatch_jobs(
+        staging,
+        pipelines,
+        pipelines.copy_quantized_positions,
+        position_jobs
+    );
+    dispatch_jobs(
+        staging,
+        pipelines,
+        pipelines.copy_quantized_normals,
+        normal_jobs
+    );
+}
+
+void repack_positions(const uint16_t* padded, uint16_t* packed, size_t count) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    // Two vertices per load. Each store writes 16 bytes but only advances by
+    // 12, so stop while there's still room for the overhang.
+    const auto low = _mm_setr_epi16(-1, -1, -1, 0, 0, 0, 0, 0);
+    const auto high = _mm_setr_epi16(0, 0, 0, -1, -1, -1, 0, 0);
+
+    for (; i + 3 <= count; i += 2) {
+        auto value =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(padded + i * 4));
+        auto shifted = _mm_srli_si128(value, 2);
+        auto result = _mm_or_si128(
+            _mm_and_si128(value, low),
+            _mm_and_si128(shifted, high)
+        );
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(packed + i * 3), result);
+    }
+#endif
+
+    for (; i < count; i++) {
+        packed[i * 3] = padded[i * 4];
+        packed[i * 3 + 1] = padded[i * 4 + 1];
+        packed[i * 3 + 2] = padded[i * 4 + 2];
+    }
+}
+
+void repack_normals(const int8_t* padded, int8_t* packed, size_t count) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    // Four vertices per load, with the same overhang as above.
+    const auto first = _mm_setr_epi32(0x00ffffff, 0, 0, 0);
+    const auto second = _mm_setr_epi32(~0x00ffffff, 0xffff, 0, 0);
+    const auto third = _mm_setr_epi32(0, ~0xffff, 0xff, 0);
+    const auto fourth = _mm_setr_epi32(0, 0, ~0xff, 0);
+
+    for (; i + 6 <= count; i += 4) {
+        auto value =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(padded + i * 4));
+        auto result = _mm_or_si128(
+            _mm_or_si128(
+                _mm_and_si128(value, first),
+                _mm_and_si128(_mm_srli_si128(value, 1), second)
+            ),
+            _mm_or_si128(
+                _mm_and_si128(_mm_srli_si128(value, 2), third),
+                _mm_and_si128(_mm_srli_si128(value, 3), fourth)
+            )
+        );
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(packed + i * 3), result);
+    }
+#endif
+
+    for (; i < count; i++) {
+        packed[i * 3] = padded[i * 4];
+        packed[i * 3 + 1] = padded[i * 4 + 1];
+        packed[i * 3 + 2] = padded[i * 4 + 2];
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "../allocations/staging.h"
+#include "../pipelines.h"
+
+// The gltf stores quantized positions as `uint16_t x4` and normals as
+// `int8_t x4`, with an unused padding element. These strip the padding.
+
+// Collects the repacking for everything staged into the current chunk of a
+// `StagingRing` into job tables, and records them as one dispatch per
+// stream type right before the chunk is submitted, instead of a pipeline
+// bind, push constant and dispatch per primitive.
+struct VertexRepacker {
+    StagingRing& staging;
+    const Pipelines& pipelines;
+    std::vector<CopyQuantizedJob> position_jobs;
+    std::vector<CopyQuantizedJob> normal_jobs;
+
+    VertexRepacker(StagingRing& staging_, const Pipelines& pipelines_);
+
+    ~VertexRepacker();
+
+    // `src` has to be in the current staging chunk.
+    void add_positions(uint64_t dst, uint64_t src, uint32_t count);
+
+    void add_normals(uint64_t dst, uint64_t src, uint32_t count);
+
+    // Called by `staging` before it submits the current chunk.
+    void record();
+};
+
+// The same repacking on the CPU, for when the destination is in host memory
+// anyway.
+
+void repack_positions(const uint16_t* padded, uint16_t* packed, size_t count);
+
+void repack_normals(const int8_t* padded, int8_t* packed, size_t count);
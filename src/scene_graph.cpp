@@ -0,0 +1,216 @@
+#include "scene_graph.h"
+
+#include "thread_pool.h"
+
+void SceneGraph::add_nodes(const std::vector<SceneNode>& nodes) {
+    auto first = static_cast<uint32_t>(parents.size());
+
+    std::vector<std::vector<uint32_t>> children(nodes.size());
+    std::vector<uint32_t> stack;
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].parent == NO_PARENT) {
+            stack.push_back(static_cast<uint32_t>(i));
+        } else {
+            children[nodes[i].parent].push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    // Push the roots and children in reverse so that they come out of the
+    // stack in their original order.
+    std::reverse(stack.begin(), stack.end());
+
+    std::vector<uint32_t> new_sorted_indices(nodes.size(), NO_PARENT);
+    auto next = first;
+
+    while (!stack.empty()) {
+        auto node = stack.back();
+        stack.pop_back();
+
+        new_sorted_indices[node] = next;
+        next++;
+
+        for (auto child = children[node].rbegin();
+             child != children[node].rend();
+             child++) {
+            stack.push_back(*child);
+        }
+    }
+
+    if (next - first != nodes.size()) {
+        dbg(nodes.size(), next - first, "nodes aren't reachable from a root");
+        abort();
+    }
+
+    auto total = first + nodes.size();
+    parents.resize(total);
+    subtree_ends.resize(total);
+    local_transforms.resize(total);
+    world_transforms.resize(total);
+    node_instances.resize(total);
+    dirty.resize(total, false);
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        auto sorted = new_sorted_indices[i];
+        parents[sorted] = nodes[i].parent == NO_PARENT
+            ? NO_PARENT
+            : new_sorted_indices[nodes[i].parent];
+        local_transforms[sorted] = nodes[i].local_transform;
+        subtree_ends[sorted] = sorted + 1;
+    }
+
+    // Going backwards, every child is visited before its parent.
+    for (auto i = total; i > first; i--) {
+        auto parent = parents[i - 1];
+        if (parent != NO_PARENT) {
+            subtree_ends[parent] =
+                std::max(subtree_ends[parent], subtree_ends[i - 1]);
+        }
+    }
+
+    for (auto i = first; i < total; i++) {
+        world_transforms[i] = parents[i] == NO_PARENT
+            ? local_transforms[i]
+            : world_transforms[parents[i]] * local_transforms[i];
+    }
+
+    sorted_indices.insert(
+        sorted_indices.end(),
+        new_sorted_indices.begin(),
+        new_sorted_indices.end()
+    );
+}
+
+void SceneGraph::add_instances(const std::vector<NodeInstance>& new_instances
+) {
+    for (auto& instance : new_instances) {
+        if (instances.size() >= MAX_INSTANCES) {
+            // Only reported once, as this is hit every time the loader has
+            // more.
+            if (dropped_instances == 0) {
+                dbg(MAX_INSTANCES, "instances reached, dropping the rest");
+            }
+            dropped_instances++;
+            continue;
+        }
+
+        auto node = sorted_indices[instance.node];
+        auto index = static_cast<uint32_t>(instances.size());
+
+        instances.push_back(
+            Instance(world_transforms[node], instance.mesh_info_address)
+        );
+        instance_mesh_infos.push_back(instance.mesh_info_address);
+        node_instances[node].push_back(index);
+        changed_instances.push_back(index);
+    }
+}
+
+void SceneGraph::set_local_transform(
+    uint32_t node,
+    const glm::mat4& transform
+) {
+    auto sorted = sorted_indices[node];
+    local_transforms[sorted] = transform;
+
+    if (!dirty[sorted]) {
+        dirty[sorted] = true;
+        dirty_nodes.push_back(sorted);
+    }
+}
+
+void SceneGraph::update() {
+    ZoneScoped;
+
+    if (dirty_nodes.empty()) {
+        return;
+    }
+
+    // Only keep the dirty nodes that aren't inside another dirty subtree.
+    std::sort(dirty_nodes.begin(), dirty_nodes.end());
+
+    std::vector<uint32_t> dirty_roots;
+    uint32_t covered_until = 0;
+
+    for (auto node : dirty_nodes) {
+        dirty[node] = false;
+
+        if (node >= covered_until) {
+            dirty_roots.push_back(node);
+            covered_until = subtree_ends[node];
+        }
+    }
+
+    dirty_nodes.clear();
+
+    parallel_for(dirty_roots.size(), [&](size_t i) {
+        auto root = dirty_roots[i];
+
+        for (auto node = root; node < subtree_ends[root]; node++) {
+            world_transforms[node] = parents[node] == NO_PARENT
+                ? local_transforms[node]
+                : world_transforms[parents[node]] * local_transforms[node];
+
+            for (auto instance : node_instances[node]) {
+                instances[instance] = Instance(
+                    world_transforms[node],
+                    instance_mesh_infos[instance]
+                );
+            }
+        }
+    });
+
+    for (auto root : dirty_roots) {
+        for (auto node = root; node < subtree_ends[root]; node++) {
+            changed_instances.insert(
+                changed_instances.end(),
+                node_instances[node].begin(),
+                node_instances[node].end()
+            );
+        }
+    }
+}
+
+void SceneGraph::flush(
+    UploadingBuffer& instance_buffer,
+    const vk::raii::CommandBuffer& command_buffer
+) {
+    if (changed_instances.empty()) {
+        return;
+    }
+
+    std::sort(changed_instances.begin(), changed_instances.end());
+    changed_instances.erase(
+        std::unique(changed_instances.begin(), changed_instances.end()),
+        changed_instances.end()
+    );
+
+    auto mapped =
+        static_cast<Instance*>(instance_buffer.staging.mapped_ptr);
+
+    std::vector<vk::BufferCopy> regions;
+
+    for (auto index : changed_instances) {
+        mapped[index] = instances[index];
+
+        auto offset = index * sizeof(Instance);
+
+        if (!regions.empty()
+            && regions.back().srcOffset + regions.back().size == offset) {
+            regions.back().size += sizeof(Instance);
+        } else {
+            regions.push_back(vk::BufferCopy {
+                .srcOffset = offset,
+                .dstOffset = offset,
+                .size = sizeof(Instance)});
+        }
+    }
+
+    command_buffer.copyBuffer(
+        instance_buffer.staging.buffer.buffer,
+        instance_buffer.buffer.buffer,
+        regions
+    );
+
+    changed_instances.clear();
+}
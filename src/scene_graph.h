@@ -0,0 +1,66 @@
+#pragma once
+#include "frame_resources.h"
+#include "shared_cpu_gpu.h"
+
+const static uint32_t NO_PARENT = std::numeric_limits<uint32_t>::max();
+
+struct SceneNode {
+    uint32_t parent = NO_PARENT;
+    glm::mat4 local_transform = glm::mat4(1.0);
+};
+
+// An instance of a primitive that's drawn with the world transform of a node.
+struct NodeInstance {
+    uint32_t node;
+    uint64_t mesh_info_address;
+};
+
+// Node transforms and the instances that use them.
+//
+// Nodes are stored in depth-first order, so parents always come before their
+// children and every subtree is one contiguous range. Changing a node only
+// marks it as dirty; `update` then recomputes the world transforms of the
+// dirty subtrees in parallel and `flush` uploads just the instances that
+// changed.
+//
+// Outside of this struct, nodes are referred to by the order they were added
+// in.
+struct SceneGraph {
+    std::vector<uint32_t> sorted_indices;
+
+    // These are all in sorted order.
+    std::vector<uint32_t> parents;
+    // One past the last node in each node's subtree.
+    std::vector<uint32_t> subtree_ends;
+    std::vector<glm::mat4> local_transforms;
+    std::vector<glm::mat4> world_transforms;
+    std::vector<std::vector<uint32_t>> node_instances;
+    std::vector<uint8_t> dirty;
+    std::vector<uint32_t> dirty_nodes;
+
+    // The contents of the instance buffer.
+    std::vector<Instance> instances;
+    std::vector<uint64_t> instance_mesh_infos;
+    std::vector<uint32_t> changed_instances;
+    // Instances past `MAX_INSTANCES` that were left out, as the instance
+    // buffer has no room for them.
+    size_t dropped_instances = 0;
+
+    // Parents refer to other nodes in `nodes`.
+    void add_nodes(const std::vector<SceneNode>& nodes);
+
+    // Anything that would go past `MAX_INSTANCES` is dropped.
+    void add_instances(const std::vector<NodeInstance>& new_instances);
+
+    void set_local_transform(uint32_t node, const glm::mat4& transform);
+
+    // Recompute the world transforms of everything that's been changed.
+    void update();
+
+    // Record copies for all the instances that have changed since the last
+    // flush, with one region per contiguous run.
+    void flush(
+        UploadingBuffer& instance_buffer,
+        const vk::raii::CommandBuffer& command_buffer
+    );
+};
@@ -1,6 +1,7 @@
 #include <shared_cpu_gpu.h>
 
 #include "buffer_references.glsl"
+#include "meshlets.glsl"
 
 // Ensure that all of these are scalar!
 
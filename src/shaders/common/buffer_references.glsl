@@ -11,6 +11,14 @@ layout(buffer_reference, scalar) buffer MeshletBuffer {
     Meshlet meshlets[];
 };
 
+layout(buffer_reference, scalar) buffer MeshletLodBuffer {
+    MeshletLod lods[];
+};
+
+layout(buffer_reference, scalar) buffer MeshletGroupBuffer {
+    MeshletGroup groups[];
+};
+
 layout(buffer_reference, scalar, buffer_reference_align = 1) buffer
     MicroIndexBuffer {
     u8vec3 indices[];
@@ -1,3 +1,13 @@
+// Add one to a `CullingStats` counter, e.g. `COUNT_CULLING(meshlets.tested)`.
+#define COUNT_CULLING(counter) \
+    if (get_uniforms().count_culling != 0) { \
+        atomicAdd( \
+            MiscStorageBuffer(get_uniforms().misc_storage) \
+                .misc_storage.culling_stats.counter, \
+            1 \
+        ); \
+    }
+
 bool cull_bounding_sphere(Instance instance, vec4 bounding_sphere) {
     Uniforms uniforms = get_uniforms();
 
@@ -134,18 +144,244 @@ bool cull_bounding_sphere_shadows(
     return false;
 }
 
-bool cull_cone_perspective(Instance instance, Meshlet meshlet) {
+// How far a box with these (scaled) axes reaches along `direction`.
+float box_reach(mat3 axes, vec3 direction) {
+    return abs(dot(axes[0], direction)) + abs(dot(axes[1], direction))
+        + abs(dot(axes[2], direction));
+}
+
+// The same planes as `cull_bounding_sphere`, but with how far the transformed
+// box reaches towards each plane in place of the radius. Long, thin boxes
+// reach a lot less far than their spheres in most directions.
+bool cull_aabb(Instance instance, vec3 aabb_min, vec3 aabb_max) {
+    Uniforms uniforms = get_uniforms();
+
+    mat4 model_view = uniforms.initial_view * instance.transform;
+    vec3 center = (aabb_min + aabb_max) * 0.5;
+    vec3 extents = (aabb_max - aabb_min) * 0.5;
+
+    // Flip z like `cull_bounding_sphere` does.
+    mat3 flip_z = mat3(1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, -1.0);
+
+    vec3 view_space_pos = flip_z * (model_view * vec4(center, 1.0)).xyz;
+    mat3 axes = flip_z * mat3(model_view)
+        * mat3(extents.x, 0.0, 0.0, 0.0, extents.y, 0.0, 0.0, 0.0, extents.z);
+
+    bool visible =
+        view_space_pos.z + box_reach(axes, vec3(0.0, 0.0, 1.0)) > NEAR_PLANE;
+
+    vec3 frustum_x = normalize(
+        transpose(uniforms.perspective)[3].xyz
+        + transpose(uniforms.perspective)[0].xyz
+    );
+    vec3 frustum_y = normalize(
+        transpose(uniforms.perspective)[3].xyz
+        + transpose(uniforms.perspective)[1].xyz
+    );
+
+    // The planes on the side of the center, as picked by the `abs` calls in
+    // `cull_bounding_sphere`.
+    vec3 plane_x = vec3(
+        view_space_pos.x >= 0.0 ? frustum_x.x : -frustum_x.x,
+        0.0,
+        frustum_x.z
+    );
+    vec3 plane_y = vec3(
+        0.0,
+        view_space_pos.y >= 0.0 ? -frustum_y.y : frustum_y.y,
+        frustum_y.z
+    );
+
+    visible = visible
+        && dot(plane_x, view_space_pos) < box_reach(axes, plane_x);
+    visible = visible
+        && dot(plane_y, view_space_pos) < box_reach(axes, plane_y);
+
+    return !visible;
+}
+
+// How far a box with these world space axes reaches along a cascade's x and
+// y.
+vec2 cascade_reach(mat3 world_axes, uint32_t cascade_index) {
+    MiscStorageBuffer buf = MiscStorageBuffer(get_uniforms().misc_storage);
+
+    mat3 view_axes =
+        mat3(buf.misc_storage.shadow_view_matrices[cascade_index]) * world_axes;
+
+    return abs(view_axes[0].xy) + abs(view_axes[1].xy) + abs(view_axes[2].xy);
+}
+
+bool box_fits_entirely_inside_cascade(
+    vec3 world_pos,
+    mat3 world_axes,
+    uint32_t cascade_index
+) {
+    MiscStorageBuffer buf = MiscStorageBuffer(get_uniforms().misc_storage);
+
+    vec2 view_pos = (buf.misc_storage.shadow_view_matrices[cascade_index]
+                     * vec4(world_pos, 1.0))
+                        .xy;
+
+    return all(lessThan(
+        abs(view_pos) + cascade_reach(world_axes, cascade_index),
+        vec2(buf.misc_storage.shadow_sphere_radii[cascade_index])
+    ));
+}
+
+// `cull_bounding_sphere_shadows` for a box.
+bool cull_aabb_shadows(
+    Instance instance,
+    vec3 aabb_min,
+    vec3 aabb_max,
+    uint32_t cascade_index
+) {
+    MiscStorageBuffer buf = MiscStorageBuffer(get_uniforms().misc_storage);
+
+    vec3 center = (aabb_min + aabb_max) * 0.5;
+    vec3 extents = (aabb_max - aabb_min) * 0.5;
+
+    vec3 world_space_pos = (instance.transform * vec4(center, 1.0)).xyz;
+    mat3 world_axes = mat3(instance.transform)
+        * mat3(extents.x, 0.0, 0.0, 0.0, extents.y, 0.0, 0.0, 0.0, extents.z);
+
+    vec2 view_space_pos = (buf.misc_storage.shadow_view_matrices[cascade_index]
+                           * vec4(world_space_pos, 1.0))
+                              .xy;
+
+    if (!all(lessThan(
+            abs(view_space_pos) - cascade_reach(world_axes, cascade_index),
+            vec2(buf.misc_storage.shadow_sphere_radii[cascade_index])
+        ))) {
+        return true;
+    }
+
+    // If the object fits entirely within a smaller cascade then it can be culled.
+    for (uint32_t smaller = 0; smaller < cascade_index; smaller++) {
+        if (box_fits_entirely_inside_cascade(
+                world_space_pos,
+                world_axes,
+                smaller
+            )) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// There's no cone apex in the packed meshlets, so this uses the bounding
+// sphere instead, see
+// https://github.com/zeux/meshoptimizer#mesh-shading
+bool cull_cone_perspective(
+    Instance instance,
+    Meshlet meshlet,
+    vec4 bounding_sphere
+) {
     Uniforms uniforms = get_uniforms();
 
-    float3 apex = (instance.transform * float4(meshlet.cone_apex, 1.0)).xyz;
-    float3 axis = normalize((instance.normal_transform * meshlet.cone_axis));
+    float3 center =
+        (instance.transform * float4(bounding_sphere.xyz, 1.0)).xyz;
+    float3 axis =
+        normalize((instance.normal_transform * meshlet_cone_axis(meshlet)));
 
-    return dot(normalize(apex - uniforms.camera_pos), normalize(axis))
-        >= meshlet.cone_cutoff;
+    vec3 scale = vec3(
+        length(instance.transform[0].xyz),
+        length(instance.transform[1].xyz),
+        length(instance.transform[2].xyz)
+    );
+    float radius = bounding_sphere.w * max(max(scale.x, scale.y), scale.z);
+
+    float3 offset = center - uniforms.camera_pos;
+
+    return dot(offset, axis)
+        >= meshlet_cone_cutoff(meshlet) * length(offset) + radius;
 }
 
 bool cull_cone_orthographic(Instance instance, Meshlet meshlet) {
     Uniforms uniforms = get_uniforms();
-    float3 axis = normalize((instance.normal_transform * meshlet.cone_axis));
-    return dot(uniforms.sun_dir, axis) >= meshlet.cone_cutoff;
+    float3 axis =
+        normalize((instance.normal_transform * meshlet_cone_axis(meshlet)));
+    return dot(uniforms.sun_dir, axis) >= meshlet_cone_cutoff(meshlet);
+}
+
+// The largest axis scale of the instance's transform.
+float instance_max_scale(Instance instance) {
+    vec3 scale = vec3(
+        length(instance.transform[0].xyz),
+        length(instance.transform[1].xyz),
+        length(instance.transform[2].xyz)
+    );
+    return max(max(scale.x, scale.y), scale.z);
+}
+
+// How many pixels an error of `error` at `distance` from the camera covers.
+float projected_error_at_distance(
+    Instance instance,
+    float error,
+    float distance
+) {
+    Uniforms uniforms = get_uniforms();
+
+    float pixels_per_unit_at_distance_1 =
+        abs(uniforms.perspective[1][1]) * float(uniforms.window_size.y) * 0.5;
+
+    return error * instance_max_scale(instance) / max(distance, NEAR_PLANE)
+        * pixels_per_unit_at_distance_1;
+}
+
+// How many pixels an error of `error` inside `bounding_sphere` could cover,
+// measured from the point of the sphere closest to the camera.
+float projected_error(Instance instance, vec4 bounding_sphere, float error) {
+    vec3 world_space_pos =
+        (instance.transform * vec4(bounding_sphere.xyz, 1.0)).xyz;
+
+    float distance = length(world_space_pos - get_uniforms().camera_pos)
+        - bounding_sphere.w * instance_max_scale(instance);
+
+    return projected_error_at_distance(instance, error, distance);
+}
+
+// Whether the meshlet is part of the LOD cut for the current view. The parent
+// sphere always contains the meshlet's own sphere and the parent error is
+// never smaller, so along any path through the hierarchy exactly one meshlet
+// passes.
+bool in_lod_cut(Instance instance, MeshletLod lod) {
+    float threshold = get_uniforms().lod_pixel_error;
+
+    return projected_error(instance, lod.bounding_sphere, lod.error)
+        <= threshold
+        && projected_error(instance, lod.parent_bounding_sphere, lod.parent_error)
+        > threshold;
+}
+
+// Whether any meshlet of the group could be in the LOD cut. Projected errors
+// only grow as the distance to a sphere shrinks, so every parent error
+// projects to at most the largest one at the closest point of the sphere
+// around them, and every own error to at least the smallest one at the
+// furthest point of the sphere around them.
+bool meshlet_group_in_lod_cut(Instance instance, MeshletGroup group) {
+    float threshold = get_uniforms().lod_pixel_error;
+
+    if (projected_error(
+            instance,
+            group.lod_parent_bounding_sphere,
+            group.lod_max_parent_error
+        )
+        <= threshold) {
+        return false;
+    }
+
+    vec3 world_space_pos =
+        (instance.transform * vec4(group.lod_bounding_sphere.xyz, 1.0)).xyz;
+
+    float furthest_distance =
+        length(world_space_pos - get_uniforms().camera_pos)
+        + group.lod_bounding_sphere.w * instance_max_scale(instance);
+
+    return projected_error_at_distance(
+               instance,
+               group.lod_min_error,
+               furthest_distance
+           )
+        <= threshold;
 }
@@ -0,0 +1,78 @@
+// Unpacking for the fields of `Meshlet` and `MeshletGroup`.
+
+uint32_t meshlet_triangle_offset(Meshlet meshlet) {
+    return (meshlet.triangle_offset_and_count >> MESHLET_COUNT_BITS)
+        * MESHLET_TRIANGLE_OFFSET_UNIT;
+}
+
+uint32_t meshlet_triangle_count(Meshlet meshlet) {
+    return meshlet.triangle_offset_and_count & MESHLET_COUNT_MASK;
+}
+
+uint32_t meshlet_index_offset(Meshlet meshlet) {
+    return meshlet.index_offset_and_count >> MESHLET_COUNT_BITS;
+}
+
+vec4 unpack_bounding_sphere(uvec2 packed, MeshInfo mesh_info) {
+    vec4 relative = vec4(unpackHalf2x16(packed.x), unpackHalf2x16(packed.y));
+    return vec4(mesh_info.bounding_sphere.xyz + relative.xyz, relative.w);
+}
+
+vec4 meshlet_bounding_sphere(Meshlet meshlet, MeshInfo mesh_info) {
+    return unpack_bounding_sphere(meshlet.bounding_sphere, mesh_info);
+}
+
+vec3 meshlet_cone_axis(Meshlet meshlet) {
+    return vec3(meshlet.cone_axis) / 127.0;
+}
+
+float meshlet_cone_cutoff(Meshlet meshlet) {
+    return float(meshlet.cone_cutoff) / 127.0;
+}
+
+vec3 unpack_aabb_corner(uint32_t packed, MeshInfo mesh_info) {
+    uvec3 quantized = uvec3(
+        packed & MESHLET_AABB_MASK,
+        packed >> MESHLET_AABB_BITS & MESHLET_AABB_MASK,
+        packed >> (MESHLET_AABB_BITS * 2) & MESHLET_AABB_MASK
+    );
+    return mesh_info.aabb_min
+        + vec3(quantized) * (mesh_info.aabb_max - mesh_info.aabb_min)
+        / float(MESHLET_AABB_MASK);
+}
+
+void meshlet_aabb(
+    Meshlet meshlet,
+    MeshInfo mesh_info,
+    out vec3 aabb_min,
+    out vec3 aabb_max
+) {
+    aabb_min = unpack_aabb_corner(meshlet.aabb.x, mesh_info);
+    aabb_max = unpack_aabb_corner(meshlet.aabb.y, mesh_info);
+}
+
+uint32_t meshlet_group_count(MeshInfo mesh_info) {
+    return (uint32_t(mesh_info.num_meshlets) + MESHLET_GROUP_SIZE - 1)
+        / MESHLET_GROUP_SIZE;
+}
+
+uint32_t meshlet_group_meshlet_count(MeshInfo mesh_info, uint32_t group_index) {
+    return min(
+        MESHLET_GROUP_SIZE,
+        uint32_t(mesh_info.num_meshlets) - group_index * MESHLET_GROUP_SIZE
+    );
+}
+
+vec4 meshlet_group_bounding_sphere(MeshletGroup group, MeshInfo mesh_info) {
+    return unpack_bounding_sphere(group.bounding_sphere, mesh_info);
+}
+
+void meshlet_group_aabb(
+    MeshletGroup group,
+    MeshInfo mesh_info,
+    out vec3 aabb_min,
+    out vec3 aabb_max
+) {
+    aabb_min = unpack_aabb_corner(group.aabb.x, mesh_info);
+    aabb_max = unpack_aabb_corner(group.aabb.y, mesh_info);
+}
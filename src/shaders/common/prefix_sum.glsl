@@ -14,8 +14,14 @@ layout(buffer_reference, scalar) buffer PrefixSumBuffer {
 //
 // See also https://research.nvidia.com/sites/default/files/pubs/2016-03_Single-pass-Parallel-Prefix/nvr-2016-002.pdf
 // apparently.
-void prefix_sum_inclusive_append(
+//
+// `buf` holds `capacity` values. Appends past that are dropped and return
+// false. The counter still counts them, so everything that reads the buffer
+// clamps to `capacity`. The values that did fit were appended before any
+// that didn't, so they still form a valid prefix sum.
+bool prefix_sum_inclusive_append(
     PrefixSumBuffer buf,
+    uint32_t capacity,
     uint32_t index,
     uint32_t value
 ) {
@@ -24,14 +30,27 @@ void prefix_sum_inclusive_append(
         atomicAdd(buf.counter, uint64_t(value) | upper_bits_one);
     uint32_t buffer_index = uint32_t(sum_and_counter >> 32);
 
+    if (buffer_index >= capacity) {
+        return false;
+    }
+
     buf.values[buffer_index].index = index;
     // Add the current value to make in inclusive rather than exclusive.
     buf.values[buffer_index].sum = uint32_t(sum_and_counter) + value;
+    return true;
+}
+
+uint32_t prefix_sum_count(PrefixSumBuffer buf, uint32_t capacity) {
+    return min(uint32_t(buf.counter >> 32), capacity);
 }
 
 // See https://en.cppreference.com/w/cpp/algorithm/upper_bound.
-PrefixSumValue prefix_sum_binary_search(PrefixSumBuffer buf, uint32_t target) {
-    uint32_t count = uint32_t(buf.counter >> 32);
+PrefixSumValue prefix_sum_binary_search(
+    PrefixSumBuffer buf,
+    uint32_t capacity,
+    uint32_t target
+) {
+    uint32_t count = prefix_sum_count(buf, capacity);
     uint32_t first = 0;
 
     while (count > 0) {
@@ -49,6 +68,11 @@ void prefix_sum_reset(PrefixSumBuffer buf) {
     buf.counter = 0;
 }
 
-uint32_t prefix_sum_total(PrefixSumBuffer buf) {
+uint32_t prefix_sum_total(PrefixSumBuffer buf, uint32_t capacity) {
+    // The counter's sum includes any dropped values.
+    if (uint32_t(buf.counter >> 32) > capacity) {
+        return buf.values[capacity - 1].sum;
+    }
+
     return uint32_t(buf.counter);
 }
@@ -24,36 +24,88 @@ float convert_infinite_reverze_z_depth(float depth) {
     return NEAR_PLANE / depth;
 }
 
+// Sums the meshlet group counts of the instances that survive culling.
+PrefixSumBuffer group_prefix_sum_buffer_for_cascade(uint32_t cascade_index) {
+    return PrefixSumBuffer(
+        get_uniforms().num_meshlet_groups_prefix_sum
+        + cascade_index * PREFIX_SUM_BUFFER_SECTOR_SIZE
+    );
+}
+
+// Sums the meshlet counts of the meshlet groups that survive culling.
 PrefixSumBuffer prefix_sum_buffer_for_cascade(uint32_t cascade_index) {
     return PrefixSumBuffer(
         get_uniforms().num_meshlets_prefix_sum
-        + cascade_index * PREFIX_SUM_BUFFER_SECTOR_SIZE
+        + cascade_index * MESHLET_PREFIX_SUM_BUFFER_SECTOR_SIZE
+    );
+}
+
+uint32_t total_num_meshlet_groups_for_cascade(uint32_t cascade_index) {
+    return prefix_sum_total(
+        group_prefix_sum_buffer_for_cascade(cascade_index),
+        MAX_INSTANCES
     );
 }
 
 uint32_t total_num_meshlets_for_cascade(uint32_t cascade_index) {
-    return prefix_sum_total(prefix_sum_buffer_for_cascade(cascade_index));
+    return prefix_sum_total(
+        prefix_sum_buffer_for_cascade(cascade_index),
+        MAX_VISIBLE_MESHLET_GROUPS
+    );
 }
 
 uint32_t dispatch_size(uint32_t width, uint32_t workgroup_size) {
     return (select(width == 0, 1, width - 1) / workgroup_size) + 1;
 }
 
+uint32_t pack_meshlet_group_reference(
+    uint32_t instance_index,
+    uint32_t group_index
+) {
+    return instance_index << 16 | group_index;
+}
+
+// Returns the instance index and writes out the group index within the
+// instance's mesh.
+uint32_t get_meshlet_group_reference(
+    uint32_t global_group_index,
+    uint32_t cascade_index,
+    out uint32_t group_index
+) {
+    PrefixSumValue result = prefix_sum_binary_search(
+        group_prefix_sum_buffer_for_cascade(cascade_index),
+        MAX_INSTANCES,
+        global_group_index
+    );
+    Instance instance =
+        InstanceBuffer(get_uniforms().instances).instances[result.index];
+    MeshInfo mesh_info = MeshInfoBuffer(instance.mesh_info_address).mesh_info;
+
+    group_index =
+        global_group_index - (result.sum - meshlet_group_count(mesh_info));
+    return result.index;
+}
+
 MeshletReference
 get_meshlet_reference(uint32_t global_meshlet_index, uint32_t cascade_index) {
     PrefixSumValue result = prefix_sum_binary_search(
         prefix_sum_buffer_for_cascade(cascade_index),
+        MAX_VISIBLE_MESHLET_GROUPS,
         global_meshlet_index
     );
+    uint32_t instance_index = result.index >> 16;
+    uint32_t group_index = result.index & 0xffff;
+
     Instance instance =
-        InstanceBuffer(get_uniforms().instances).instances[result.index];
+        InstanceBuffer(get_uniforms().instances).instances[instance_index];
     MeshInfo mesh_info = MeshInfoBuffer(instance.mesh_info_address).mesh_info;
 
-    uint32_t local_meshlet_index =
-        global_meshlet_index - (result.sum - mesh_info.num_meshlets);
+    uint32_t local_meshlet_index = group_index * MESHLET_GROUP_SIZE
+        + global_meshlet_index
+        - (result.sum - meshlet_group_meshlet_count(mesh_info, group_index));
 
     MeshletReference reference;
-    reference.instance_index = result.index;
+    reference.instance_index = instance_index;
     reference.meshlet_index = uint16_t(local_meshlet_index);
     return reference;
 }
@@ -63,8 +115,8 @@ void reset_counters() {
     draw_call_buf.num_opaque = 0;
     draw_call_buf.num_alpha_clip = 0;
 
-    prefix_sum_reset(prefix_sum_buffer_for_cascade(0));
-    prefix_sum_reset(prefix_sum_buffer_for_cascade(1));
-    prefix_sum_reset(prefix_sum_buffer_for_cascade(2));
-    prefix_sum_reset(prefix_sum_buffer_for_cascade(3));
+    for (uint32_t cascade_index = 0; cascade_index < 4; cascade_index++) {
+        prefix_sum_reset(group_prefix_sum_buffer_for_cascade(cascade_index));
+        prefix_sum_reset(prefix_sum_buffer_for_cascade(cascade_index));
+    }
 }
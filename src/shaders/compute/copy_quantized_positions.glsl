@@ -4,6 +4,10 @@ layout(push_constant) uniform PushConstant {
     CopyQuantizedPositionsConstant copy;
 };
 
+layout(buffer_reference, scalar) buffer CopyQuantizedJobs {
+    CopyQuantizedJob jobs[];
+};
+
 layout(buffer_reference, scalar) buffer Uint16_t4 {
     uint16_t4 values[];
 };
@@ -25,25 +29,23 @@ layout(buffer_reference, scalar, buffer_reference_align = 1) buffer Uint8_t3 {
 layout(local_size_x = 64) in;
 
 void copy_quantized_positions() {
-    uint32_t index = gl_GlobalInvocationID.x;
+    CopyQuantizedJob job = CopyQuantizedJobs(copy.jobs).jobs[gl_WorkGroupID.x];
 
-    if (index >= copy.count) {
-        return;
+    for (uint32_t index = gl_LocalInvocationID.x; index < job.count;
+         index += 64) {
+        uint16_t4 value = Uint16_t4(job.src).values[index];
+        Uint16_t3(job.dst).values[index] = value.xyz;
     }
-
-    uint16_t4 value = Uint16_t4(copy.src).values[index];
-    Uint16_t3(copy.dst).values[index] = value.xyz;
 }
 
 layout(local_size_x = 64) in;
 
 void copy_quantized_normals() {
-    uint32_t index = gl_GlobalInvocationID.x;
+    CopyQuantizedJob job = CopyQuantizedJobs(copy.jobs).jobs[gl_WorkGroupID.x];
 
-    if (index >= copy.count) {
-        return;
+    for (uint32_t index = gl_LocalInvocationID.x; index < job.count;
+         index += 64) {
+        uint8_t4 value = Uint8_t4(job.src).values[index];
+        Uint8_t3(job.dst).values[index] = value.xyz;
     }
-
-    uint8_t4 value = Uint8_t4(copy.src).values[index];
-    Uint8_t3(copy.dst).values[index] = value.xyz;
 }
@@ -12,6 +12,14 @@ void reset_buffers_a() {
     buf.misc_storage.min_depth = UINT32_T_MAX_VALUE;
     buf.misc_storage.max_depth = 0;
 
+    CullingCounts zero = CullingCounts(0, 0, 0);
+    buf.misc_storage.culling_stats =
+        CullingStats(zero, zero, zero, zero, zero, zero, 0);
+
+    for (uint32_t i = 0; i < MAX_BINDLESS_TEXTURES; i++) {
+        buf.misc_storage.texture_feedback[i] = 0;
+    }
+
     DispatchCommandsBuffer dispatches =
         DispatchCommandsBuffer(get_uniforms().dispatches);
 
@@ -33,14 +41,42 @@ void reset_buffers_b() {
     DispatchCommandsBuffer dispatches =
         DispatchCommandsBuffer(get_uniforms().dispatches);
 
+    dispatches.commands[PER_MESHLET_GROUP_DISPATCH].x =
+        dispatch_size(total_num_meshlet_groups_for_cascade(0), 64);
+    dispatches.commands[PER_MESHLET_GROUP_DISPATCH].y = 1;
+    dispatches.commands[PER_MESHLET_GROUP_DISPATCH].z = 1;
+}
+
+// After the shadow prefix sum.
+void reset_buffers_c() {
+    DispatchCommandsBuffer dispatches =
+        DispatchCommandsBuffer(get_uniforms().dispatches);
+
+    dispatches.commands[PER_MESHLET_GROUP_DISPATCH].x = dispatch_size(
+        total_num_meshlet_groups_for_cascade(shadow_constant.cascade_index),
+        64
+    );
+    dispatches.commands[PER_MESHLET_GROUP_DISPATCH].y = 1;
+    dispatches.commands[PER_MESHLET_GROUP_DISPATCH].z = 1;
+
+    DrawCallBuffer draw_call_buf = DrawCallBuffer(get_uniforms().draw_calls);
+    draw_call_buf.num_opaque = 0;
+    draw_call_buf.num_alpha_clip = 0;
+}
+
+// After meshlet group culling.
+void reset_buffers_d() {
+    DispatchCommandsBuffer dispatches =
+        DispatchCommandsBuffer(get_uniforms().dispatches);
+
     dispatches.commands[PER_MESHLET_DISPATCH].x =
         dispatch_size(total_num_meshlets_for_cascade(0), 64);
     dispatches.commands[PER_MESHLET_DISPATCH].y = 1;
     dispatches.commands[PER_MESHLET_DISPATCH].z = 1;
 }
 
-// After the shadow prefix sum.
-void reset_buffers_c() {
+// After shadow meshlet group culling.
+void reset_buffers_e() {
     DispatchCommandsBuffer dispatches =
         DispatchCommandsBuffer(get_uniforms().dispatches);
 
@@ -50,8 +86,4 @@ void reset_buffers_c() {
     );
     dispatches.commands[PER_MESHLET_DISPATCH].y = 1;
     dispatches.commands[PER_MESHLET_DISPATCH].z = 1;
-
-    DrawCallBuffer draw_call_buf = DrawCallBuffer(get_uniforms().draw_calls);
-    draw_call_buf.num_opaque = 0;
-    draw_call_buf.num_alpha_clip = 0;
 }
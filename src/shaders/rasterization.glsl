@@ -22,9 +22,10 @@ VertexData load_vertex_data(uint32_t vertex_index, uint32_t instance_index) {
     Meshlet meshlet = MeshletBuffer(vertex_data.mesh_info.meshlets)
                           .meshlets[meshlet_reference.meshlet_index];
 
-    uint32_t micro_index = meshlet.index_offset
+    uint32_t micro_index = meshlet_index_offset(meshlet)
         + MicroIndexBufferSingle(
-              vertex_data.mesh_info.micro_indices + meshlet.triangle_offset
+              vertex_data.mesh_info.micro_indices
+              + meshlet_triangle_offset(meshlet)
         )
               .indices[vertex_index];
 
@@ -22,9 +22,16 @@ struct MeshInfo {
     uint64_t uvs;
     uint64_t micro_indices;
     uint64_t meshlets;
+    // One `MeshletLod` per meshlet.
+    uint64_t meshlet_lods;
+    // One `MeshletGroup` per `MESHLET_GROUP_SIZE` meshlets.
+    uint64_t meshlet_groups;
     uint16_t num_meshlets;
     uint8_t flags;
     vec4 bounding_sphere;
+    // Meshlet boxes are quantized relative to this.
+    vec3 aabb_min;
+    vec3 aabb_max;
     vec2 texture_scale;
     vec2 texture_offset;
     uint16_t base_color_texture_index;
@@ -33,6 +40,31 @@ struct MeshInfo {
     vec3 base_color_factor;
 };
 
+// How many things each culling test looked at and how many it culled, counted
+// while `Uniforms::count_culling` is set. The box test only sees what the
+// sphere test kept, so `culled_by_aabb` is what the boxes cull on top.
+struct CullingCounts {
+    uint32_t tested;
+    uint32_t culled_by_sphere;
+    uint32_t culled_by_aabb;
+};
+
+// The shadow counts are summed over all the cascades.
+struct CullingStats {
+    CullingCounts instances;
+    CullingCounts meshlet_groups;
+    CullingCounts meshlets;
+    CullingCounts shadow_instances;
+    CullingCounts shadow_meshlet_groups;
+    CullingCounts shadow_meshlets;
+    // Meshlet groups that survived culling but didn't fit into
+    // `MAX_VISIBLE_MESHLET_GROUPS`, summed over all the views.
+    uint32_t dropped_meshlet_groups;
+};
+
+// The size of the bindless texture array.
+const static uint32_t MAX_BINDLESS_TEXTURES = 512;
+
 struct MiscStorage {
     mat4 shadow_matrices[4];
     mat4 uv_space_shadow_matrices[4];
@@ -40,6 +72,11 @@ struct MiscStorage {
     float shadow_sphere_radii[4];
     uint32_t min_depth;
     uint32_t max_depth;
+    CullingStats culling_stats;
+    // Per bindless texture, the most levels below a 1x1 texel texture that
+    // any pixel's footprint was this frame, or 0 if nothing sampled it. See
+    // `TextureStreamer`.
+    uint32_t texture_feedback[MAX_BINDLESS_TEXTURES];
 };
 
 // This is only an int32_t because of imgui.
@@ -62,6 +99,7 @@ struct Uniforms {
     uint64_t instances;
     uint64_t draw_calls;
     uint64_t misc_storage;
+    uint64_t num_meshlet_groups_prefix_sum;
     uint64_t num_meshlets_prefix_sum;
     uint64_t dispatches;
     vec3 camera_pos;
@@ -73,6 +111,10 @@ struct Uniforms {
     float cascade_split_pow;
     int32_t debug;
     bool debug_shadowmaps;
+    // How many pixels of simplification error the LOD selection allows.
+    float lod_pixel_error;
+    // Not a bool so that it's the same size on both sides.
+    uint32_t count_culling;
 };
 
 // Same as VkDrawIndirectCommand
@@ -106,10 +148,17 @@ struct CalcBoundingSphereConstant {
     uint32_t num_vertices;
 };
 
-struct CopyQuantizedPositionsConstant {
+// One range of vertices to strip the padding element from. Each workgroup of
+// `copy_quantized_positions`/`copy_quantized_normals` handles one job.
+struct CopyQuantizedJob {
     uint64_t dst;
     uint64_t src;
     uint32_t count;
+    uint32_t padding;
+};
+
+struct CopyQuantizedPositionsConstant {
+    uint64_t jobs;
 };
 
 struct UniformBufferAddressConstant {
@@ -126,16 +175,72 @@ const static uint32_t MESHLET_INDICES_BUFFER_SECTION_OFFSET =
 
 const static float NEAR_PLANE = 0.01f;
 
+// Packed to keep the loads small, as this is read for every meshlet when
+// culling, every vertex and every pixel. Packed in `meshlets.cpp` and unpacked
+// in `common/meshlets.glsl`.
 struct Meshlet {
-    vec3 cone_apex;
-    vec3 cone_axis;
-    float cone_cutoff;
+    // The center relative to the mesh's bounding sphere and the radius, as
+    // halfs. The radius is rounded up to cover the error in the center.
+    uvec2 bounding_sphere;
+    // The min and max corners as `MESHLET_AABB_BITS` fractions of the mesh's
+    // box on each axis, x in the low bits. The min is rounded down and the
+    // max up.
+    uvec2 aabb;
+    // Quantized as in meshoptimizer's `cone_axis_s8` and `cone_cutoff_s8`.
+    i8vec3 cone_axis;
+    int8_t cone_cutoff;
+    // Offsets in the high `32 - MESHLET_COUNT_BITS` bits and counts in the
+    // low bits. The buffers these index into are often large enough to
+    // require more than 16-bit offsets.
+    uint32_t triangle_offset_and_count;
+    uint32_t index_offset_and_count;
+};
+
+const static uint32_t MESHLET_AABB_BITS = 10;
+const static uint32_t MESHLET_AABB_MASK = (1 << MESHLET_AABB_BITS) - 1;
+
+const static uint32_t MESHLET_COUNT_BITS = 8;
+const static uint32_t MESHLET_COUNT_MASK = (1 << MESHLET_COUNT_BITS) - 1;
+const static uint32_t MESHLET_MAX_OFFSET = 1 << (32 - MESHLET_COUNT_BITS);
+// meshoptimizer starts each meshlet's micro indices on a 4 byte boundary, so
+// triangle offsets are stored in units of 4 bytes.
+const static uint32_t MESHLET_TRIANGLE_OFFSET_UNIT = 4;
+
+// The bounds of `MESHLET_GROUP_SIZE` consecutive meshlets (fewer for the last
+// group), packed the same way as in `Meshlet`. Meshlets are built in a
+// spatially coherent order, so neighbours in the buffer are usually
+// neighbours in the mesh and the bounds stay tight. Whole groups are culled
+// before their meshlets are looked at.
+//
+// The LOD fields bound the `MeshletLod`s of the group's meshlets, so that a
+// group none of whose meshlets can be in the LOD cut is skipped too: the
+// first sphere contains all of their spheres and goes with the smallest of
+// their errors, the second contains all of their parent spheres and goes
+// with the largest of their parent errors. Meshlets are appended level by
+// level, so a group mostly holds a single level and the bounds stay tight.
+struct MeshletGroup {
+    uvec2 bounding_sphere;
+    uvec2 aabb;
+    vec4 lod_bounding_sphere;
+    vec4 lod_parent_bounding_sphere;
+    float lod_min_error;
+    float lod_max_parent_error;
+};
+
+const static uint32_t MESHLET_GROUP_SIZE = 32;
+
+// Where a meshlet sits in the mesh's LOD hierarchy. Meshlets are simplified in
+// groups, and every meshlet in a group shares the group's sphere and error as
+// its own, and the sphere and error of the group it was simplified into as its
+// parent's. A meshlet is drawn when its own error is small enough on screen
+// but its parent's isn't, which picks exactly one level for every part of the
+// mesh. Meshlets that were never simplified further have `FLT_MAX` as their
+// parent error.
+struct MeshletLod {
     vec4 bounding_sphere;
-    // The buffers these index into are often large enough to require 32-bit offsets.
-    uint32_t triangle_offset;
-    uint32_t index_offset;
-    uint8_t triangle_count;
-    uint8_t index_count;
+    vec4 parent_bounding_sphere;
+    float error;
+    float parent_error;
 };
 
 // Allows for indexing a meshlet in the mesh that an instance represents.
@@ -161,6 +266,15 @@ const static uint32_t MAX_INSTANCES = 1024;
 // MAX_INSTANCES * sizeof(PrefixSumValue) + sizeof(uint64_t)
 const static uint32_t PREFIX_SUM_BUFFER_SECTOR_SIZE = MAX_INSTANCES * 8 + 8;
 
+// How many meshlet groups can survive culling in one view. Surviving groups
+// are referred to with the instance index in the high 16 bits and the group
+// index in the low bits.
+const static uint32_t MAX_VISIBLE_MESHLET_GROUPS = 1 << 17;
+
+const static uint32_t MESHLET_PREFIX_SUM_BUFFER_SECTOR_SIZE =
+    MAX_VISIBLE_MESHLET_GROUPS * 8 + 8;
+
 const static uint32_t PER_INSTANCE_DISPATCH = 0;
 const static uint32_t PER_SHADOW_INSTANCE_DISPATCH = 1;
-const static uint32_t PER_MESHLET_DISPATCH = 2;
+const static uint32_t PER_MESHLET_GROUP_DISPATCH = 2;
+const static uint32_t PER_MESHLET_DISPATCH = 3;
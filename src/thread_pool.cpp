@@ -0,0 +1,60 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(size_t num_workers) {
+    workers.reserve(num_workers);
+
+    for (size_t i = 0; i < num_workers; i++) {
+        workers.push_back(std::thread([this]() {
+            while (true) {
+                std::function<void()> task;
+
+                {
+                    std::unique_lock lock(mutex);
+                    condition.wait(lock, [this]() {
+                        return stopping || !tasks.empty();
+                    });
+
+                    if (stopping && tasks.empty()) {
+                        return;
+                    }
+
+                    task = std::move(tasks.front());
+                    tasks.pop_front();
+                }
+
+                task();
+            }
+        }));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock lock(mutex);
+        stopping = true;
+    }
+
+    condition.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::push(std::function<void()> task) {
+    {
+        std::unique_lock lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+
+    condition.notify_one();
+}
+
+ThreadPool& ThreadPool::global() {
+    // The main thread always participates in `parallel_for`,
+    // so leave a core for it.
+    static ThreadPool pool(
+        std::max(std::thread::hardware_concurrency(), 2u) - 1
+    );
+    return pool;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+// A fixed set of worker threads used to spread CPU-heavy loading work
+// (meshlet building, decoding etc.) over all cores.
+struct ThreadPool {
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+
+    ThreadPool(size_t num_workers);
+
+    ~ThreadPool();
+
+    void push(std::function<void()> task);
+
+    static ThreadPool& global();
+};
+
+// Call `func(i)` for every `i` in `[0, count)` using the global thread pool.
+// The calling thread works on items too, so this is safe to call from
+// inside a worker (nested calls just get fewer helpers).
+// Results should be written into pre-sized, per-index storage so that
+// output stays deterministic regardless of scheduling.
+// If `func` throws, the items that haven't started yet are skipped and the
+// first exception is rethrown on the calling thread once the rest are done.
+template<class F>
+void parallel_for(size_t count, const F& func) {
+    if (count == 0) {
+        return;
+    }
+
+    struct State {
+        std::atomic<size_t> next = 0;
+        std::atomic<size_t> completed = 0;
+        std::mutex mutex;
+        std::exception_ptr exception;
+    };
+
+    auto state = std::make_shared<State>();
+
+    // Helpers that start after all the items have been claimed
+    // exit without touching `func`.
+    auto run = [state, count, &func]() {
+        size_t i;
+        while ((i = state->next.fetch_add(1)) < count) {
+            try {
+                func(i);
+            } catch (...) {
+                std::unique_lock lock(state->mutex);
+                if (!state->exception) {
+                    state->exception = std::current_exception();
+                }
+                // Items that were already claimed still count as completed
+                // when they finish, so only the unclaimed ones are skipped.
+                auto claimed = std::min(state->next.exchange(count), count);
+                state->completed.fetch_add(count - claimed);
+            }
+            if (state->completed.fetch_add(1) + 1 == count) {
+                state->completed.notify_all();
+            }
+        }
+    };
+
+    auto& pool = ThreadPool::global();
+    auto num_helpers = std::min(pool.workers.size(), count - 1);
+
+    for (size_t i = 0; i < num_helpers; i++) {
+        pool.push(run);
+    }
+
+    run();
+
+    size_t completed;
+    while ((completed = state->completed.load()) < count) {
+        state->completed.wait(completed);
+    }
+
+    if (state->exception) {
+        std::rethrow_exception(state->exception);
+    }
+}